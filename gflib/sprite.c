@@ -2,6 +2,7 @@
 #include "sprite.h"
 #include "main.h"
 #include "palette.h"
+#include "frame_profiler.h"
 
 #define MAX_SPRITE_COPY_REQUESTS 64
 
@@ -13,6 +14,21 @@
     (sSpriteTileRanges + 1)[index * 2] = count;    \
 }
 
+#if MODERN
+// The tile bitmap is kept in words so that the allocator can skip over 32
+// tiles at a time.
+#define ALLOC_SPRITE_TILE(n)                               \
+{                                                          \
+    sSpriteTileAllocBitmap[(n) / 32] |= (1u << ((n) % 32)); \
+}
+
+#define FREE_SPRITE_TILE(n)                                 \
+{                                                           \
+    sSpriteTileAllocBitmap[(n) / 32] &= ~(1u << ((n) % 32)); \
+}
+
+#define SPRITE_TILE_IS_ALLOCATED(n) ((sSpriteTileAllocBitmap[(n) / 32] >> ((n) % 32)) & 1)
+#else
 #define ALLOC_SPRITE_TILE(n)                             \
 {                                                        \
     sSpriteTileAllocBitmap[(n) / 8] |= (1 << ((n) % 8)); \
@@ -24,6 +40,7 @@
 }
 
 #define SPRITE_TILE_IS_ALLOCATED(n) ((sSpriteTileAllocBitmap[(n) / 8] >> ((n) % 8)) & 1)
+#endif
 
 
 struct SpriteCopyRequest
@@ -307,14 +324,25 @@ u32 gOamMatrixAllocBitmap;
 u8 gReservedSpritePaletteCount;
 
 EWRAM_DATA struct Sprite gSprites[MAX_SPRITES + 1] = {0};
+#if MODERN
+EWRAM_DATA static u32 sSpriteSortKeys[MAX_SPRITES] = {0};
+EWRAM_DATA static bool8 sSpriteSortKeysChanged = FALSE;
+#else
 EWRAM_DATA static u16 sSpritePriorities[MAX_SPRITES] = {0};
+#endif
 EWRAM_DATA static u8 sSpriteOrder[MAX_SPRITES] = {0};
 EWRAM_DATA static bool8 sShouldProcessSpriteCopyRequests = 0;
 EWRAM_DATA static u8 sSpriteCopyRequestCount = 0;
 EWRAM_DATA static struct SpriteCopyRequest sSpriteCopyRequests[MAX_SPRITES] = {0};
 EWRAM_DATA u8 gOamLimit = 0;
 EWRAM_DATA u16 gReservedSpriteTileCount = 0;
+#if MODERN
+EWRAM_DATA static u32 sSpriteTileAllocBitmap[TOTAL_OBJ_TILE_COUNT / 32] = {0};
+EWRAM_DATA static u16 sSpriteTileAllocFailures = 0;
+EWRAM_DATA static u16 sLastFailedSpriteTileCount = 0;
+#else
 EWRAM_DATA static u8 sSpriteTileAllocBitmap[128] = {0};
+#endif
 EWRAM_DATA s16 gSpriteCoordOffsetX = 0;
 EWRAM_DATA s16 gSpriteCoordOffsetY = 0;
 EWRAM_DATA struct OamMatrix gOamMatrices[OAM_MATRIX_COUNT] = {0};
@@ -343,7 +371,9 @@ void AnimateSprites(void)
 
         if (sprite->inUse)
         {
+            FrameProfiler_BeginCall(PROFILE_SPRITE_CALLBACK, sprite->callback);
             sprite->callback(sprite);
+            FrameProfiler_EndCall();
 
             if (sprite->inUse)
                 AnimateSprite(sprite);
@@ -387,6 +417,75 @@ void UpdateOamCoords(void)
     }
 }
 
+#if MODERN
+// Sprites are drawn in order of priority, then subpriority, then from the
+// bottom of the screen up. Sorting by one key per sprite gives exactly the
+// order that the comparisons in the original SortSprites do.
+static u32 GetSpriteSortKey(struct Sprite *sprite)
+{
+    u16 priority = sprite->subpriority | (sprite->oam.priority << 8);
+    s16 y = sprite->oam.y;
+
+    if (y >= DISPLAY_HEIGHT)
+        y = y - 256;
+
+    if (sprite->oam.affineMode == ST_OAM_AFFINE_DOUBLE
+     && sprite->oam.size == ST_OAM_SIZE_3)
+    {
+        u32 shape = sprite->oam.shape;
+        if (shape == ST_OAM_SQUARE || shape == ST_OAM_V_RECTANGLE)
+        {
+            if (y > 128)
+                y = y - 256;
+        }
+    }
+
+    return (priority << 16) | (u16)(0x8000 - y);
+}
+
+void BuildSpritePriorities(void)
+{
+    u16 i;
+    for (i = 0; i < MAX_SPRITES; i++)
+    {
+        u32 key = GetSpriteSortKey(&gSprites[i]);
+
+        if (sSpriteSortKeys[i] != key)
+        {
+            sSpriteSortKeys[i] = key;
+            sSpriteSortKeysChanged = TRUE;
+        }
+    }
+}
+
+// Stable, like the original, so sprites that tie keep last frame's order.
+// Most frames only a few sprites move past each other, if any, so starting
+// from last frame's order there is little left to do.
+void SortSprites(void)
+{
+    u8 i;
+
+    if (!sSpriteSortKeysChanged)
+        return;
+
+    for (i = 1; i < MAX_SPRITES; i++)
+    {
+        u8 spriteId = sSpriteOrder[i];
+        u32 key = sSpriteSortKeys[spriteId];
+        u8 j = i;
+
+        while (j > 0 && sSpriteSortKeys[sSpriteOrder[j - 1]] > key)
+        {
+            sSpriteOrder[j] = sSpriteOrder[j - 1];
+            j--;
+        }
+
+        sSpriteOrder[j] = spriteId;
+    }
+
+    sSpriteSortKeysChanged = FALSE;
+}
+#else
 void BuildSpritePriorities(void)
 {
     u16 i;
@@ -491,6 +590,8 @@ void SortSprites(void)
     }
 }
 
+#endif // MODERN
+
 void CopyMatricesToOamBuffer(void)
 {
     u8 i;
@@ -728,6 +829,144 @@ void CalcCenterToCornerVec(struct Sprite *sprite, u8 shape, u8 size, u8 affineMo
     sprite->centerToCornerVecY = y;
 }
 
+#if MODERN
+// Returns the first tile from start on that is allocated, or free if
+// allocated is FALSE, or TOTAL_OBJ_TILE_COUNT if there is none.
+static u16 FindSpriteTile(u16 start, bool32 allocated)
+{
+    u32 index = start / 32;
+    u32 word;
+
+    if (start >= TOTAL_OBJ_TILE_COUNT)
+        return TOTAL_OBJ_TILE_COUNT;
+
+    word = allocated ? sSpriteTileAllocBitmap[index] : ~sSpriteTileAllocBitmap[index];
+    word &= 0xFFFFFFFF << (start % 32);
+
+    while (word == 0)
+    {
+        if (++index == ARRAY_COUNT(sSpriteTileAllocBitmap))
+            return TOTAL_OBJ_TILE_COUNT;
+
+        word = allocated ? sSpriteTileAllocBitmap[index] : ~sSpriteTileAllocBitmap[index];
+    }
+
+    // Tiles go from the low bit up, so the first one is the lowest set bit.
+    return index * 32 + __builtin_ctz(word);
+}
+
+static void SetSpriteTilesAllocated(u16 start, u16 count, bool32 allocated)
+{
+    u32 end = start + count;
+
+    while (start < end)
+    {
+        u32 index = start / 32;
+        u32 shift = start % 32;
+        u32 numBits = min(32 - shift, end - start);
+        u32 mask = (numBits == 32 ? 0xFFFFFFFF : ((1u << numBits) - 1)) << shift;
+
+        if (allocated)
+            sSpriteTileAllocBitmap[index] |= mask;
+        else
+            sSpriteTileAllocBitmap[index] &= ~mask;
+
+        start += numBits;
+    }
+}
+
+// Picks the first free range of tiles that is big enough, or with
+// BEST_FIT_SPRITE_TILES, the smallest one.
+s16 AllocSpriteTiles(u16 tileCount)
+{
+    u16 start;
+    u16 end;
+    s16 bestStart = -1;
+    u16 bestCount = 0xFFFF;
+
+    if (tileCount == 0)
+    {
+        // Free all unreserved tiles if the tile count is 0.
+        SetSpriteTilesAllocated(gReservedSpriteTileCount, TOTAL_OBJ_TILE_COUNT - gReservedSpriteTileCount, FALSE);
+        return 0;
+    }
+
+    for (start = FindSpriteTile(gReservedSpriteTileCount, FALSE); start < TOTAL_OBJ_TILE_COUNT; start = FindSpriteTile(end, FALSE))
+    {
+        end = FindSpriteTile(start, TRUE);
+
+        if (end - start >= tileCount && end - start < bestCount)
+        {
+            bestStart = start;
+            bestCount = end - start;
+#ifdef BEST_FIT_SPRITE_TILES
+            if (bestCount == tileCount)
+                break;
+#else
+            break;
+#endif
+        }
+    }
+
+    if (bestStart < 0)
+    {
+        sSpriteTileAllocFailures++;
+        sLastFailedSpriteTileCount = tileCount;
+#ifndef NDEBUG
+        {
+            struct SpriteTileAllocStats stats;
+
+            GetSpriteTileAllocStats(&stats);
+            AGBPrintf("AllocSpriteTiles: no room for %d tiles, %d free in %d ranges, largest %d\n",
+                      tileCount, stats.freeTiles, stats.freeRanges, stats.largestFreeRange);
+        }
+#endif
+        return -1;
+    }
+
+    SetSpriteTilesAllocated(bestStart, tileCount, TRUE);
+    return bestStart;
+}
+
+// Shows how fragmented the free sprite tiles are, and what the last request
+// that couldn't be met was.
+void GetSpriteTileAllocStats(struct SpriteTileAllocStats *stats)
+{
+    u16 start;
+    u16 end;
+
+    stats->freeTiles = 0;
+    stats->freeRanges = 0;
+    stats->largestFreeRange = 0;
+    stats->failedAllocs = sSpriteTileAllocFailures;
+    stats->lastFailedTileCount = sLastFailedSpriteTileCount;
+
+    for (start = FindSpriteTile(gReservedSpriteTileCount, FALSE); start < TOTAL_OBJ_TILE_COUNT; start = FindSpriteTile(end, FALSE))
+    {
+        end = FindSpriteTile(start, TRUE);
+        stats->freeTiles += end - start;
+        stats->freeRanges++;
+
+        if (end - start > stats->largestFreeRange)
+            stats->largestFreeRange = end - start;
+    }
+}
+
+u8 SpriteTileAllocBitmapOp(u16 bit, u8 op)
+{
+    u32 mask = 1u << (bit % 32);
+    u8 retVal = 0;
+
+    if (op == 0)
+        sSpriteTileAllocBitmap[bit / 32] &= ~mask;
+    else if (op == 1)
+        sSpriteTileAllocBitmap[bit / 32] |= mask;
+    else
+        retVal = (sSpriteTileAllocBitmap[bit / 32] & mask) >> (bit % 32 - bit % 8);
+
+    return retVal;
+}
+#else
 s16 AllocSpriteTiles(u16 tileCount)
 {
     u16 i;
@@ -807,6 +1046,8 @@ u8 SpriteTileAllocBitmapOp(u16 bit, u8 op)
     return retVal;
 }
 
+#endif // MODERN
+
 void SpriteCallbackDummy(struct Sprite *sprite)
 {
 }
@@ -885,6 +1126,9 @@ void ResetAllSprites(void)
     }
 
     ResetSprite(&gSprites[i]);
+#if MODERN
+    sSpriteSortKeysChanged = TRUE;
+#endif
 }
 
 // UB: template pointer may point to freed temporary storage
@@ -1534,8 +1778,12 @@ void FreeSpriteTilesByTag(u16 tag)
         rangeCounts = sSpriteTileRanges + 1;
         count = rangeCounts[index * 2];
 
+#if MODERN
+        SetSpriteTilesAllocated(start, count, FALSE);
+#else
         for (i = start; i < start + count; i++)
             FREE_SPRITE_TILE(i);
+#endif
 
         sSpriteTileRangeTags[index] = 0xFFFF;
     }
@@ -237,6 +237,17 @@ struct Sprite
     /*0x43*/ u8 subpriority;
 };
 
+#if MODERN
+struct SpriteTileAllocStats
+{
+    u16 freeTiles;
+    u16 freeRanges;
+    u16 largestFreeRange;
+    u16 failedAllocs;        // AllocSpriteTiles calls that returned -1 so far
+    u16 lastFailedTileCount; // tiles asked for by the last of them
+};
+#endif
+
 struct OamMatrix
 {
     s16 a;
@@ -318,6 +329,9 @@ bool8 AddSubspritesToOamBuffer(struct Sprite *sprite, struct OamData *destOam, u
 void CopyToSprites(u8 *src);
 void CopyFromSprites(u8 *dest);
 u8 SpriteTileAllocBitmapOp(u16 bit, u8 op);
+#if MODERN
+void GetSpriteTileAllocStats(struct SpriteTileAllocStats *stats);
+#endif
 void ClearSpriteCopyRequests(void);
 void ResetAffineAnimData(void);
 
@@ -0,0 +1,641 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "global.h"
+#include "main.h"
+#include "malloc.h"
+#include "bg.h"
+#include "dma3.h"
+#include "sprite.h"
+#include "task.h"
+#include "text.h"
+#include "window.h"
+
+// Drives engine hot paths through fixed scenarios and times them per frame.
+// Every scenario runs from the same seed each time, and ends by printing a
+// checksum of the state that it leaves behind, which only changes if the
+// behavior of the code under test does. Runs of DEFAULT_FRAMES frames are
+// checked against the checksum that each scenario is known to give.
+
+#define DEFAULT_FRAMES 10000
+
+struct Scenario
+{
+    const char *name;
+    void (*init)(void);
+    void (*runFrame)(u32 frame);
+    u32 (*checksum)(void);
+    u32 expectedChecksum;
+};
+
+static u32 sRngState;
+
+static u32 Random32(void)
+{
+    // xorshift32
+    sRngState ^= sRngState << 13;
+    sRngState ^= sRngState >> 17;
+    sRngState ^= sRngState << 5;
+    return sRngState;
+}
+
+static u32 HashBytes(u32 hash, const void *data, size_t size)
+{
+    const u8 *bytes = data;
+    size_t i;
+
+    // FNV-1a
+    for (i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 16777619;
+
+    return hash;
+}
+
+#define FNV_OFFSET_BASIS 2166136261u
+
+// Sprites: a busy scene of moving, animating, rotating and respawning sprites,
+// like a battle animation or a contest.
+
+#define TAG_BENCH_SMALL 0x1000
+#define TAG_BENCH_LARGE 0x1001
+#define TAG_BENCH_HUGE  0x1002
+#define NUM_BENCH_SPRITES 60
+
+static u32 sOamHash;
+
+static u8 sSmallSpriteTiles[4 * 4 * TILE_SIZE_4BPP];
+static u8 sLargeSpriteTiles[4 * 16 * TILE_SIZE_4BPP];
+static u8 sHugeSpriteTiles[64 * TILE_SIZE_4BPP];
+
+static const struct SpriteSheet sBenchSpriteSheets[] =
+{
+    {sSmallSpriteTiles, sizeof(sSmallSpriteTiles), TAG_BENCH_SMALL},
+    {sLargeSpriteTiles, sizeof(sLargeSpriteTiles), TAG_BENCH_LARGE},
+    {sHugeSpriteTiles, sizeof(sHugeSpriteTiles), TAG_BENCH_HUGE},
+    {},
+};
+
+static const struct OamData sOam_Small =
+{
+    .affineMode = ST_OAM_AFFINE_OFF,
+    .shape = SPRITE_SHAPE(16x16),
+    .size = SPRITE_SIZE(16x16),
+};
+
+static const struct OamData sOam_LargeAffine =
+{
+    .affineMode = ST_OAM_AFFINE_DOUBLE,
+    .shape = SPRITE_SHAPE(32x32),
+    .size = SPRITE_SIZE(32x32),
+};
+
+// Double-size 64x64 sprites wrap around the top of the screen differently.
+static const struct OamData sOam_HugeAffine =
+{
+    .affineMode = ST_OAM_AFFINE_DOUBLE,
+    .shape = SPRITE_SHAPE(64x64),
+    .size = SPRITE_SIZE(64x64),
+};
+
+static const union AnimCmd sAnim_Small[] =
+{
+    ANIMCMD_FRAME(0, 4),
+    ANIMCMD_FRAME(4, 4),
+    ANIMCMD_FRAME(8, 4, .hFlip = TRUE),
+    ANIMCMD_FRAME(12, 4),
+    ANIMCMD_JUMP(0),
+};
+
+static const union AnimCmd sAnim_Large[] =
+{
+    ANIMCMD_FRAME(0, 8),
+    ANIMCMD_FRAME(16, 8),
+    ANIMCMD_FRAME(32, 8),
+    ANIMCMD_FRAME(48, 8),
+    ANIMCMD_JUMP(0),
+};
+
+static const union AnimCmd *const sAnims_Small[] =
+{
+    sAnim_Small,
+};
+
+static const union AnimCmd *const sAnims_Large[] =
+{
+    sAnim_Large,
+};
+
+static const union AffineAnimCmd sAffineAnim_Spin[] =
+{
+    AFFINEANIMCMD_FRAME(0x100, 0x100, 0, 0),
+    AFFINEANIMCMD_FRAME(2, 2, 4, 32),
+    AFFINEANIMCMD_FRAME(-2, -2, 4, 32),
+    AFFINEANIMCMD_JUMP(1),
+};
+
+static const union AffineAnimCmd *const sAffineAnims_Spin[] =
+{
+    sAffineAnim_Spin,
+};
+
+static void SpriteCB_Bounce(struct Sprite *sprite);
+
+static const struct SpriteTemplate sSpriteTemplate_HugeAffine =
+{
+    .tileTag = TAG_BENCH_HUGE,
+    .paletteTag = 0xFFFF,
+    .oam = &sOam_HugeAffine,
+    .anims = gDummySpriteAnimTable,
+    .images = NULL,
+    .affineAnims = sAffineAnims_Spin,
+    .callback = SpriteCB_Bounce,
+};
+
+static const struct SpriteTemplate sSpriteTemplate_Small =
+{
+    .tileTag = TAG_BENCH_SMALL,
+    .paletteTag = 0xFFFF,
+    .oam = &sOam_Small,
+    .anims = sAnims_Small,
+    .images = NULL,
+    .affineAnims = gDummySpriteAffineAnimTable,
+    .callback = SpriteCB_Bounce,
+};
+
+static const struct SpriteTemplate sSpriteTemplate_LargeAffine =
+{
+    .tileTag = TAG_BENCH_LARGE,
+    .paletteTag = 0xFFFF,
+    .oam = &sOam_LargeAffine,
+    .anims = sAnims_Large,
+    .images = NULL,
+    .affineAnims = sAffineAnims_Spin,
+    .callback = SpriteCB_Bounce,
+};
+
+#define sVelocityX data[0]
+#define sVelocityY data[1]
+
+// Moves across the whole range of coordinates that OAM wraps around, so that
+// sprites keep changing places in the priority order.
+static void SpriteCB_Bounce(struct Sprite *sprite)
+{
+    sprite->pos1.x += sprite->sVelocityX;
+    sprite->pos1.y += sprite->sVelocityY;
+
+    if (sprite->pos1.x < -64 || sprite->pos1.x > DISPLAY_WIDTH + 64)
+        sprite->sVelocityX = -sprite->sVelocityX;
+    if (sprite->pos1.y < -64 || sprite->pos1.y > 255)
+        sprite->sVelocityY = -sprite->sVelocityY;
+}
+
+static void CreateBenchSprite(void)
+{
+    const struct SpriteTemplate *template;
+    u8 spriteId;
+
+    switch (Random32() % 8)
+    {
+    case 0:
+        template = &sSpriteTemplate_HugeAffine;
+        break;
+    case 1:
+    case 2:
+        template = &sSpriteTemplate_LargeAffine;
+        break;
+    default:
+        template = &sSpriteTemplate_Small;
+        break;
+    }
+
+    spriteId = CreateSprite(template, Random32() % DISPLAY_WIDTH, Random32() % DISPLAY_HEIGHT, Random32() % 256);
+
+    if (spriteId != MAX_SPRITES)
+    {
+        gSprites[spriteId].oam.priority = Random32() % 4;
+        gSprites[spriteId].sVelocityX = (s16)(Random32() % 7) - 3;
+        gSprites[spriteId].sVelocityY = (s16)(Random32() % 7) - 3;
+    }
+}
+
+static void InitSpriteScenario(void)
+{
+    int i;
+
+    for (i = 0; i < (int)sizeof(sSmallSpriteTiles); i++)
+        sSmallSpriteTiles[i] = Random32();
+    for (i = 0; i < (int)sizeof(sLargeSpriteTiles); i++)
+        sLargeSpriteTiles[i] = Random32();
+    for (i = 0; i < (int)sizeof(sHugeSpriteTiles); i++)
+        sHugeSpriteTiles[i] = Random32();
+
+    sOamHash = FNV_OFFSET_BASIS;
+    ResetSpriteData();
+    LoadSpriteSheets(sBenchSpriteSheets);
+
+    for (i = 0; i < NUM_BENCH_SPRITES; i++)
+        CreateBenchSprite();
+}
+
+static void RunSpriteFrame(u32 frame)
+{
+    // Replace a sprite now and then, like effects that come and go.
+    if (frame % 8 == 0)
+    {
+        int i = Random32() % MAX_SPRITES;
+
+        if (gSprites[i].inUse)
+        {
+            if (gSprites[i].oam.affineMode & ST_OAM_AFFINE_ON_MASK)
+                FreeSpriteOamMatrix(&gSprites[i]);
+            DestroySprite(&gSprites[i]);
+            CreateBenchSprite();
+        }
+    }
+
+    AnimateSprites();
+    BuildOamBuffer();
+
+    // VBlank
+    LoadOam();
+    ProcessSpriteCopyRequests();
+
+    // Often enough to catch the sprite order going wrong, without taking
+    // much of the time being measured.
+    if (frame % 64 == 0)
+        sOamHash = HashBytes(sOamHash, gHostOam, sizeof(gHostOam));
+}
+
+static u32 SpriteScenarioChecksum(void)
+{
+    return HashBytes(sOamHash, gHostOam, sizeof(gHostOam));
+}
+
+// Tiles: sprite sheets of many sizes loaded and freed over and over, like
+// the party menu, the PC and battle animations do.
+
+#define NUM_BENCH_SHEETS 24
+#define TAG_BENCH_SHEET 0x2000
+
+static u8 sSheetTiles[64 * TILE_SIZE_4BPP];
+static u32 sTileStartHash;
+
+static void LoadBenchSheet(u16 tag)
+{
+    struct SpriteSheet sheet;
+    u16 tileStart;
+
+    sheet.data = sSheetTiles;
+    sheet.size = (1 + Random32() % 64) * TILE_SIZE_4BPP;
+    sheet.tag = tag;
+    tileStart = LoadSpriteSheet(&sheet);
+    sTileStartHash = HashBytes(sTileStartHash, &tileStart, sizeof(tileStart));
+}
+
+static void InitTileScenario(void)
+{
+    u16 i;
+
+    sTileStartHash = FNV_OFFSET_BASIS;
+    ResetSpriteData();
+
+    for (i = 0; i < NUM_BENCH_SHEETS; i++)
+        LoadBenchSheet(TAG_BENCH_SHEET + i);
+}
+
+static void RunTileFrame(u32 frame)
+{
+    u16 tag = TAG_BENCH_SHEET + Random32() % NUM_BENCH_SHEETS;
+
+    FreeSpriteTilesByTag(tag);
+    LoadBenchSheet(tag);
+}
+
+static u32 TileScenarioChecksum(void)
+{
+    return sTileStartHash;
+}
+
+// Tasks: the mix of long-running tasks, short-lived children and polling
+// that the overworld and battles keep in the task list.
+
+#define tCounter  data[0]
+#define tLifetime data[1]
+
+// Every task run, in order, since that's what the scheduler has to get right.
+static u32 sTaskRunHash;
+
+static void RecordTaskRun(u8 taskId)
+{
+    sTaskRunHash = HashBytes(sTaskRunHash, &taskId, sizeof(taskId));
+}
+
+static void Task_Child(u8 taskId)
+{
+    RecordTaskRun(taskId);
+
+    if (++gTasks[taskId].tCounter >= gTasks[taskId].tLifetime)
+        DestroyTask(taskId);
+}
+
+static void Task_Spawner(u8 taskId)
+{
+    RecordTaskRun(taskId);
+    gTasks[taskId].tCounter++;
+
+    if (Random32() % 4 == 0 && GetTaskCount() < NUM_TASKS - 2)
+    {
+        u8 childId = CreateTask(Task_Child, Random32() % 256);
+
+        gTasks[childId].tLifetime = 1 + Random32() % 32;
+    }
+}
+
+static void Task_Poller(u8 taskId)
+{
+    RecordTaskRun(taskId);
+    gTasks[taskId].tCounter += FuncIsActiveTask(Task_Child);
+    gTasks[taskId].tLifetime = FindTaskIdByFunc(Task_Spawner);
+}
+
+static void Task_Idle(u8 taskId)
+{
+    RecordTaskRun(taskId);
+    gTasks[taskId].tCounter++;
+}
+
+static void InitTaskScenario(void)
+{
+    int i;
+
+    sTaskRunHash = FNV_OFFSET_BASIS;
+    ResetTasks();
+
+    for (i = 0; i < 2; i++)
+        CreateTask(Task_Spawner, Random32() % 256);
+    for (i = 0; i < 2; i++)
+        CreateTask(Task_Poller, Random32() % 256);
+    for (i = 0; i < 6; i++)
+        CreateTask(Task_Idle, Random32() % 256);
+}
+
+static void RunTaskFrame(u32 frame)
+{
+    RunTasks();
+}
+
+static u32 TaskScenarioChecksum(void)
+{
+    u32 hash = sTaskRunHash;
+    u8 taskId;
+
+    for (taskId = 0; taskId < NUM_TASKS; taskId++)
+        hash = HashBytes(hash, gTasks[taskId].data, sizeof(gTasks[taskId].data));
+
+    return hash;
+}
+
+// Text: message boxes printing at normal speed, like the field and battle
+// message windows.
+
+#define NUM_BENCH_WINDOWS 3
+
+static const struct BgTemplate sBenchBgTemplates[] =
+{
+    {
+        .bg = 0,
+        .charBaseIndex = 2,
+        .mapBaseIndex = 31,
+        .screenSize = 0,
+        .paletteMode = 0,
+        .priority = 0,
+        .baseTile = 0
+    },
+};
+
+static const struct WindowTemplate sBenchWindowTemplates[] =
+{
+    {
+        .bg = 0,
+        .tilemapLeft = 2,
+        .tilemapTop = 1,
+        .width = 26,
+        .height = 4,
+        .paletteNum = 15,
+        .baseBlock = 1
+    },
+    {
+        .bg = 0,
+        .tilemapLeft = 2,
+        .tilemapTop = 7,
+        .width = 26,
+        .height = 4,
+        .paletteNum = 15,
+        .baseBlock = 0x69
+    },
+    {
+        .bg = 0,
+        .tilemapLeft = 2,
+        .tilemapTop = 13,
+        .width = 26,
+        .height = 4,
+        .paletteNum = 15,
+        .baseBlock = 0xD1
+    },
+    DUMMY_WIN_TEMPLATE
+};
+
+static const char *const sBenchMessages[NUM_BENCH_WINDOWS] =
+{
+    "The quick brown fox jumps over\nthe lazy dog, 1234567890.",
+    "Wild ZIGZAGOON appeared.\nGo, TREECKO.",
+    "Professor Birch is in trouble.\nRelease a Pokemon and rescue him.",
+};
+
+static u8 sBenchStrings[NUM_BENCH_WINDOWS][80];
+
+// Enough of the game's charmap for the messages above.
+static void ConvertBenchString(u8 *dest, const char *src)
+{
+    for (; *src != 0; src++)
+    {
+        if (*src >= 'A' && *src <= 'Z')
+            *dest++ = CHAR_A + (*src - 'A');
+        else if (*src >= 'a' && *src <= 'z')
+            *dest++ = CHAR_a + (*src - 'a');
+        else if (*src >= '0' && *src <= '9')
+            *dest++ = CHAR_0 + (*src - '0');
+        else if (*src == ',')
+            *dest++ = CHAR_COMMA;
+        else if (*src == '.')
+            *dest++ = CHAR_PERIOD;
+        else if (*src == '\n')
+            *dest++ = CHAR_NEWLINE;
+        else
+            *dest++ = CHAR_SPACE;
+    }
+
+    *dest = EOS;
+}
+
+static void StartBenchPrinter(u8 windowId)
+{
+    FillWindowPixelBuffer(windowId, PIXEL_FILL(1));
+    AddTextPrinterParameterized(windowId, 1, sBenchStrings[windowId], 0, 1, 1, NULL);
+}
+
+static void InitTextScenario(void)
+{
+    u8 i;
+
+    InitHeap(gHeap, HEAP_SIZE);
+    SetDefaultFontsPointer();
+    ResetBgsAndClearDma3BusyFlags(0);
+    InitBgsFromTemplates(0, sBenchBgTemplates, ARRAY_COUNT(sBenchBgTemplates));
+    InitWindows(sBenchWindowTemplates);
+    DeactivateAllTextPrinters();
+
+    for (i = 0; i < NUM_BENCH_WINDOWS; i++)
+    {
+        ConvertBenchString(sBenchStrings[i], sBenchMessages[i]);
+        StartBenchPrinter(i);
+    }
+}
+
+static void RunTextFrame(u32 frame)
+{
+    u8 i;
+
+    for (i = 0; i < NUM_BENCH_WINDOWS; i++)
+    {
+        if (!IsTextPrinterActive(i))
+            StartBenchPrinter(i);
+    }
+
+    RunTextPrinters();
+
+    // VBlank
+    ProcessDma3Requests();
+}
+
+static u32 TextScenarioChecksum(void)
+{
+    return HashBytes(FNV_OFFSET_BASIS, gHostVram, BG_CHAR_SIZE * 3);
+}
+
+static const struct Scenario sScenarios[] =
+{
+    {"sprites", InitSpriteScenario, RunSpriteFrame, SpriteScenarioChecksum, 0xA9A2E58E},
+    {"tiles", InitTileScenario, RunTileFrame, TileScenarioChecksum, 0x9AEF977A},
+    {"tasks", InitTaskScenario, RunTaskFrame, TaskScenarioChecksum, 0xE78C8F43},
+    {"text", InitTextScenario, RunTextFrame, TextScenarioChecksum, 0xC9C8AEE2},
+};
+
+static double GetSeconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Returns whether the scenario left the state it should have.
+static bool32 RunScenario(const struct Scenario *scenario, u32 numFrames)
+{
+    double start;
+    double elapsed;
+    u32 frame;
+    u32 checksum;
+
+    sRngState = 0x12345678;
+    scenario->init();
+
+    start = GetSeconds();
+
+    for (frame = 0; frame < numFrames; frame++)
+        scenario->runFrame(frame);
+
+    elapsed = GetSeconds() - start;
+    checksum = scenario->checksum();
+
+    printf("%-8s %8u frames %10.1f ns/frame  checksum %08X",
+           scenario->name, numFrames, elapsed * 1e9 / numFrames, checksum);
+
+    if (numFrames != DEFAULT_FRAMES)
+    {
+        printf("\n");
+        return TRUE;
+    }
+
+    if (checksum != scenario->expectedChecksum)
+    {
+        printf("  MISMATCH, expected %08X\n", scenario->expectedChecksum);
+        return FALSE;
+    }
+
+    printf("  ok\n");
+    return TRUE;
+}
+
+// The engine keeps function pointers in task data and tile data pointers in
+// window attributes as 32-bit values, which only works while they sit in the
+// low 2 GB. The Makefile links non-PIE to put them there.
+static bool32 PointersFitIn32Bits(void)
+{
+    return (uintptr_t)TaskDummy <= INT32_MAX
+        && (uintptr_t)RunScenario <= INT32_MAX
+        && (uintptr_t)&gHeap[HEAP_SIZE] <= INT32_MAX;
+}
+
+int main(int argc, char **argv)
+{
+    u32 numFrames = DEFAULT_FRAMES;
+    bool32 ranAny = FALSE;
+    bool32 allMatched = TRUE;
+    int i;
+    size_t j;
+
+    if (argc > 1 && strcmp(argv[1], "-n") == 0)
+    {
+        if (argc < 3 || (numFrames = strtoul(argv[2], NULL, 0)) == 0)
+        {
+            fprintf(stderr, "Usage: host_bench [-n FRAMES] [SCENARIO...]\n");
+            return 1;
+        }
+
+        argc -= 2;
+        argv += 2;
+    }
+
+    if (!PointersFitIn32Bits())
+    {
+        fprintf(stderr, "The engine's 32-bit pointer casts need host_bench to be linked non-PIE.\n");
+        return 1;
+    }
+
+    for (j = 0; j < ARRAY_COUNT(sScenarios); j++)
+    {
+        bool32 selected = (argc == 1);
+
+        for (i = 1; i < argc; i++)
+        {
+            if (strcmp(argv[i], sScenarios[j].name) == 0)
+                selected = TRUE;
+        }
+
+        if (selected)
+        {
+            if (!RunScenario(&sScenarios[j], numFrames))
+                allMatched = FALSE;
+            ranAny = TRUE;
+        }
+    }
+
+    if (!ranAny)
+    {
+        fprintf(stderr, "No such scenario.\n");
+        return 1;
+    }
+
+    return allMatched ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+# The fonts that gflib/text.c renders with, from data/fonts.s.
+
+	.section .rodata
+
+	.globl gFont8LatinGlyphs
+	.balign 4
+gFont8LatinGlyphs:
+	.incbin "graphics/fonts/font8.latfont"
+
+	.globl gFont8LatinGlyphWidths
+	.balign 4
+gFont8LatinGlyphWidths:
+	.include "graphics/fonts/font8_latin_widths.inc"
+
+	.globl gFont0LatinGlyphs
+	.balign 4
+gFont0LatinGlyphs:
+	.incbin "graphics/fonts/font0.latfont"
+
+	.globl gFont0LatinGlyphWidths
+	.balign 4
+gFont0LatinGlyphWidths:
+	.include "graphics/fonts/font0_latin_widths.inc"
+
+	.globl gFont7LatinGlyphs
+	.balign 4
+gFont7LatinGlyphs:
+	.incbin "graphics/fonts/font7.latfont"
+
+	.globl gFont7LatinGlyphWidths
+	.balign 4
+gFont7LatinGlyphWidths:
+	.include "graphics/fonts/font7_latin_widths.inc"
+
+	.globl gFont2LatinGlyphs
+	.balign 4
+gFont2LatinGlyphs:
+	.incbin "graphics/fonts/font2.latfont"
+
+	.globl gFont2LatinGlyphWidths
+	.balign 4
+gFont2LatinGlyphWidths:
+	.include "graphics/fonts/font2_latin_widths.inc"
+
+	.globl gFont1LatinGlyphs
+	.balign 4
+gFont1LatinGlyphs:
+	.incbin "graphics/fonts/font1.latfont"
+
+	.globl gFont1LatinGlyphWidths
+	.balign 4
+gFont1LatinGlyphWidths:
+	.include "graphics/fonts/font1_latin_widths.inc"
+
+	.globl gFont0JapaneseGlyphs
+	.balign 4
+gFont0JapaneseGlyphs:
+	.incbin "graphics/fonts/font0.hwjpnfont"
+
+	.globl gFont1JapaneseGlyphs
+	.balign 4
+gFont1JapaneseGlyphs:
+	.incbin "graphics/fonts/font1.hwjpnfont"
+
+	.globl gFont2JapaneseGlyphs
+	.balign 4
+gFont2JapaneseGlyphs:
+	.incbin "graphics/fonts/font2.fwjpnfont"
+
+	.globl gFont2JapaneseGlyphWidths
+	.balign 4
+gFont2JapaneseGlyphWidths:
+	.include "graphics/fonts/font2_japanese_widths.inc"
+
+	.section .note.GNU-stack,"",%progbits
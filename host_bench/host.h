@@ -0,0 +1,55 @@
+#ifndef GUARD_HOST_H
+#define GUARD_HOST_H
+
+// Included ahead of every engine source file in the host build (through
+// -include), so that gflib and src/ compile for the machine running the
+// build instead of the GBA. The GBA headers are pulled in first so that their
+// include guards keep them from being read again, and then the parts of them
+// that name hardware addresses are pointed at plain arrays instead.
+
+#include <stdint.h>
+
+// gba/syscall.h names this in a prototype without declaring it first.
+struct MultiBootParam;
+
+#include "gba/defines.h"
+#include "gba/io_reg.h"
+#include "gba/types.h"
+#include "gba/syscall.h"
+#include "gba/macro.h"
+
+extern u8 gHostIoRegs[0x400];
+extern u8 gHostPltt[PLTT_SIZE];
+extern u8 gHostVram[VRAM_SIZE];
+extern u8 gHostOam[OAM_SIZE];
+
+#undef REG_BASE
+#define REG_BASE ((uintptr_t)gHostIoRegs)
+
+#undef PLTT
+#define PLTT ((uintptr_t)gHostPltt)
+
+#undef VRAM
+#define VRAM ((uintptr_t)gHostVram)
+
+#undef OAM
+#define OAM ((uintptr_t)gHostOam)
+
+// The DMA registers are 32 bits wide, which is too small for host pointers,
+// so transfers go straight to a function that does them at once.
+void HostDmaSet(const void *src, void *dest, u32 control);
+
+#undef DmaSet
+#define DmaSet(dmaNum, src, dest, control) HostDmaSet((const void *)(src), (void *)(dest), (u32)(control))
+
+// There is no preproc pass in the host build, so INCBINed data is left out.
+// The benchmarks don't reach any code that reads it.
+#define INCBIN(x) {0}
+#define INCBIN_U8 INCBIN
+#define INCBIN_U16 INCBIN
+#define INCBIN_U32 INCBIN
+#define INCBIN_S8 INCBIN
+#define INCBIN_S16 INCBIN
+#define INCBIN_S32 INCBIN
+
+#endif // GUARD_HOST_H
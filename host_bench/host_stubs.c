@@ -0,0 +1,237 @@
+#include <math.h>
+#include "global.h"
+#include "main.h"
+#include "malloc.h"
+#include "palette.h"
+#include "sound.h"
+#include "m4a.h"
+#include "menu.h"
+#include "text.h"
+#include "string_util.h"
+#include "dynamic_placeholder_text_util.h"
+
+// The hardware, as far as the host build can see it.
+
+u8 gHostIoRegs[0x400];
+u8 gHostPltt[PLTT_SIZE] ALIGNED(4);
+u8 gHostVram[VRAM_SIZE] ALIGNED(4);
+u8 gHostOam[OAM_SIZE] ALIGNED(4);
+
+void HostDmaSet(const void *src, void *dest, u32 control)
+{
+    u32 flags = control >> 16;
+    u32 count = control & 0xFFFF;
+    u32 unitSize = (flags & DMA_32BIT) ? 4 : 2;
+    int srcStep;
+    int destStep;
+    u32 i;
+
+    // Transfers that wait for a blank or a sound FIFO are started by
+    // hardware that isn't there.
+    if (!(flags & DMA_ENABLE) || (flags & DMA_START_MASK) != DMA_START_NOW)
+        return;
+
+    if (count == 0)
+        count = 0x10000;
+
+    switch (flags & (DMA_SRC_DEC | DMA_SRC_FIXED))
+    {
+    case DMA_SRC_DEC:
+        srcStep = -(int)unitSize;
+        break;
+    case DMA_SRC_FIXED:
+        srcStep = 0;
+        break;
+    default:
+        srcStep = unitSize;
+        break;
+    }
+
+    switch (flags & DMA_DEST_RELOAD)
+    {
+    case DMA_DEST_DEC:
+        destStep = -(int)unitSize;
+        break;
+    case DMA_DEST_FIXED:
+        destStep = 0;
+        break;
+    default:
+        destStep = unitSize;
+        break;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        memcpy(dest, src, unitSize);
+        src = (const u8 *)src + srcStep;
+        dest = (u8 *)dest + destStep;
+    }
+}
+
+// BIOS calls
+
+void CpuSet(const void *src, void *dest, u32 control)
+{
+    u32 count = control & 0x1FFFFF;
+    u32 unitSize = (control & CPU_SET_32BIT) ? 4 : 2;
+    bool32 fill = (control & CPU_SET_SRC_FIXED) != 0;
+    u32 i;
+
+    for (i = 0; i < count; i++)
+        memcpy((u8 *)dest + i * unitSize, (const u8 *)src + (fill ? 0 : i * unitSize), unitSize);
+}
+
+void CpuFastSet(const void *src, void *dest, u32 control)
+{
+    // The BIOS moves 8 words at a time, so it rounds the count up.
+    u32 count = ((control & 0x1FFFFF) + 7) & ~7;
+    bool32 fill = (control & CPU_FAST_SET_SRC_FIXED) != 0;
+    u32 i;
+
+    for (i = 0; i < count; i++)
+        memcpy((u8 *)dest + i * 4, (const u8 *)src + (fill ? 0 : i * 4), 4);
+}
+
+// The BIOS sine table has 256 steps per turn, in 1.14 fixed point.
+static s32 BiosSin(u8 theta)
+{
+    return lround(sin(theta * (2 * M_PI / 256)) * 0x4000);
+}
+
+static s32 BiosCos(u8 theta)
+{
+    return BiosSin(theta + 64);
+}
+
+void ObjAffineSet(struct ObjAffineSrcData *src, void *dest, s32 count, s32 offset)
+{
+    s32 i;
+
+    for (i = 0; i < count; i++)
+    {
+        u8 theta = src[i].rotation >> 8;
+        s32 sinVal = BiosSin(theta);
+        s32 cosVal = BiosCos(theta);
+        u8 *out = (u8 *)dest + i * offset * 4;
+        s16 matrix[4];
+        s32 j;
+
+        matrix[0] = (src[i].xScale * cosVal) >> 14;
+        matrix[1] = -((src[i].xScale * sinVal) >> 14);
+        matrix[2] = (src[i].yScale * sinVal) >> 14;
+        matrix[3] = (src[i].yScale * cosVal) >> 14;
+
+        for (j = 0; j < 4; j++)
+            memcpy(out + j * offset, &matrix[j], sizeof(s16));
+    }
+}
+
+void BgAffineSet(struct BgAffineSrcData *src, struct BgAffineDstData *dest, s32 count)
+{
+    s32 i;
+
+    for (i = 0; i < count; i++)
+    {
+        u8 theta = src[i].alpha >> 8;
+        s32 sinVal = BiosSin(theta);
+        s32 cosVal = BiosCos(theta);
+
+        dest[i].pa = (src[i].sx * cosVal) >> 14;
+        dest[i].pb = -((src[i].sx * sinVal) >> 14);
+        dest[i].pc = (src[i].sy * sinVal) >> 14;
+        dest[i].pd = (src[i].sy * cosVal) >> 14;
+        dest[i].dx = src[i].texX - (dest[i].pa * src[i].scrX + dest[i].pb * src[i].scrY);
+        dest[i].dy = src[i].texY - (dest[i].pc * src[i].scrX + dest[i].pd * src[i].scrY);
+    }
+}
+
+void LZ77UnCompWram(const u32 *src, void *dest)
+{
+    const u8 *in = (const u8 *)src;
+    u8 *out = dest;
+    u32 destSize = in[1] | (in[2] << 8) | (in[3] << 16);
+    u32 destPos = 0;
+
+    in += 4;
+
+    while (destPos < destSize)
+    {
+        u8 flags = *in++;
+        int i;
+
+        for (i = 0; i < 8 && destPos < destSize; i++, flags <<= 1)
+        {
+            if (flags & 0x80)
+            {
+                u32 blockSize = (in[0] >> 4) + 3;
+                u32 blockDistance = (((in[0] & 0xF) << 8) | in[1]) + 1;
+                u32 j;
+
+                in += 2;
+
+                for (j = 0; j < blockSize && destPos < destSize; j++, destPos++)
+                    out[destPos] = out[destPos - blockDistance];
+            }
+            else
+            {
+                out[destPos++] = *in++;
+            }
+        }
+    }
+}
+
+// Modules that the host build leaves out
+
+struct Main gMain;
+u8 gHeap[HEAP_SIZE] ALIGNED(4);
+u32 gBattleTypeFlags;
+struct MusicPlayerInfo gMPlayInfo_BGM;
+u8 gStringVar1[0x100];
+u8 gStringVar2[0x100];
+u8 gStringVar3[0x100];
+
+void LoadPalette(const void *src, u16 offset, u16 size)
+{
+}
+
+void PlayBGM(u16 songNum)
+{
+}
+
+void PlaySE(u16 songNum)
+{
+}
+
+bool8 IsSEPlaying(void)
+{
+    return FALSE;
+}
+
+void m4aMPlayStop(struct MusicPlayerInfo *mplayInfo)
+{
+}
+
+void m4aMPlayContinue(struct MusicPlayerInfo *mplayInfo)
+{
+}
+
+u32 GetPlayerTextSpeed(void)
+{
+    return OPTIONS_TEXT_SPEED_FAST;
+}
+
+const u8 *DynamicPlaceholderTextUtil_GetPlaceholderPtr(u8 idx)
+{
+    return gStringVar1;
+}
+
+// Braille
+u16 Font6Func(struct TextPrinter *textPrinter)
+{
+    return 1;
+}
+
+u32 GetGlyphWidthFont6(u16 glyphId, bool32 isJapanese)
+{
+    return 8;
+}
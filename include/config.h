@@ -34,4 +34,15 @@
 #endif
 #endif
 
+// Uncomment to have modern builds put sprite sheets in the smallest range of
+// free tiles that fits, rather than the first one. This leaves fewer gaps
+// when sheets of many sizes are loaded and freed over and over.
+//#define BEST_FIT_SPRITE_TILES
+
+// Uncomment to time every main callback, task and sprite callback with timer
+// 2, and print where the time went each time a frame runs past the next
+// VBlank. This needs print debugging (see NDEBUG above). tools/frameprof
+// turns the printed log into a flame graph.
+//#define FRAME_PROFILER
+
 #endif // GUARD_CONFIG_H
@@ -0,0 +1,30 @@
+#ifndef GUARD_FRAME_PROFILER_H
+#define GUARD_FRAME_PROFILER_H
+
+// What kind of function a profiled call went to.
+enum
+{
+    PROFILE_MAIN_CALLBACK,
+    PROFILE_TASK,
+    PROFILE_SPRITE_CALLBACK,
+};
+
+// See FRAME_PROFILER in include/config.h. When it isn't defined, these do
+// nothing and their arguments are never evaluated.
+#ifdef FRAME_PROFILER
+void FrameProfiler_Init(void);
+void FrameProfiler_StartFrame(void);
+void FrameProfiler_EndFrame(void);
+void FrameProfiler_BeginCall(u8 kind, const void *func);
+void FrameProfiler_EndCall(void);
+void FrameProfiler_Dump(void);
+#else
+#define FrameProfiler_Init()
+#define FrameProfiler_StartFrame()
+#define FrameProfiler_EndFrame()
+#define FrameProfiler_BeginCall(kind, func)
+#define FrameProfiler_EndCall()
+#define FrameProfiler_Dump()
+#endif
+
+#endif // GUARD_FRAME_PROFILER_H
@@ -13,19 +13,24 @@ $(DATA_ASM_BUILDDIR)/maps.o: $(DATA_ASM_SUBDIR)/maps.s $(LAYOUTS_DIR)/layouts.in
 $(DATA_ASM_BUILDDIR)/map_events.o: $(DATA_ASM_SUBDIR)/map_events.s $(MAPS_DIR)/events.inc $(MAP_EVENTS)
 	$(PREPROC) $< charmap.txt | $(CPP) -I include | $(AS) $(ASFLAGS) -o $@
 
-$(MAPS_DIR)/%/header.inc: $(MAPS_DIR)/%/map.json
-	$(MAPJSON) map emerald $< $(LAYOUTS_DIR)/layouts.json
-$(MAPS_DIR)/%/events.inc: $(MAPS_DIR)/%/header.inc ;
-$(MAPS_DIR)/%/connections.inc: $(MAPS_DIR)/%/events.inc ;
-
-$(MAPS_DIR)/groups.inc: $(MAPS_DIR)/map_groups.json
-	$(MAPJSON) groups emerald $<
-$(MAPS_DIR)/connections.inc: $(MAPS_DIR)/groups.inc ;
-$(MAPS_DIR)/events.inc: $(MAPS_DIR)/connections.inc ;
-$(MAPS_DIR)/headers.inc: $(MAPS_DIR)/events.inc ;
-include/constants/map_groups.h: $(MAPS_DIR)/headers.inc ;
-
-$(LAYOUTS_DIR)/layouts.inc: $(LAYOUTS_DIR)/layouts.json
-	$(MAPJSON) layouts emerald $<
-$(LAYOUTS_DIR)/layouts_table.inc: $(LAYOUTS_DIR)/layouts.inc ;
-include/constants/layouts.h: $(LAYOUTS_DIR)/layouts_table.inc ;
+# A single mapjson run regenerates every map, group and layout file at once,
+# but only rewrites the files whose contents changed, so the assembly that
+# includes them is only redone when it has to be.
+MAPJSON_STAMP := $(DATA_ASM_BUILDDIR)/mapjson.stamp
+
+$(MAPJSON_STAMP): $(MAPS_DIR)/map_groups.json $(LAYOUTS_DIR)/layouts.json $(MAP_DIRS:%=%map.json)
+	$(MAPJSON) all emerald $(MAPS_DIR)/map_groups.json $(LAYOUTS_DIR)/layouts.json
+	@touch $@
+
+MAPJSON_OUTPUTS := $(MAP_HEADERS) $(MAP_EVENTS) $(MAP_CONNECTIONS) \
+                   $(MAPS_DIR)/groups.inc $(MAPS_DIR)/connections.inc $(MAPS_DIR)/events.inc $(MAPS_DIR)/headers.inc \
+                   include/constants/map_groups.h \
+                   $(LAYOUTS_DIR)/layouts.inc $(LAYOUTS_DIR)/layouts_table.inc include/constants/layouts.h
+
+$(MAPJSON_OUTPUTS): $(MAPJSON_STAMP) ;
+
+# The outputs' own rules do nothing, so if one has gone missing since the last
+# run, the batch has to be run again to put it back.
+ifneq ($(filter-out $(wildcard $(MAPJSON_OUTPUTS)),$(MAPJSON_OUTPUTS)),)
+.PHONY: $(MAPJSON_STAMP)
+endif
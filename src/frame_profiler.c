@@ -0,0 +1,280 @@
+#include "global.h"
+#include "frame_profiler.h"
+
+// Times every main callback, task and sprite callback, adds the times up per
+// function for each frame, and keeps the last few frames in a ring buffer.
+// When a frame takes longer than one refresh, the ring buffer is printed
+// through AGBPrint, and tools/frameprof can turn the output into a flame graph.
+
+#ifdef FRAME_PROFILER
+
+#ifdef NDEBUG
+#error "FRAME_PROFILER prints through AGBPrint, so NDEBUG must not be defined."
+#endif
+
+// Frames are timed with timer 2, counting in steps of 64 cycles, so that it
+// takes over 14 frames to wrap around and a 16-bit difference can time any
+// call. Timer 2 is also the flash timer (see InitFlashTimer), which takes it
+// over while a save is written and stops it afterwards. Frames are not
+// recorded while the flash code has it, a frame during which it was taken is
+// thrown away, and the timer is started again at the start of the next one.
+#define TICK_SHIFT 6
+#define TIMER_CONTROL (TIMER_ENABLE | TIMER_64CLK)
+
+#define CYCLES_PER_FRAME 280896
+#define FRAME_BUDGET_TICKS (CYCLES_PER_FRAME >> TICK_SHIFT)
+
+// Frames are stored one after another: a header, then an entry for each
+// function (and function it was called from) that ran during the frame.
+#define RING_SIZE 512
+#define MAX_FRAME_ENTRIES 128
+#define LOOKUP_SIZE 256
+#define MAX_CALL_DEPTH 8
+#define NO_ENTRY 0xFF
+
+#define PROFILE_FRAME 0xFF
+
+struct ProfileEntry
+{
+    const void *func;
+    u32 ticks;
+    u16 calls; // For a frame header, how many entries follow it.
+    u8 kind;
+    u8 parent; // The entry of the call that this one was made from.
+};
+
+EWRAM_DATA static struct ProfileEntry sRing[RING_SIZE] = {0};
+EWRAM_DATA static u16 sOldestFrame = 0;
+EWRAM_DATA static u16 sNumRingEntries = 0;
+EWRAM_DATA static u16 sFrameHeader = 0;
+EWRAM_DATA static u16 sFrameStartTicks = 0;
+EWRAM_DATA static bool8 sInFrame = FALSE;
+
+// Finds this frame's entry for a function, as the entry's number in the frame
+// plus one, or 0 for none.
+EWRAM_DATA static u8 sLookup[LOOKUP_SIZE] = {0};
+
+// The calls that are running now. The depth keeps counting past the last one
+// that fits, so that their ends still match up.
+EWRAM_DATA static u8 sCallEntries[MAX_CALL_DEPTH] = {0};
+EWRAM_DATA static u16 sCallStartTicks[MAX_CALL_DEPTH] = {0};
+EWRAM_DATA static u8 sCallDepth = 0;
+
+static u16 ReadTimer(void)
+{
+    return REG_TM2CNT_L;
+}
+
+static void StartTimer(void)
+{
+    REG_TM2CNT_H = 0;
+    REG_TM2CNT_L = 0;
+    REG_TM2CNT_H = TIMER_CONTROL;
+}
+
+// Whether timer 2 is still counting the way StartTimer set it up.
+static bool8 HasTimer(void)
+{
+    return REG_TM2CNT_H == TIMER_CONTROL;
+}
+
+void FrameProfiler_Init(void)
+{
+    StartTimer();
+    AGBPrintInit();
+    sOldestFrame = 0;
+    sNumRingEntries = 0;
+    sInFrame = FALSE;
+}
+
+// Takes the next entry of the ring buffer, dropping the oldest frame if it's
+// full. A frame has at most MAX_FRAME_ENTRIES entries, so this never drops
+// the frame that is being recorded.
+static u16 AddRingEntry(void)
+{
+    u16 index;
+
+    if (sNumRingEntries == RING_SIZE)
+    {
+        u16 size = sRing[sOldestFrame].calls + 1;
+
+        sOldestFrame = (sOldestFrame + size) % RING_SIZE;
+        sNumRingEntries -= size;
+    }
+
+    index = (sOldestFrame + sNumRingEntries) % RING_SIZE;
+    sNumRingEntries++;
+    return index;
+}
+
+static struct ProfileEntry *GetFrameEntry(u8 entryId)
+{
+    return &sRing[(sFrameHeader + 1 + entryId) % RING_SIZE];
+}
+
+static u8 FindFrameEntry(u8 kind, const void *func, u8 parent)
+{
+    struct ProfileEntry *header = &sRing[sFrameHeader];
+    struct ProfileEntry *entry;
+    u32 slot = ((((u32)func >> 1) + parent) * 0x9E3779B1) >> 24;
+    u8 entryId;
+
+    while (sLookup[slot] != 0)
+    {
+        entryId = sLookup[slot] - 1;
+        entry = GetFrameEntry(entryId);
+        if (entry->func == func && entry->parent == parent)
+            return entryId;
+        slot = (slot + 1) % LOOKUP_SIZE;
+    }
+
+    if (header->calls == MAX_FRAME_ENTRIES)
+        return NO_ENTRY;
+
+    entryId = header->calls;
+    entry = &sRing[AddRingEntry()];
+    entry->func = func;
+    entry->ticks = 0;
+    entry->calls = 0;
+    entry->kind = kind;
+    entry->parent = parent;
+    header->calls++;
+    sLookup[slot] = entryId + 1;
+    return entryId;
+}
+
+void FrameProfiler_StartFrame(void)
+{
+    struct ProfileEntry *header;
+
+    if (!HasTimer())
+    {
+        // The flash code's timer interrupt is enabled while it has the timer.
+        if (REG_IE & INTR_FLAG_TIMER2)
+            return;
+
+        StartTimer();
+    }
+
+    CpuFill16(0, sLookup, sizeof(sLookup));
+    sFrameHeader = AddRingEntry();
+    header = &sRing[sFrameHeader];
+    header->func = NULL;
+    header->ticks = 0;
+    header->calls = 0;
+    header->kind = PROFILE_FRAME;
+    header->parent = NO_ENTRY;
+    sCallDepth = 0;
+    sInFrame = TRUE;
+    sFrameStartTicks = ReadTimer();
+}
+
+void FrameProfiler_EndFrame(void)
+{
+    u16 ticks = ReadTimer() - sFrameStartTicks;
+
+    if (!sInFrame)
+        return;
+
+    sInFrame = FALSE;
+
+    // A save took the timer during this frame, so its times are wrong. It is
+    // the newest frame in the ring buffer, so it just comes off the end.
+    if (!HasTimer())
+    {
+        sNumRingEntries -= sRing[sFrameHeader].calls + 1;
+        return;
+    }
+
+    sRing[sFrameHeader].ticks = ticks;
+
+    // This frame has missed the next VBlank.
+    if (ticks > FRAME_BUDGET_TICKS)
+        FrameProfiler_Dump();
+}
+
+void FrameProfiler_BeginCall(u8 kind, const void *func)
+{
+    if (!sInFrame)
+        return;
+
+    if (sCallDepth < MAX_CALL_DEPTH)
+    {
+        u8 entryId = NO_ENTRY;
+
+        // Calls made from a call that couldn't be recorded aren't either, as
+        // they would show up in the wrong place.
+        if (sCallDepth == 0)
+            entryId = FindFrameEntry(kind, func, NO_ENTRY);
+        else if (sCallEntries[sCallDepth - 1] != NO_ENTRY)
+            entryId = FindFrameEntry(kind, func, sCallEntries[sCallDepth - 1]);
+
+        sCallEntries[sCallDepth] = entryId;
+        sCallStartTicks[sCallDepth] = ReadTimer();
+    }
+
+    sCallDepth++;
+}
+
+void FrameProfiler_EndCall(void)
+{
+    u16 now = ReadTimer();
+
+    if (!sInFrame)
+        return;
+
+    sCallDepth--;
+
+    if (sCallDepth < MAX_CALL_DEPTH && sCallEntries[sCallDepth] != NO_ENTRY)
+    {
+        struct ProfileEntry *entry = GetFrameEntry(sCallEntries[sCallDepth]);
+
+        entry->ticks += (u16)(now - sCallStartTicks[sCallDepth]);
+        entry->calls++;
+    }
+}
+
+// Prints the frames that have been recorded since the last dump, one line per
+// frame and one per entry:
+//   FRAMEPROF FRAME <cycles>
+//   FRAMEPROF CALL <entry> <parent entry, or -1> <kind> <address> <calls> <cycles>
+void FrameProfiler_Dump(void)
+{
+    u16 index = sOldestFrame;
+    u16 numEntries = sNumRingEntries;
+    u16 i;
+
+    // A frame that is still running is kept for the next dump.
+    if (sInFrame)
+        numEntries -= sRing[sFrameHeader].calls + 1;
+
+    while (numEntries != 0)
+    {
+        struct ProfileEntry *header = &sRing[index];
+
+        AGBPrintf("FRAMEPROF FRAME %lu\n", (unsigned long)header->ticks << TICK_SHIFT);
+
+        for (i = 0; i < header->calls; i++)
+        {
+            struct ProfileEntry *entry = &sRing[(index + 1 + i) % RING_SIZE];
+
+            AGBPrintf("FRAMEPROF CALL %d %d %d %lx %d %lu\n",
+                      i,
+                      entry->parent == NO_ENTRY ? -1 : entry->parent,
+                      entry->kind,
+                      (unsigned long)entry->func,
+                      entry->calls,
+                      (unsigned long)entry->ticks << TICK_SHIFT);
+        }
+
+        numEntries -= header->calls + 1;
+        index = (index + header->calls + 1) % RING_SIZE;
+    }
+
+    AGBPrintFlush();
+
+    sOldestFrame = index;
+    sNumRingEntries = sInFrame ? sRing[sFrameHeader].calls + 1 : 0;
+}
+
+#endif // FRAME_PROFILER
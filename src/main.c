@@ -23,6 +23,7 @@
 #include "intro.h"
 #include "main.h"
 #include "trainer_hill.h"
+#include "frame_profiler.h"
 #include "constants/rgb.h"
 
 static void VBlankIntr(void);
@@ -110,6 +111,7 @@ void AgbMain()
     ResetBgs();
     SetDefaultFontsPointer();
     InitHeap(gHeap, HEAP_SIZE);
+    FrameProfiler_Init();
 
     gSoftResetDisabled = FALSE;
 
@@ -121,6 +123,7 @@ void AgbMain()
 
     for (;;)
     {
+        FrameProfiler_StartFrame();
         ReadKeys();
 
         if (gSoftResetDisabled == FALSE
@@ -155,6 +158,7 @@ void AgbMain()
 
         PlayTimeCounter_Update();
         MapMusicMain();
+        FrameProfiler_EndFrame();
         WaitForVBlank();
     }
 }
@@ -179,10 +183,18 @@ static void InitMainCallbacks(void)
 static void CallCallbacks(void)
 {
     if (gMain.callback1)
+    {
+        FrameProfiler_BeginCall(PROFILE_MAIN_CALLBACK, gMain.callback1);
         gMain.callback1();
+        FrameProfiler_EndCall();
+    }
 
     if (gMain.callback2)
+    {
+        FrameProfiler_BeginCall(PROFILE_MAIN_CALLBACK, gMain.callback2);
         gMain.callback2();
+        FrameProfiler_EndCall();
+    }
 }
 
 void SetMainCallback2(MainCallback callback)
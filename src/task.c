@@ -1,8 +1,17 @@
 #include "global.h"
 #include "task.h"
+#include "frame_profiler.h"
 
 struct Task gTasks[NUM_TASKS];
 
+#if MODERN
+// Modern builds keep track of the slots in use and of the first task to run,
+// so that nothing has to scan gTasks for them. Only this file changes
+// isActive and the task list, so these stay in step with gTasks.
+static u16 sActiveTaskBits;
+static u8 sFirstTaskId;
+#endif
+
 static void InsertTask(u8 newTaskId);
 static u8 FindFirstActiveTask(void);
 
@@ -22,8 +31,31 @@ void ResetTasks(void)
 
     gTasks[0].prev = HEAD_SENTINEL;
     gTasks[NUM_TASKS - 1].next = TAIL_SENTINEL;
+#if MODERN
+    sActiveTaskBits = 0;
+    sFirstTaskId = NUM_TASKS;
+#endif
 }
 
+#if MODERN
+u8 CreateTask(TaskFunc func, u8 priority)
+{
+    u8 i;
+
+    if (sActiveTaskBits == (1 << NUM_TASKS) - 1)
+        return 0;
+
+    // The lowest free slot, as the scan below would find.
+    i = __builtin_ctz(~sActiveTaskBits);
+    gTasks[i].func = func;
+    gTasks[i].priority = priority;
+    InsertTask(i);
+    memset(gTasks[i].data, 0, sizeof(gTasks[i].data));
+    gTasks[i].isActive = TRUE;
+    sActiveTaskBits |= 1 << i;
+    return i;
+}
+#else
 u8 CreateTask(TaskFunc func, u8 priority)
 {
     u8 i;
@@ -43,6 +75,7 @@ u8 CreateTask(TaskFunc func, u8 priority)
 
     return 0;
 }
+#endif
 
 static void InsertTask(u8 newTaskId)
 {
@@ -53,6 +86,9 @@ static void InsertTask(u8 newTaskId)
         // The new task is the only task.
         gTasks[newTaskId].prev = HEAD_SENTINEL;
         gTasks[newTaskId].next = TAIL_SENTINEL;
+#if MODERN
+        sFirstTaskId = newTaskId;
+#endif
         return;
     }
 
@@ -66,6 +102,10 @@ static void InsertTask(u8 newTaskId)
             gTasks[newTaskId].next = taskId;
             if (gTasks[taskId].prev != HEAD_SENTINEL)
                 gTasks[gTasks[taskId].prev].next = newTaskId;
+#if MODERN
+            else
+                sFirstTaskId = newTaskId;
+#endif
             gTasks[taskId].prev = newTaskId;
             return;
         }
@@ -86,11 +126,17 @@ void DestroyTask(u8 taskId)
     if (gTasks[taskId].isActive)
     {
         gTasks[taskId].isActive = FALSE;
+#if MODERN
+        sActiveTaskBits &= ~(1 << taskId);
+#endif
 
         if (gTasks[taskId].prev == HEAD_SENTINEL)
         {
             if (gTasks[taskId].next != TAIL_SENTINEL)
                 gTasks[gTasks[taskId].next].prev = HEAD_SENTINEL;
+#if MODERN
+            sFirstTaskId = gTasks[taskId].next == TAIL_SENTINEL ? NUM_TASKS : gTasks[taskId].next;
+#endif
         }
         else
         {
@@ -115,7 +161,9 @@ void RunTasks(void)
     {
         do
         {
+            FrameProfiler_BeginCall(PROFILE_TASK, gTasks[taskId].func);
             gTasks[taskId].func(taskId);
+            FrameProfiler_EndCall();
             taskId = gTasks[taskId].next;
         } while (taskId != TAIL_SENTINEL);
     }
@@ -123,6 +171,9 @@ void RunTasks(void)
 
 static u8 FindFirstActiveTask(void)
 {
+#if MODERN
+    return sFirstTaskId;
+#else
     u8 taskId;
 
     for (taskId = 0; taskId < NUM_TASKS; taskId++)
@@ -130,6 +181,7 @@ static u8 FindFirstActiveTask(void)
             break;
 
     return taskId;
+#endif
 }
 
 void TaskDummy(u8 taskId)
@@ -152,6 +204,34 @@ void SwitchTaskToFollowupFunc(u8 taskId)
     gTasks[taskId].func = (TaskFunc)((u16)(gTasks[taskId].data[followupFuncIndex]) | (gTasks[taskId].data[followupFuncIndex + 1] << 16));
 }
 
+#if MODERN
+// gTasks[].func is set all over the game, so rather than keep an index of
+// funcs, these only look at the slots in use, lowest first like before.
+bool8 FuncIsActiveTask(TaskFunc func)
+{
+    return FindTaskIdByFunc(func) != TASK_NONE;
+}
+
+u8 FindTaskIdByFunc(TaskFunc func)
+{
+    u32 bits;
+
+    for (bits = sActiveTaskBits; bits != 0; bits &= bits - 1)
+    {
+        u8 taskId = __builtin_ctz(bits);
+
+        if (gTasks[taskId].func == func)
+            return taskId;
+    }
+
+    return TASK_NONE; // No task was found.
+}
+
+u8 GetTaskCount(void)
+{
+    return __builtin_popcount(sActiveTaskBits);
+}
+#else
 bool8 FuncIsActiveTask(TaskFunc func)
 {
     u8 i;
@@ -186,6 +266,8 @@ u8 GetTaskCount(void)
     return count;
 }
 
+#endif
+
 void SetWordTaskArg(u8 taskId, u8 dataElem, u32 value)
 {
     if (dataElem < NUM_TASK_DATA - 1)
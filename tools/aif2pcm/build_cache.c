@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define MakeDir(path) _mkdir(path)
+#define GetPid() _getpid()
+#else
+#include <unistd.h>
+#define MakeDir(path) mkdir(path, 0777)
+#define GetPid() getpid()
+#endif
+#include "build_cache.h"
+
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void Sha1Block(uint32_t state[5], const unsigned char *block)
+{
+	uint32_t w[80];
+
+	for (int i = 0; i < 16; i++)
+		w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+
+	for (int i = 16; i < 80; i++)
+		w[i] = ROTL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+	uint32_t a = state[0];
+	uint32_t b = state[1];
+	uint32_t c = state[2];
+	uint32_t d = state[3];
+	uint32_t e = state[4];
+
+	for (int i = 0; i < 80; i++) {
+		uint32_t f;
+		uint32_t k;
+
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5A827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8F1BBCDC;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6;
+		}
+
+		uint32_t temp = ROTL32(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = ROTL32(b, 30);
+		b = a;
+		a = temp;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+bool BuildCacheEnabled(void)
+{
+	char *dir = getenv("TOOL_CACHE_DIR");
+
+	return dir != NULL && *dir != 0;
+}
+
+void BuildCacheKeyInit(struct BuildCacheKey *key, const char *toolVersion)
+{
+	key->state[0] = 0x67452301;
+	key->state[1] = 0xEFCDAB89;
+	key->state[2] = 0x98BADCFE;
+	key->state[3] = 0x10325476;
+	key->state[4] = 0xC3D2E1F0;
+	key->length = 0;
+	key->hex[0] = 0;
+
+	BuildCacheKeyAddString(key, toolVersion);
+}
+
+void BuildCacheKeyAddData(struct BuildCacheKey *key, const void *data, size_t size)
+{
+	const unsigned char *bytes = data;
+
+	while (size > 0) {
+		size_t blockPos = key->length % 64;
+		size_t count = 64 - blockPos;
+
+		if (count > size)
+			count = size;
+
+		memcpy(&key->block[blockPos], bytes, count);
+		key->length += count;
+		bytes += count;
+		size -= count;
+
+		if (key->length % 64 == 0)
+			Sha1Block(key->state, key->block);
+	}
+}
+
+// Strings are added with their terminator so that ("ab", "c") and ("a", "bc")
+// produce different keys.
+void BuildCacheKeyAddString(struct BuildCacheKey *key, const char *string)
+{
+	BuildCacheKeyAddData(key, string, strlen(string) + 1);
+}
+
+bool BuildCacheKeyAddFile(struct BuildCacheKey *key, const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+
+	if (fp == NULL)
+		return false;
+
+	unsigned char buffer[0x10000];
+	size_t count;
+
+	while ((count = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+		BuildCacheKeyAddData(key, buffer, count);
+
+	fclose(fp);
+	return true;
+}
+
+static void FinishKey(struct BuildCacheKey *key)
+{
+	if (key->hex[0] != 0)
+		return;
+
+	uint64_t bitLength = key->length * 8;
+	unsigned char padding[72] = { 0x80 };
+	size_t paddingSize = 64 - ((key->length + 8) % 64);
+	unsigned char lengthBytes[8];
+
+	for (int i = 0; i < 8; i++)
+		lengthBytes[i] = (unsigned char)(bitLength >> (56 - i * 8));
+
+	BuildCacheKeyAddData(key, padding, paddingSize);
+	BuildCacheKeyAddData(key, lengthBytes, 8);
+
+	for (int i = 0; i < 5; i++)
+		sprintf(&key->hex[i * 8], "%08x", (unsigned int)key->state[i]);
+}
+
+static char *GetEntryPath(struct BuildCacheKey *key, bool createDir)
+{
+	char *dir = getenv("TOOL_CACHE_DIR");
+	size_t size = strlen(dir) + 1 + 2 + 1 + 38 + 1;
+	char *path = malloc(size);
+
+	if (path == NULL)
+		return NULL;
+
+	FinishKey(key);
+
+	if (createDir) {
+		MakeDir(dir);
+		snprintf(path, size, "%s/%.2s", dir, key->hex);
+		MakeDir(path);
+	}
+
+	snprintf(path, size, "%s/%.2s/%s", dir, key->hex, &key->hex[2]);
+	return path;
+}
+
+// Copies srcPath to destPath through a temporary file so that an interrupted
+// copy never leaves a truncated file behind under the final name.
+static bool CopyCacheFile(const char *srcPath, const char *destPath, const void *tag)
+{
+	FILE *src = fopen(srcPath, "rb");
+
+	if (src == NULL)
+		return false;
+
+	size_t tmpSize = strlen(destPath) + 64;
+	char *tmpPath = malloc(tmpSize);
+
+	if (tmpPath == NULL) {
+		fclose(src);
+		return false;
+	}
+
+	snprintf(tmpPath, tmpSize, "%s.%d.%p.tmp", destPath, (int)GetPid(), tag);
+
+	FILE *dest = fopen(tmpPath, "wb");
+	bool success = (dest != NULL);
+
+	if (success) {
+		unsigned char buffer[0x10000];
+		size_t count;
+
+		while (success && (count = fread(buffer, 1, sizeof(buffer), src)) > 0)
+			success = (fwrite(buffer, 1, count, dest) == count);
+
+		success = !ferror(src) && (fclose(dest) == 0) && success;
+	}
+
+	fclose(src);
+
+	if (success) {
+		remove(destPath);
+		success = (rename(tmpPath, destPath) == 0);
+	}
+
+	if (!success)
+		remove(tmpPath);
+
+	free(tmpPath);
+	return success;
+}
+
+bool BuildCacheFetch(struct BuildCacheKey *key, const char *outputPath)
+{
+	char *entryPath = GetEntryPath(key, false);
+
+	if (entryPath == NULL)
+		return false;
+
+	bool found = CopyCacheFile(entryPath, outputPath, key);
+
+	free(entryPath);
+	return found;
+}
+
+void BuildCacheStore(struct BuildCacheKey *key, const char *outputPath)
+{
+	char *entryPath = GetEntryPath(key, true);
+
+	if (entryPath == NULL)
+		return;
+
+	CopyCacheFile(outputPath, entryPath, key);
+	free(entryPath);
+}
@@ -0,0 +1,29 @@
+#ifndef BUILD_CACHE_H
+#define BUILD_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Content-addressed cache of tool outputs, enabled by pointing the
+// TOOL_CACHE_DIR environment variable at a directory. The key of an entry
+// is the SHA-1 of everything added to it: the tool version, its options and
+// the contents of its inputs. Failing to use the cache is never an error;
+// the tool just does the conversion itself.
+
+struct BuildCacheKey {
+	uint32_t state[5];
+	uint64_t length;
+	unsigned char block[64];
+	char hex[41];
+};
+
+bool BuildCacheEnabled(void);
+void BuildCacheKeyInit(struct BuildCacheKey *key, const char *toolVersion);
+void BuildCacheKeyAddData(struct BuildCacheKey *key, const void *data, size_t size);
+void BuildCacheKeyAddString(struct BuildCacheKey *key, const char *string);
+bool BuildCacheKeyAddFile(struct BuildCacheKey *key, const char *path);
+bool BuildCacheFetch(struct BuildCacheKey *key, const char *outputPath);
+void BuildCacheStore(struct BuildCacheKey *key, const char *outputPath);
+
+#endif // BUILD_CACHE_H
@@ -24,6 +24,22 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <process.h>
+#define GetPid() _getpid()
+#else
+#include <unistd.h>
+#define GetPid() getpid()
+#endif
+
+#include "build_cache.h"
+
+// Identifies the output format of aif2pcm in cache keys. Bump this whenever a
+// change to aif2pcm changes what it writes for the same input and options, so
+// that outputs cached by older builds aren't used.
+#define AIF2PCM_CACHE_VERSION "aif2pcm 1"
 
 /* extended.c */
 void ieee754_write_extended (double, uint8_t*);
@@ -108,6 +124,46 @@ void free_bytearray(struct Bytes *bytes)
 	free(bytes);
 }
 
+// A buffer that keeps its memory from one file to the next, so that batch
+// workers do not allocate for every conversion.
+struct ReusableBytes {
+	struct Bytes bytes;
+	unsigned long capacity;
+};
+
+uint8_t *reserve_bytes(struct ReusableBytes *buffer, unsigned long size)
+{
+	if (size > buffer->capacity)
+	{
+		free(buffer->bytes.data);
+		buffer->capacity = size + size / 2;
+		buffer->bytes.data = malloc(buffer->capacity);
+		if (buffer->bytes.data == NULL)
+		{
+			FATAL_ERROR("Failed to allocate %lu bytes!\n", buffer->capacity);
+		}
+	}
+	buffer->bytes.length = size;
+	return buffer->bytes.data;
+}
+
+void read_reusable_bytes(const char *filename, struct ReusableBytes *buffer)
+{
+	FILE *f = fopen(filename, "rb");
+	if (!f)
+	{
+		FATAL_ERROR("Failed to open '%s' for reading!\n", filename);
+	}
+	fseek(f, 0, SEEK_END);
+	long length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (length <= 0 || fread(reserve_bytes(buffer, length), length, 1, f) != 1)
+	{
+		FATAL_ERROR("Failed to read data from '%s'!\n", filename);
+	}
+	fclose(f);
+}
+
 char *get_file_extension(char *filename)
 {
 	char *index = strrchr(filename, '.');
@@ -294,11 +350,11 @@ void read_aif(struct Bytes *aif, AifData *aif_data)
 			// Skip offset and blockSize
 			pos += 8;
 
+			// The samples are used in place, so they are only valid for as
+			// long as the file's data is.
 			unsigned long num_samples = chunk_size - 8;
-			uint8_t *sample_data = (uint8_t *)malloc(num_samples * sizeof(uint8_t));
-			memcpy(sample_data, &aif->data[pos], num_samples);
 
-			aif_data->samples = sample_data;
+			aif_data->samples = &aif->data[pos];
 			aif_data->real_num_samples = num_samples;
 			pos += chunk_size - 8;
 		}
@@ -461,73 +517,238 @@ int get_delta_index(uint8_t sample, uint8_t prev_sample)
 	return best_index;
 }
 
-struct Bytes *delta_compress(struct Bytes *pcm)
+// A delta that wraps past the end of the signed range is never the nearest:
+// it only wraps when the previous sample is close to that end, so the delta
+// of 0 or -1 is already closer than any wrapped sample can be. That means
+// get_delta_index only depends on the difference between the signed samples
+// and on how many of the deltas in that direction do not wrap. The table
+// holds its result for each difference plus 255 and each number of deltas
+// that do not wrap, and sNonWrappingDeltas holds that number for each
+// previous sample and direction.
+static uint8_t sDeltaIndexTable[511][8];
+static uint8_t sNonWrappingDeltas[256][2];
+static bool sDeltaIndexTableBuilt = false;
+
+static void build_delta_index_table(void)
+{
+	if (sDeltaIndexTableBuilt)
+		return;
+
+	for (int prev = 0; prev < 256; prev++)
+	{
+		int prev_signed = U8_TO_S8(prev);
+
+		sNonWrappingDeltas[prev][0] = 0;
+		sNonWrappingDeltas[prev][1] = 0;
+
+		for (int i = POSITIVE_DELTAS_START; i < POSITIVE_DELTAS_END; i++)
+		{
+			if (prev_signed + gDeltaEncodingTable[i] <= 127)
+				sNonWrappingDeltas[prev][0]++;
+		}
+
+		for (int i = NEGATIVE_DELTAS_START; i < NEGATIVE_DELTAS_END; i++)
+		{
+			if (prev_signed + gDeltaEncodingTable[i] >= -128)
+				sNonWrappingDeltas[prev][1]++;
+		}
+	}
+
+	for (int difference = -255; difference <= 255; difference++)
+	{
+		for (int count = 1; count <= 8; count++)
+		{
+			// The deltas that do not wrap are the smallest positive ones or
+			// the smallest negative ones, which are at the end of the table.
+			int start = difference >= 0 ? POSITIVE_DELTAS_START : NEGATIVE_DELTAS_END - count;
+			int end = difference >= 0 ? POSITIVE_DELTAS_START + count : NEGATIVE_DELTAS_END;
+			int best_error = INT_MAX;
+			int best_index = -1;
+
+			for (int i = start; i < end; i++)
+			{
+				int error = ABS(difference - gDeltaEncodingTable[i]);
+
+				if (error < best_error)
+				{
+					best_error = error;
+					best_index = i;
+				}
+			}
+
+			sDeltaIndexTable[difference + 255][count - 1] = best_index;
+		}
+	}
+
+	sDeltaIndexTableBuilt = true;
+}
+
+// Chooses each delta greedily, exactly like calling get_delta_index on every
+// sample, but with table lookups instead of a search.
+static void choose_deltas_greedy(const uint8_t *samples, int count, uint8_t *indices)
 {
-	struct Bytes *delta = malloc(sizeof(struct Bytes));
-	// estimate the length so we can malloc
-	int num_blocks = pcm->length / 64;
-	delta->length = num_blocks * 33;
+	uint8_t base = samples[0];
+
+	build_delta_index_table();
+
+	for (int i = 1; i < count; i++)
+	{
+		int difference = U8_TO_S8(samples[i]) - U8_TO_S8(base);
+		int non_wrapping = sNonWrappingDeltas[base][difference < 0];
+		int delta_index = sDeltaIndexTable[difference + 255][non_wrapping - 1];
+
+		base += gDeltaEncodingTable[delta_index];
+		indices[i] = delta_index;
+	}
+}
+
+static bool deltas_are_exact(const uint8_t *samples, int count, const uint8_t *indices)
+{
+	uint8_t base = samples[0];
+
+	for (int i = 1; i < count; i++)
+	{
+		base += gDeltaEncodingTable[indices[i]];
+		if (base != samples[i])
+			return false;
+	}
 
-	int extra = pcm->length % 64;
-	if (extra)
+	return true;
+}
+
+// Chooses the deltas of a block with the Viterbi algorithm, so that the total
+// squared error of the decoded samples is as small as possible. The state is
+// the decoded sample value, which starts out as the block's first sample.
+// Since the error of a step only depends on the state it ends in, each step
+// takes the cheapest way into every state and adds that state's error. The
+// inner loops have no branches so that the compiler can vectorize them.
+static void choose_deltas_trellis(const uint8_t *samples, int count, uint8_t *indices)
+{
+	// costs holds the cost of reaching each state twice over, starting at
+	// index 128, so that the state a delta comes from is always at
+	// costs[128 + state - delta] without wrapping the index.
+	int32_t costs[512];
+	uint8_t choices[64][256];
+	const int32_t unreachable = INT32_MAX / 2;
+
+	int32_t best[256];
+	int32_t choice[256];
+
+	for (int k = 0; k < 512; k++)
+		costs[k] = unreachable;
+	costs[128 + samples[0]] = 0;
+	memcpy(&costs[384], &costs[128], 128 * sizeof(int32_t));
+	memcpy(&costs[0], &costs[256], 128 * sizeof(int32_t));
+
+	for (int i = 1; i < count; i++)
 	{
-		delta->length += 1;
-		extra -= 1;
+		int target = U8_TO_S8(samples[i]);
+
+		for (int state = 0; state < 256; state++)
+		{
+			best[state] = unreachable;
+			choice[state] = 0;
+		}
+
+		for (int delta_index = 0; delta_index < 16; delta_index++)
+		{
+			const int32_t *from = &costs[128 - gDeltaEncodingTable[delta_index]];
+
+			for (int state = 0; state < 256; state++)
+			{
+				int32_t cost = from[state];
+				int32_t better = -(cost < best[state]);
+
+				best[state] = (cost & better) | (best[state] & ~better);
+				choice[state] = (delta_index & better) | (choice[state] & ~better);
+			}
+		}
+
+		for (int state = 0; state < 256; state++)
+		{
+			int error = U8_TO_S8(state) - target;
+			int32_t cost = best[state] + error * error;
+
+			if (cost > unreachable)
+				cost = unreachable;
+
+			choices[i][state] = choice[state];
+			costs[128 + state] = cost;
+		}
+
+		memcpy(&costs[384], &costs[128], 128 * sizeof(int32_t));
+		memcpy(&costs[0], &costs[256], 128 * sizeof(int32_t));
 	}
-	if (extra)
+
+	int best_state = 0;
+
+	for (int state = 1; state < 256; state++)
 	{
-		delta->length += 1;
-		extra -= 1;
+		if (costs[128 + state] < costs[128 + best_state])
+			best_state = state;
 	}
-	if (extra)
+
+	for (int i = count - 1; i > 0; i--)
 	{
-		delta->length += (extra + 1) / 2;
+		indices[i] = choices[i][best_state];
+		best_state = (uint8_t)(best_state - gDeltaEncodingTable[indices[i]]);
 	}
+}
 
-	delta->data = malloc(delta->length + 33);
+// The most bytes that delta_compress can write for length samples.
+unsigned long delta_compress_bound(unsigned long length)
+{
+	return (length / 64 + 1) * 33;
+}
 
+// Compresses the samples into out, which must have room for
+// delta_compress_bound(length) bytes, and returns the compressed length.
+unsigned long delta_compress(const uint8_t *samples, unsigned long length, uint8_t *out, bool trellis)
+{
 	unsigned int i = 0;
 	unsigned int j = 0;
 	int k;
-	uint8_t base;
-	int delta_index;
+	uint8_t indices[64];
 
-	while (i < pcm->length)
+	// Every block of 64 samples starts over from a literal sample, followed
+	// by one delta in a byte of its own and then two deltas per byte.
+	while (i < length)
 	{
-		base = pcm->data[i++];
-		delta->data[j++] = base;
+		int count = length - i < 64 ? length - i : 64;
+		int n = 1;
+
+		choose_deltas_greedy(&samples[i], count, indices);
+
+		// A block that the greedy deltas reproduce exactly cannot be improved.
+		if (trellis && !deltas_are_exact(&samples[i], count, indices))
+			choose_deltas_trellis(&samples[i], count, indices);
 
-		if (i >= pcm->length)
+		out[j++] = samples[i];
+		i += count;
+
+		if (n >= count)
 		{
 			break;
 		}
-		delta_index = get_delta_index(pcm->data[i++], base);
-		base += gDeltaEncodingTable[delta_index];
-		delta->data[j++] = delta_index;
+		out[j++] = indices[n++];
 
 		for (k = 0; k < 31; k++)
 		{
-			if (i >= pcm->length)
+			if (n >= count)
 			{
 				break;
 			}
-			delta_index = get_delta_index(pcm->data[i++], base);
-			base += gDeltaEncodingTable[delta_index];
-			delta->data[j] = (delta_index << 4);
+			out[j] = (indices[n++] << 4);
 
-			if (i >= pcm->length)
+			if (n >= count)
 			{
 				break;
 			}
-			delta_index = get_delta_index(pcm->data[i++], base);
-			base += gDeltaEncodingTable[delta_index];
-			delta->data[j++] |= delta_index;
+			out[j++] |= indices[n++];
 		}
 	}
 
-	delta->length = j;
-
-	return delta;
+	return j;
 }
 
 #define STORE_U32_LE(dest, value) \
@@ -546,33 +767,36 @@ do { \
 	(var) |= (*((src) + 3) << 24); \
 } while (0)
 
-// Reads an .aif file and produces a .pcm file containing an array of 8-bit samples.
-void aif2pcm(const char *aif_filename, const char *pcm_filename, bool compress)
+// The buffers that converting an .aif file needs, kept between files by
+// batch workers.
+struct ConvertBuffers {
+	struct ReusableBytes aif;
+	struct ReusableBytes output;
+};
+
+void free_convert_buffers(struct ConvertBuffers *buffers)
+{
+	free(buffers->aif.bytes.data);
+	free(buffers->output.bytes.data);
+}
+
+// Converts the .aif file that has already been read into buffers->aif and
+// writes the .pcm file.
+void convert_aif(const char *pcm_filename, bool compress, bool trellis, struct ConvertBuffers *buffers)
 {
-	struct Bytes *aif = read_bytearray(aif_filename);
 	AifData aif_data = {0,0,0,0,0,0,0};
-	read_aif(aif, &aif_data);
+	read_aif(&buffers->aif.bytes, &aif_data);
 
 	int header_size = 0x10;
-	struct Bytes *pcm;
-	struct Bytes output = {0,0};
+	unsigned long pcm_length = compress ? delta_compress_bound(aif_data.real_num_samples) : aif_data.real_num_samples;
+	uint8_t *output = reserve_bytes(&buffers->output, header_size + pcm_length);
 
 	if (compress)
-	{
-		struct Bytes *input = malloc(sizeof(struct Bytes));
-		input->data = aif_data.samples;
-		input->length = aif_data.real_num_samples;
-		pcm = delta_compress(input);
-		free(input);
-	}
+		pcm_length = delta_compress(aif_data.samples, aif_data.real_num_samples, output + header_size, trellis);
 	else
-	{
-		pcm = malloc(sizeof(struct Bytes));
-		pcm->data = aif_data.samples;
-		pcm->length = aif_data.real_num_samples;
-	}
-	output.length = header_size + pcm->length;
-	output.data = malloc(output.length);
+		memcpy(&output[header_size], aif_data.samples, pcm_length);
+
+	buffers->output.bytes.length = header_size + pcm_length;
 
 	uint32_t pitch_adjust = (uint32_t)(aif_data.sample_rate * 1024);
 	uint32_t loop_offset = (uint32_t)(aif_data.loop_offset);
@@ -580,18 +804,22 @@ void aif2pcm(const char *aif_filename, const char *pcm_filename, bool compress)
 	uint32_t flags = 0;
 	if (aif_data.has_loop) flags |= 0x40000000;
 	if (compress) flags |= 1;
-	STORE_U32_LE(output.data + 0, flags);
-	STORE_U32_LE(output.data + 4, pitch_adjust);
-	STORE_U32_LE(output.data + 8, loop_offset);
-	STORE_U32_LE(output.data + 12, adjusted_num_samples);
-	memcpy(&output.data[header_size], pcm->data, pcm->length);
-	write_bytearray(pcm_filename, &output);
+	STORE_U32_LE(output + 0, flags);
+	STORE_U32_LE(output + 4, pitch_adjust);
+	STORE_U32_LE(output + 8, loop_offset);
+	STORE_U32_LE(output + 12, adjusted_num_samples);
+	write_bytearray(pcm_filename, &buffers->output.bytes);
+}
 
-	free(aif->data);
-	free(aif);
-	free(pcm);
-	free(output.data);
-	free(aif_data.samples);
+// Reads an .aif file and produces a .pcm file containing an array of 8-bit samples.
+void aif2pcm(const char *aif_filename, const char *pcm_filename, bool compress, bool trellis)
+{
+	struct ConvertBuffers buffers;
+
+	memset(&buffers, 0, sizeof(buffers));
+	read_reusable_bytes(aif_filename, &buffers.aif);
+	convert_aif(pcm_filename, compress, trellis, &buffers);
+	free_convert_buffers(&buffers);
 }
 
 // Reads a .pcm file containing an array of 8-bit samples and produces an .aif file.
@@ -844,10 +1072,385 @@ void pcm2aif(const char *pcm_filename, const char *aif_filename, uint32_t base_n
 	free(aif);
 }
 
+// Compresses every given .aif file many times with each encoder and prints
+// how long that took and how far the decoded samples are from the originals.
+// The table-driven greedy encoder is also checked against get_delta_index for
+// every pair of samples.
+void benchmark(int num_files, char **filenames)
+{
+	for (int prev = 0; prev < 256; prev++)
+	{
+		for (int sample = 0; sample < 256; sample++)
+		{
+			uint8_t samples[2] = { prev, sample };
+			uint8_t indices[2];
+
+			choose_deltas_greedy(samples, 2, indices);
+			if (indices[1] != get_delta_index(sample, prev))
+				FATAL_ERROR("Delta index table disagrees with get_delta_index for %d after %d\n", sample, prev);
+		}
+	}
+
+	const int repeats[2] = { 20, 1 };
+	const char *names[2] = { "greedy", "trellis" };
+	double seconds[2] = { 0, 0 };
+	double squared_error[2] = { 0, 0 };
+	unsigned long total_samples = 0;
+
+	for (int f = 0; f < num_files; f++)
+	{
+		struct Bytes *aif = read_bytearray(filenames[f]);
+		AifData aif_data = {0,0,0,0,0,0,0};
+		read_aif(aif, &aif_data);
+
+		struct Bytes input = { aif_data.real_num_samples, aif_data.samples };
+		struct Bytes delta = { 0, malloc(delta_compress_bound(input.length)) };
+		total_samples += input.length;
+
+		for (int mode = 0; mode < 2; mode++)
+		{
+			clock_t start = clock();
+
+			for (int r = 0; r < repeats[mode]; r++)
+				delta.length = delta_compress(input.data, input.length, delta.data, mode == 1);
+
+			seconds[mode] += (double)(clock() - start) / CLOCKS_PER_SEC / repeats[mode];
+
+			struct Bytes *decoded = delta_decompress(&delta, input.length);
+
+			for (unsigned long i = 0; i < decoded->length; i++)
+			{
+				int error = U8_TO_S8(decoded->data[i]) - U8_TO_S8(input.data[i]);
+				squared_error[mode] += error * error;
+			}
+
+			free_bytearray(decoded);
+		}
+
+		free(delta.data);
+		free_bytearray(aif);
+	}
+
+	printf("%d files, %lu samples\n", num_files, total_samples);
+
+	for (int mode = 0; mode < 2; mode++)
+	{
+		printf("%-8s %8.3f ms %10.1f Msamples/s  mean squared error %.3f\n",
+			names[mode],
+			seconds[mode] * 1000,
+			seconds[mode] > 0 ? total_samples / seconds[mode] / 1e6 : 0.0,
+			total_samples > 0 ? squared_error[mode] / total_samples : 0.0);
+	}
+}
+
+// One line of a batch manifest.
+struct BatchJob {
+	char *input;
+	char *output;
+	bool compress;
+	bool trellis;
+	bool has_old_hash;
+	uint64_t old_hash;
+	uint64_t hash;
+};
+
+struct Batch {
+	struct BatchJob *jobs;
+	int num_jobs;
+	int next_job;
+	int num_converted;
+	pthread_mutex_t mutex;
+};
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+	const uint8_t *bytes = data;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ULL;
+	}
+
+	return hash;
+}
+
+static char *copy_string(const char *string)
+{
+	char *copy = malloc(strlen(string) + 1);
+
+	strcpy(copy, string);
+	return copy;
+}
+
+static bool file_exists(const char *filename)
+{
+	FILE *f = fopen(filename, "rb");
+
+	if (f == NULL)
+		return false;
+
+	fclose(f);
+	return true;
+}
+
+// Reads a manifest with one "<aif_file> <bin_file> [--compress] [--trellis]"
+// line per conversion. Blank lines and lines starting with '#' are skipped.
+// A filename of "-" reads the manifest from stdin.
+static void read_batch_manifest(const char *filename, struct Batch *batch)
+{
+	FILE *f = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+	if (!f)
+	{
+		FATAL_ERROR("Failed to open '%s' for reading!\n", filename);
+	}
+
+	int capacity = 0;
+	char line[4096];
+	int line_num = 0;
+
+	while (fgets(line, sizeof(line), f))
+	{
+		line_num++;
+
+		char *fields[4];
+		int num_fields = 0;
+
+		for (char *field = strtok(line, " \t\r\n"); field != NULL; field = strtok(NULL, " \t\r\n"))
+		{
+			if (num_fields == 4)
+			{
+				FATAL_ERROR("%s:%d: too many fields\n", filename, line_num);
+			}
+			fields[num_fields++] = field;
+		}
+
+		if (num_fields == 0 || fields[0][0] == '#')
+			continue;
+
+		if (num_fields < 2)
+		{
+			FATAL_ERROR("%s:%d: expected an input and an output file\n", filename, line_num);
+		}
+
+		if (batch->num_jobs == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 256;
+			batch->jobs = realloc(batch->jobs, capacity * sizeof(struct BatchJob));
+		}
+
+		struct BatchJob *job = &batch->jobs[batch->num_jobs++];
+
+		memset(job, 0, sizeof(*job));
+		job->input = copy_string(fields[0]);
+		job->output = copy_string(fields[1]);
+
+		for (int i = 2; i < num_fields; i++)
+		{
+			if (strcmp(fields[i], "--compress") == 0)
+				job->compress = true;
+			else if (strcmp(fields[i], "--trellis") == 0)
+				job->trellis = true;
+			else
+				FATAL_ERROR("%s:%d: unknown option '%s'\n", filename, line_num, fields[i]);
+		}
+	}
+
+	if (f != stdin)
+		fclose(f);
+}
+
+// The state file has one "<hash> <bin_file>" line for every output of the
+// last batch, where the hash covers the input file, the options and the
+// build of aif2pcm.
+static void read_batch_state(const char *filename, struct Batch *batch)
+{
+	FILE *f = fopen(filename, "r");
+
+	if (f == NULL)
+		return;
+
+	char line[4096];
+	int hint = 0;
+
+	while (fgets(line, sizeof(line), f))
+	{
+		unsigned long long hash;
+		char output[4096];
+
+		if (sscanf(line, "%16llx %4095s", &hash, output) != 2)
+			continue;
+
+		// The state is written in manifest order, so the matching job is
+		// almost always the one after the last match.
+		for (int i = 0; i < batch->num_jobs; i++)
+		{
+			struct BatchJob *job = &batch->jobs[(hint + i) % batch->num_jobs];
+
+			if (strcmp(job->output, output) == 0)
+			{
+				job->has_old_hash = true;
+				job->old_hash = hash;
+				hint = (hint + i + 1) % batch->num_jobs;
+				break;
+			}
+		}
+	}
+
+	fclose(f);
+}
+
+static void write_batch_state(const char *filename, struct Batch *batch)
+{
+	size_t tmp_size = strlen(filename) + 32;
+	char *tmp_filename = malloc(tmp_size);
+
+	snprintf(tmp_filename, tmp_size, "%s.%d.tmp", filename, (int)GetPid());
+
+	FILE *f = fopen(tmp_filename, "w");
+	if (!f)
+	{
+		FATAL_ERROR("Failed to open '%s' for writing!\n", tmp_filename);
+	}
+
+	for (int i = 0; i < batch->num_jobs; i++)
+		fprintf(f, "%016llx %s\n", (unsigned long long)batch->jobs[i].hash, batch->jobs[i].output);
+
+	if (fclose(f) != 0 || rename(tmp_filename, filename) != 0)
+	{
+		remove(tmp_filename);
+		FATAL_ERROR("Failed to write '%s'!\n", filename);
+	}
+
+	free(tmp_filename);
+}
+
+// Single conversions and batches use the same keys, so that they can share
+// cached outputs. The input's contents are added by the caller.
+static void init_cache_key(struct BuildCacheKey *key, bool to_pcm, bool compress, bool trellis)
+{
+	BuildCacheKeyInit(key, AIF2PCM_CACHE_VERSION);
+	BuildCacheKeyAddString(key, to_pcm ? "aif2pcm" : "pcm2aif");
+	BuildCacheKeyAddString(key, compress ? "--compress" : "");
+	BuildCacheKeyAddString(key, compress && trellis ? "--trellis" : "");
+}
+
+static void *batch_worker(void *arg)
+{
+	struct Batch *batch = arg;
+	struct ConvertBuffers buffers;
+	int num_converted = 0;
+
+	memset(&buffers, 0, sizeof(buffers));
+
+	for (;;)
+	{
+		pthread_mutex_lock(&batch->mutex);
+		int index = batch->next_job++;
+		pthread_mutex_unlock(&batch->mutex);
+
+		if (index >= batch->num_jobs)
+			break;
+
+		struct BatchJob *job = &batch->jobs[index];
+		const char *version = AIF2PCM_CACHE_VERSION;
+		uint8_t options = job->compress | (job->compress && job->trellis) << 1;
+
+		read_reusable_bytes(job->input, &buffers.aif);
+
+		job->hash = hash_bytes(0xCBF29CE484222325ULL, version, strlen(version) + 1);
+		job->hash = hash_bytes(job->hash, &options, 1);
+		job->hash = hash_bytes(job->hash, buffers.aif.bytes.data, buffers.aif.bytes.length);
+
+		if (job->has_old_hash && job->old_hash == job->hash && file_exists(job->output))
+			continue;
+
+		struct BuildCacheKey cache_key;
+		bool use_cache = BuildCacheEnabled();
+
+		if (use_cache)
+		{
+			init_cache_key(&cache_key, true, job->compress, job->trellis);
+			BuildCacheKeyAddData(&cache_key, buffers.aif.bytes.data, buffers.aif.bytes.length);
+
+			if (BuildCacheFetch(&cache_key, job->output))
+				continue;
+		}
+
+		convert_aif(job->output, job->compress, job->trellis, &buffers);
+		num_converted++;
+
+		if (use_cache)
+			BuildCacheStore(&cache_key, job->output);
+	}
+
+	free_convert_buffers(&buffers);
+
+	pthread_mutex_lock(&batch->mutex);
+	batch->num_converted += num_converted;
+	pthread_mutex_unlock(&batch->mutex);
+
+	return NULL;
+}
+
+// Converts every .aif file listed in the manifest on a pool of threads.
+// If a state file is given, outputs whose input has not changed since the
+// last batch are left alone, so that their timestamps are kept.
+void batch(const char *manifest_filename, const char *state_filename, int num_threads)
+{
+	struct Batch batch;
+
+	memset(&batch, 0, sizeof(batch));
+	read_batch_manifest(manifest_filename, &batch);
+
+	if (state_filename != NULL)
+		read_batch_state(state_filename, &batch);
+
+	// Build the shared tables up front, so the workers only ever read them.
+	build_delta_index_table();
+
+	if (num_threads > batch.num_jobs)
+		num_threads = batch.num_jobs;
+	if (num_threads < 1)
+		num_threads = 1;
+
+	pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+
+	pthread_mutex_init(&batch.mutex, NULL);
+
+	for (int i = 1; i < num_threads; i++)
+	{
+		if (pthread_create(&threads[i], NULL, batch_worker, &batch) != 0)
+		{
+			FATAL_ERROR("Failed to start a worker thread!\n");
+		}
+	}
+
+	batch_worker(&batch);
+
+	for (int i = 1; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&batch.mutex);
+	free(threads);
+
+	if (state_filename != NULL)
+		write_batch_state(state_filename, &batch);
+
+	for (int i = 0; i < batch.num_jobs; i++)
+	{
+		free(batch.jobs[i].input);
+		free(batch.jobs[i].output);
+	}
+	free(batch.jobs);
+}
+
 void usage(void)
 {
 	fprintf(stderr, "Usage: aif2pcm bin_file [aif_file]\n");
-	fprintf(stderr, "       aif2pcm aif_file [bin_file] [--compress]\n");
+	fprintf(stderr, "       aif2pcm aif_file [bin_file] [--compress [--trellis]]\n");
+	fprintf(stderr, "       aif2pcm --batch manifest_file [--state state_file] [-j threads]\n");
+	fprintf(stderr, "       aif2pcm --benchmark aif_file...\n");
 }
 
 int main(int argc, char **argv)
@@ -858,10 +1461,54 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (strcmp(argv[1], "--batch") == 0)
+	{
+		const char *state_file = NULL;
+		int num_threads = 0;
+
+		if (argc < 3)
+		{
+			usage();
+			exit(1);
+		}
+
+		for (int i = 3; i < argc; i++)
+		{
+			if (strcmp(argv[i], "--state") == 0 && i + 1 < argc)
+			{
+				state_file = argv[++i];
+			}
+			else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			{
+				num_threads = atoi(argv[++i]);
+			}
+			else
+			{
+				usage();
+				exit(1);
+			}
+		}
+
+#ifdef _SC_NPROCESSORS_ONLN
+		if (num_threads < 1)
+			num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+		batch(argv[2], state_file, num_threads);
+		return 0;
+	}
+
+	if (strcmp(argv[1], "--benchmark") == 0)
+	{
+		benchmark(argc - 2, &argv[2]);
+		return 0;
+	}
+
 	char *input_file = argv[1];
 	char *extension = get_file_extension(input_file);
 	char *output_file;
 	bool compressed = false;
+	bool trellis = false;
 
 	if (argc > 3)
 	{
@@ -871,41 +1518,50 @@ int main(int argc, char **argv)
 			{
 				compressed = true;
 			}
+			else if (strcmp(argv[i], "--trellis") == 0)
+			{
+				trellis = true;
+			}
 		}
 	}
 
+	bool to_pcm;
+
 	if (strcmp(extension, "aif") == 0 || strcmp(extension, "aiff") == 0)
+		to_pcm = true;
+	else if (strcmp(extension, "bin") == 0)
+		to_pcm = false;
+	else
+		FATAL_ERROR("Input file must be .aif or .bin: '%s'\n", input_file);
+
+	if (argc >= 3)
+		output_file = argv[2];
+	else
+		output_file = new_file_extension(input_file, to_pcm ? "bin" : "aif");
+
+	struct BuildCacheKey cache_key;
+	bool use_cache = BuildCacheEnabled();
+
+	if (use_cache)
 	{
-		if (argc >= 3)
-		{
-			output_file = argv[2];
-			aif2pcm(input_file, output_file, compressed);
-		}
-		else
-		{
-			output_file = new_file_extension(input_file, "bin");
-			aif2pcm(input_file, output_file, compressed);
-			free(output_file);
-		}
+		init_cache_key(&cache_key, to_pcm, compressed, trellis);
+		if (!BuildCacheKeyAddFile(&cache_key, input_file))
+			FATAL_ERROR("Failed to open '%s' for reading!\n", input_file);
 	}
-	else if (strcmp(extension, "bin") == 0)
+
+	if (!use_cache || !BuildCacheFetch(&cache_key, output_file))
 	{
-		if (argc >= 3)
-		{
-			output_file = argv[2];
-			pcm2aif(input_file, output_file, 60);
-		}
+		if (to_pcm)
+			aif2pcm(input_file, output_file, compressed, trellis);
 		else
-		{
-			output_file = new_file_extension(input_file, "aif");
 			pcm2aif(input_file, output_file, 60);
-			free(output_file);
-		}
-	}
-	else
-	{
-		FATAL_ERROR("Input file must be .aif or .bin: '%s'\n", input_file);
+
+		if (use_cache)
+			BuildCacheStore(&cache_key, output_file);
 	}
 
+	if (output_file != argv[2])
+		free(output_file);
+
 	return 0;
 }
@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "global.h"
+#include "util.h"
+#include "symbol_table.h"
+
+#define CYCLES_PER_FRAME 280896
+#define MAX_CALLS_PER_FRAME 256
+
+#define IMAGE_WIDTH 1200
+#define IMAGE_MARGIN 10
+#define ROW_HEIGHT 16
+#define TITLE_HEIGHT 30
+#define CHAR_WIDTH 7
+
+// A function in a call stack. Nodes live in one array and point at each other
+// by index, so that growing the array doesn't break the tree.
+struct Node {
+    const char *name;
+    uint64_t self;
+    uint64_t total;
+    int firstChild;
+    int nextSibling;
+};
+
+struct Call {
+    int parent;
+    uint32_t address;
+    uint64_t cycles;
+};
+
+struct Profile {
+    struct SymbolTable functions; // sorted by address
+    struct Node *nodes;
+    int numNodes;
+    int nodeCapacity;
+    int numFrames;
+    int numOverBudget;
+    bool overBudgetOnly;
+};
+
+static int CompareSymbolAddresses(const void *a, const void *b)
+{
+    const struct Symbol *x = a;
+    const struct Symbol *y = b;
+
+    return x->address < y->address ? -1 : x->address > y->address;
+}
+
+// Names the function at address, or gives its address if the ELF file
+// doesn't have a function there.
+static const char *GetFunctionName(struct Profile *profile, uint32_t address)
+{
+    struct Symbol *symbols = profile->functions.symbols;
+
+    // Thumb function pointers have the low bit set.
+    address &= ~1;
+
+    int low = 0;
+    int high = profile->functions.numSymbols;
+
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+
+        if (symbols[mid].address <= address)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (low > 0)
+    {
+        struct Symbol *symbol = &symbols[low - 1];
+
+        // Take the first of the symbols that share this address.
+        while (symbol > symbols && symbol[-1].address == symbol->address)
+            symbol--;
+
+        if (symbol->size == 0 || address - symbol->address < symbol->size)
+            return symbol->name;
+    }
+
+    char *name = malloc(11);
+
+    if (name == NULL)
+        FATAL_ERROR("Failed to allocate memory for function name.\n");
+
+    snprintf(name, 11, "0x%08" PRIX32, address);
+    return name;
+}
+
+static int AddNode(struct Profile *profile, const char *name)
+{
+    if (profile->numNodes == profile->nodeCapacity)
+    {
+        profile->nodeCapacity *= 2;
+        profile->nodes = realloc(profile->nodes, sizeof(struct Node) * profile->nodeCapacity);
+
+        if (profile->nodes == NULL)
+            FATAL_ERROR("Failed to allocate memory for call tree.\n");
+    }
+
+    struct Node *node = &profile->nodes[profile->numNodes];
+
+    node->name = name;
+    node->self = 0;
+    node->total = 0;
+    node->firstChild = -1;
+    node->nextSibling = -1;
+    return profile->numNodes++;
+}
+
+static int GetChildNode(struct Profile *profile, int parent, const char *name)
+{
+    int child;
+
+    for (child = profile->nodes[parent].firstChild; child != -1; child = profile->nodes[child].nextSibling)
+        if (strcmp(profile->nodes[child].name, name) == 0)
+            return child;
+
+    child = AddNode(profile, name);
+    profile->nodes[child].nextSibling = profile->nodes[parent].firstChild;
+    profile->nodes[parent].firstChild = child;
+    return child;
+}
+
+// Adds a frame's calls to the tree. A call's cycles include those of the calls
+// made from it, so each node gets only what is left after its children.
+static void AddFrame(struct Profile *profile, uint64_t frameCycles, struct Call *calls, int numCalls)
+{
+    bool overBudget = frameCycles > CYCLES_PER_FRAME;
+
+    if (profile->overBudgetOnly && !overBudget)
+        return;
+
+    profile->numFrames++;
+    profile->numOverBudget += overBudget;
+
+    int nodes[MAX_CALLS_PER_FRAME];
+    uint64_t childCycles[MAX_CALLS_PER_FRAME];
+    uint64_t topLevelCycles = 0;
+
+    for (int i = 0; i < numCalls; i++)
+    {
+        int parentNode = calls[i].parent == -1 ? 0 : nodes[calls[i].parent];
+
+        nodes[i] = GetChildNode(profile, parentNode, GetFunctionName(profile, calls[i].address));
+        childCycles[i] = 0;
+
+        if (calls[i].parent == -1)
+            topLevelCycles += calls[i].cycles;
+        else
+            childCycles[calls[i].parent] += calls[i].cycles;
+    }
+
+    // The timer counts in steps, so children can add up to a little more
+    // than their parent.
+    for (int i = 0; i < numCalls; i++)
+        if (calls[i].cycles > childCycles[i])
+            profile->nodes[nodes[i]].self += calls[i].cycles - childCycles[i];
+
+    if (frameCycles > topLevelCycles)
+        profile->nodes[0].self += frameCycles - topLevelCycles;
+}
+
+// Reads the FRAMEPROF lines of the log, wherever they are in the line, since
+// emulators add their own prefixes to debug output.
+static void ReadLog(struct Profile *profile, char *path)
+{
+    int size;
+    unsigned char *data = ReadWholeFile(path, &size);
+    char *text = realloc(data, size + 1);
+
+    if (text == NULL)
+        FATAL_ERROR("Failed to allocate memory for reading \"%s\".\n", path);
+
+    text[size] = 0;
+
+    struct Call calls[MAX_CALLS_PER_FRAME];
+    int numCalls = 0;
+    uint64_t frameCycles = 0;
+    bool inFrame = false;
+    int lineNum = 0;
+
+    for (char *line = strtok(text, "\r\n"); line != NULL; line = strtok(NULL, "\r\n"))
+    {
+        lineNum++;
+
+        char *record = strstr(line, "FRAMEPROF ");
+
+        if (record == NULL)
+            continue;
+
+        record += strlen("FRAMEPROF ");
+
+        unsigned long long cycles;
+        unsigned long address;
+        int entry, parent, kind, numCallsMade;
+
+        if (sscanf(record, "FRAME %llu", &cycles) == 1)
+        {
+            if (inFrame)
+                AddFrame(profile, frameCycles, calls, numCalls);
+
+            inFrame = true;
+            frameCycles = cycles;
+            numCalls = 0;
+        }
+        else if (sscanf(record, "CALL %d %d %d %lx %d %llu", &entry, &parent, &kind, &address, &numCallsMade, &cycles) == 6)
+        {
+            if (!inFrame || entry != numCalls || entry >= MAX_CALLS_PER_FRAME || parent < -1 || parent >= entry)
+                FATAL_ERROR("%s:%d: Call doesn't belong to the frame before it.\n", path, lineNum);
+
+            calls[numCalls].parent = parent;
+            calls[numCalls].address = address;
+            calls[numCalls].cycles = cycles;
+            numCalls++;
+        }
+    }
+
+    if (inFrame)
+        AddFrame(profile, frameCycles, calls, numCalls);
+
+    free(text);
+}
+
+static uint64_t ComputeTotals(struct Profile *profile, int node)
+{
+    uint64_t total = profile->nodes[node].self;
+
+    for (int child = profile->nodes[node].firstChild; child != -1; child = profile->nodes[child].nextSibling)
+        total += ComputeTotals(profile, child);
+
+    profile->nodes[node].total = total;
+    return total;
+}
+
+static struct Profile *sSortProfile;
+
+static int CompareNodeNames(const void *a, const void *b)
+{
+    return strcmp(sSortProfile->nodes[*(const int *)a].name, sSortProfile->nodes[*(const int *)b].name);
+}
+
+// Orders the children of every node by name, as flame graphs do.
+static void SortChildren(struct Profile *profile, int node)
+{
+    int numChildren = 0;
+
+    for (int child = profile->nodes[node].firstChild; child != -1; child = profile->nodes[child].nextSibling)
+        numChildren++;
+
+    if (numChildren == 0)
+        return;
+
+    int *children = malloc(sizeof(int) * numChildren);
+
+    if (children == NULL)
+        FATAL_ERROR("Failed to allocate memory for call tree.\n");
+
+    int i = 0;
+
+    for (int child = profile->nodes[node].firstChild; child != -1; child = profile->nodes[child].nextSibling)
+        children[i++] = child;
+
+    sSortProfile = profile;
+    qsort(children, numChildren, sizeof(int), CompareNodeNames);
+
+    profile->nodes[node].firstChild = children[0];
+
+    for (i = 0; i < numChildren; i++)
+    {
+        profile->nodes[children[i]].nextSibling = i + 1 < numChildren ? children[i + 1] : -1;
+        SortChildren(profile, children[i]);
+    }
+
+    free(children);
+}
+
+static int GetDepth(struct Profile *profile, int node)
+{
+    int depth = 0;
+
+    for (int child = profile->nodes[node].firstChild; child != -1; child = profile->nodes[child].nextSibling)
+    {
+        int childDepth = GetDepth(profile, child);
+
+        if (childDepth > depth)
+            depth = childDepth;
+    }
+
+    return depth + 1;
+}
+
+// Writes one line per stack, in the "folded" format that flamegraph.pl and
+// most other flame graph viewers read.
+static void WriteFolded(FILE *fp, struct Profile *profile, int node, char *stack, size_t stackLength)
+{
+    size_t nameLength = strlen(profile->nodes[node].name);
+    char *newStack = malloc(stackLength + nameLength + 2);
+
+    if (newStack == NULL)
+        FATAL_ERROR("Failed to allocate memory for call stack.\n");
+
+    if (stackLength > 0)
+    {
+        memcpy(newStack, stack, stackLength);
+        newStack[stackLength++] = ';';
+    }
+
+    memcpy(newStack + stackLength, profile->nodes[node].name, nameLength + 1);
+    stackLength += nameLength;
+
+    if (profile->nodes[node].self > 0)
+        fprintf(fp, "%s %" PRIu64 "\n", newStack, profile->nodes[node].self);
+
+    for (int child = profile->nodes[node].firstChild; child != -1; child = profile->nodes[child].nextSibling)
+        WriteFolded(fp, profile, child, newStack, stackLength);
+
+    free(newStack);
+}
+
+// Flame graph colors, picked from the name so that a function keeps its color
+// from one graph to the next.
+static void GetNodeColor(const char *name, int *red, int *green, int *blue)
+{
+    uint32_t hash = 2166136261u;
+
+    for (const char *p = name; *p != 0; p++)
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+
+    *red = 205 + hash % 50;
+    *green = (hash >> 8) % 230;
+    *blue = (hash >> 16) % 55;
+}
+
+// Symbol names only have letters, digits, '_', '.' and '$' in them, so they
+// don't need escaping.
+static void WriteSvgNode(FILE *fp, struct Profile *profile, int node, double x, int depth, int imageHeight)
+{
+    struct Node *n = &profile->nodes[node];
+    uint64_t rootTotal = profile->nodes[0].total;
+    double width = (double)n->total / rootTotal * (IMAGE_WIDTH - 2 * IMAGE_MARGIN);
+
+    if (width < 0.1)
+        return;
+
+    int y = imageHeight - IMAGE_MARGIN - (depth + 1) * ROW_HEIGHT;
+    int red, green, blue;
+
+    GetNodeColor(n->name, &red, &green, &blue);
+    fprintf(fp, "<g>\n<title>%s (%" PRIu64 " cycles, %.2f%%, %.0f per frame)</title>\n",
+            n->name, n->total, 100.0 * n->total / rootTotal, (double)n->total / profile->numFrames);
+    fprintf(fp, "<rect x=\"%.1f\" y=\"%d\" width=\"%.1f\" height=\"%d\" fill=\"rgb(%d,%d,%d)\" rx=\"2\" ry=\"2\"/>\n",
+            x, y, width, ROW_HEIGHT - 1, red, green, blue);
+
+    int maxChars = (int)(width - 6) / CHAR_WIDTH;
+    int nameLength = strlen(n->name);
+
+    if (maxChars >= 3)
+    {
+        if (nameLength <= maxChars)
+            fprintf(fp, "<text x=\"%.1f\" y=\"%d\">%s</text>\n", x + 3, y + ROW_HEIGHT - 5, n->name);
+        else
+            fprintf(fp, "<text x=\"%.1f\" y=\"%d\">%.*s..</text>\n", x + 3, y + ROW_HEIGHT - 5, maxChars - 2, n->name);
+    }
+
+    fprintf(fp, "</g>\n");
+
+    for (int child = n->firstChild; child != -1; child = profile->nodes[child].nextSibling)
+    {
+        WriteSvgNode(fp, profile, child, x, depth + 1, imageHeight);
+        x += (double)profile->nodes[child].total / rootTotal * (IMAGE_WIDTH - 2 * IMAGE_MARGIN);
+    }
+}
+
+static void WriteSvg(FILE *fp, struct Profile *profile)
+{
+    int imageHeight = TITLE_HEIGHT + GetDepth(profile, 0) * ROW_HEIGHT + 2 * IMAGE_MARGIN;
+
+    fprintf(fp, "<?xml version=\"1.0\" standalone=\"no\"?>\n");
+    fprintf(fp, "<svg version=\"1.1\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\" xmlns=\"http://www.w3.org/2000/svg\">\n",
+            IMAGE_WIDTH, imageHeight, IMAGE_WIDTH, imageHeight);
+    fprintf(fp, "<style>text { font-family: Verdana, sans-serif; font-size: 12px; fill: black; }</style>\n");
+    fprintf(fp, "<rect x=\"0\" y=\"0\" width=\"100%%\" height=\"100%%\" fill=\"rgb(248,248,248)\"/>\n");
+    fprintf(fp, "<text x=\"%d\" y=\"%d\" text-anchor=\"middle\" style=\"font-size: 16px\">%d frames, %d of them over budget</text>\n",
+            IMAGE_WIDTH / 2, TITLE_HEIGHT - 8, profile->numFrames, profile->numOverBudget);
+    WriteSvgNode(fp, profile, 0, IMAGE_MARGIN, 0, imageHeight);
+    fprintf(fp, "</svg>\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+        FATAL_ERROR("Usage: frameprof ELF_PATH LOG_PATH OUTPUT [--folded] [--over-budget]\n"
+                    "Makes an SVG flame graph out of the FRAMEPROF lines that FRAME_PROFILER\n"
+                    "printed to LOG_PATH, or folded stacks for other viewers with --folded.\n"
+                    "With --over-budget, only frames that ran past the next VBlank count.\n");
+
+    char *elfPath = argv[1];
+    char *logPath = argv[2];
+    char *outputPath = argv[3];
+    bool folded = false;
+    struct Profile profile;
+
+    profile.overBudgetOnly = false;
+
+    for (int i = 4; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "--folded") == 0)
+            folded = true;
+        else if (strcmp(option, "--over-budget") == 0)
+            profile.overBudgetOnly = true;
+        else
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+    }
+
+    ReadSymbolTable(elfPath, &profile.functions);
+    qsort(profile.functions.symbols, profile.functions.numSymbols, sizeof(struct Symbol), CompareSymbolAddresses);
+
+    profile.nodeCapacity = 256;
+    profile.nodes = malloc(sizeof(struct Node) * profile.nodeCapacity);
+    profile.numNodes = 0;
+    profile.numFrames = 0;
+    profile.numOverBudget = 0;
+
+    if (profile.nodes == NULL)
+        FATAL_ERROR("Failed to allocate memory for call tree.\n");
+
+    AddNode(&profile, "frame");
+    ReadLog(&profile, logPath);
+
+    if (profile.numFrames == 0)
+        FATAL_ERROR("No frames in \"%s\".\n", logPath);
+
+    ComputeTotals(&profile, 0);
+    SortChildren(&profile, 0);
+
+    FILE *fp = fopen(outputPath, "w");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", outputPath);
+
+    if (folded)
+        WriteFolded(fp, &profile, 0, NULL, 0);
+    else
+        WriteSvg(fp, &profile);
+
+    fclose(fp);
+
+    fprintf(stderr, "%d frames, %d of them over budget\n", profile.numFrames, profile.numOverBudget);
+
+    free(profile.nodes);
+    FreeSymbolTable(&profile.functions);
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "global.h"
+#include "elf.h"
+#include "symbol_table.h"
+#include "util.h"
+
+struct Boundaries {
+    uint32_t *addresses;
+    int count;
+    int capacity;
+};
+
+static void AddBoundary(struct Boundaries *boundaries, uint64_t address)
+{
+    if (address > UINT32_MAX)
+        return;
+
+    if (boundaries->count == boundaries->capacity)
+    {
+        boundaries->capacity = boundaries->capacity == 0 ? 1024 : boundaries->capacity * 2;
+        boundaries->addresses = realloc(boundaries->addresses, sizeof(uint32_t) * boundaries->capacity);
+
+        if (boundaries->addresses == NULL)
+            FATAL_ERROR("Failed to allocate memory for symbol table.\n");
+    }
+
+    boundaries->addresses[boundaries->count++] = address;
+}
+
+static int CompareAddresses(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// Returns the first boundary after address, or 0 if there is none.
+static uint32_t GetNextBoundary(struct Boundaries *boundaries, uint32_t address)
+{
+    int low = 0;
+    int high = boundaries->count;
+
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+
+        if (boundaries->addresses[mid] <= address)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low < boundaries->count ? boundaries->addresses[low] : 0;
+}
+
+// Returns the header of section index, checking that its contents are in
+// the file.
+static Elf32_Shdr *GetSection(struct SymbolTable *table, int size, Elf32_Ehdr *header, int index, char *path)
+{
+    if (index <= 0 || index >= header->e_shnum)
+        FATAL_ERROR("\"%s\" has a bad section index %d.\n", path, index);
+
+    Elf32_Shdr *section = (Elf32_Shdr *)&table->data[header->e_shoff + index * header->e_shentsize];
+
+    if (section->sh_type != SHT_NOBITS && (section->sh_offset > size || section->sh_size > size - section->sh_offset))
+        FATAL_ERROR("Section %d of \"%s\" runs past the end of the file.\n", index, path);
+
+    return section;
+}
+
+// Function symbols are the named ones typed as functions that are defined in
+// a section.
+static bool IsFunctionSymbol(Elf32_Sym *sym, char *name)
+{
+    if (ELF32_ST_TYPE(sym->st_info) != STT_FUNC)
+        return false;
+
+    if (sym->st_shndx == SHN_UNDEF || sym->st_shndx >= SHN_LORESERVE)
+        return false;
+
+    return name[0] != 0;
+}
+
+void ReadSymbolTable(char *path, struct SymbolTable *table)
+{
+    int size;
+
+    table->data = ReadWholeFile(path, &size);
+    table->symbols = NULL;
+    table->numSymbols = 0;
+
+    Elf32_Ehdr *header = (Elf32_Ehdr *)table->data;
+
+    if (size < sizeof(Elf32_Ehdr) || memcmp(header->e_ident, ELFMAG, SELFMAG) != 0)
+        FATAL_ERROR("\"%s\" is not an ELF file.\n", path);
+
+    if (header->e_ident[EI_CLASS] != ELFCLASS32 || header->e_ident[EI_DATA] != ELFDATA2LSB)
+        FATAL_ERROR("\"%s\" is not a 32-bit little-endian ELF file.\n", path);
+
+    if (header->e_shentsize < sizeof(Elf32_Shdr) || header->e_shoff > size
+     || (uint64_t)header->e_shnum * header->e_shentsize > size - header->e_shoff)
+        FATAL_ERROR("The section headers of \"%s\" run past the end of the file.\n", path);
+
+    struct Boundaries boundaries = { NULL, 0, 0 };
+    Elf32_Shdr *symtab = NULL;
+
+    for (int i = 1; i < header->e_shnum; i++)
+    {
+        Elf32_Shdr *section = GetSection(table, size, header, i, path);
+
+        if (section->sh_type == SHT_SYMTAB)
+            symtab = section;
+
+        if (section->sh_flags & SHF_ALLOC)
+        {
+            AddBoundary(&boundaries, section->sh_addr);
+            AddBoundary(&boundaries, (uint64_t)section->sh_addr + section->sh_size);
+        }
+    }
+
+    if (symtab == NULL)
+        FATAL_ERROR("\"%s\" has no symbol table.\n", path);
+
+    Elf32_Shdr *strtab = GetSection(table, size, header, symtab->sh_link, path);
+    char *strings = (char *)&table->data[strtab->sh_offset];
+    Elf32_Sym *syms = (Elf32_Sym *)&table->data[symtab->sh_offset];
+    int numSyms = symtab->sh_size / sizeof(Elf32_Sym);
+
+    if (strtab->sh_size == 0 || strings[strtab->sh_size - 1] != 0)
+        FATAL_ERROR("The string table of \"%s\" is not terminated.\n", path);
+
+    table->symbols = malloc(sizeof(struct Symbol) * (numSyms + 1));
+
+    if (table->symbols == NULL)
+        FATAL_ERROR("Failed to allocate memory for symbol table.\n");
+
+    for (int i = 0; i < numSyms; i++)
+    {
+        if (syms[i].st_name >= strtab->sh_size)
+            FATAL_ERROR("Symbol %d of \"%s\" has a bad name.\n", i, path);
+
+        char *name = &strings[syms[i].st_name];
+
+        if (!IsFunctionSymbol(&syms[i], name))
+            continue;
+
+        struct Symbol *symbol = &table->symbols[table->numSymbols++];
+
+        symbol->name = name;
+        symbol->address = syms[i].st_value & ~1;
+        symbol->size = syms[i].st_size;
+
+        AddBoundary(&boundaries, symbol->address);
+        AddBoundary(&boundaries, (uint64_t)symbol->address + symbol->size);
+    }
+
+    qsort(boundaries.addresses, boundaries.count, sizeof(uint32_t), CompareAddresses);
+
+    for (int i = 0; i < table->numSymbols; i++)
+    {
+        struct Symbol *symbol = &table->symbols[i];
+
+        if (symbol->size == 0)
+        {
+            uint32_t end = GetNextBoundary(&boundaries, symbol->address);
+
+            symbol->size = end == 0 ? 0 : end - symbol->address;
+        }
+    }
+
+    free(boundaries.addresses);
+}
+
+void FreeSymbolTable(struct SymbolTable *table)
+{
+    free(table->symbols);
+    free(table->data);
+}
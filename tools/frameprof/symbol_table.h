@@ -0,0 +1,26 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <stdint.h>
+
+struct Symbol {
+    char *name;
+    uint32_t address;
+    uint32_t size;
+};
+
+// The function symbols of an ELF file's symbol table, static ones included,
+// at their addresses without the Thumb bit. Most have their size in the
+// table. Functions in assembly that don't set one run up to the next address
+// where a function or an allocated section starts or ends, or have a size of
+// 0 if there is no such address.
+struct SymbolTable {
+    unsigned char *data;
+    struct Symbol *symbols;
+    int numSymbols;
+};
+
+void ReadSymbolTable(char *path, struct SymbolTable *table);
+void FreeSymbolTable(struct SymbolTable *table);
+
+#endif // SYMBOL_TABLE_H
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include "global.h"
+#include "util.h"
+
+bool ParseNumber(char *s, char **end, int radix, int *intValue)
+{
+	char *localEnd;
+
+	if (end == NULL)
+		end = &localEnd;
+
+	errno = 0;
+
+	const long longValue = strtol(s, end, radix);
+
+	if (*end == s)
+		return false; // not a number
+
+	if ((longValue == LONG_MIN || longValue == LONG_MAX) && errno == ERANGE)
+		return false;
+
+	if (longValue > INT_MAX)
+		return false;
+
+	if (longValue < INT_MIN)
+		return false;
+
+	*intValue = (int)longValue;
+
+	return true;
+}
+
+unsigned char *ReadWholeFile(char *path, int *size)
+{
+	FILE *fp = fopen(path, "rb");
+
+	if (fp == NULL)
+		FATAL_ERROR("Failed to open \"%s\" for reading.\n", path);
+
+	fseek(fp, 0, SEEK_END);
+
+	*size = ftell(fp);
+
+	unsigned char *buffer = malloc(*size);
+
+	if (buffer == NULL)
+		FATAL_ERROR("Failed to allocate memory for reading \"%s\".\n", path);
+
+	rewind(fp);
+
+	if (fread(buffer, *size, 1, fp) != 1)
+		FATAL_ERROR("Failed to read \"%s\".\n", path);
+
+	fclose(fp);
+
+	return buffer;
+}
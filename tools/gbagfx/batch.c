@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "global.h"
+#include "batch.h"
+#include "util.h"
+
+struct BatchJob {
+    int argc;
+    char **argv;
+};
+
+struct BatchQueue {
+    struct BatchJob *jobs;
+    int numJobs;
+    int nextJob;
+    pthread_mutex_t mutex;
+    BatchJobFunc func;
+};
+
+static unsigned char *ReadManifest(char *path, int *size)
+{
+    if (strcmp(path, "-") != 0)
+        return ReadWholeFile(path, size);
+
+    int capacity = 0x10000;
+    unsigned char *buffer = malloc(capacity);
+
+    *size = 0;
+
+    for (;;)
+    {
+        if (buffer == NULL)
+            FATAL_ERROR("Failed to allocate memory for reading manifest.\n");
+
+        *size += fread(buffer + *size, 1, capacity - *size, stdin);
+
+        if (*size < capacity)
+            break;
+
+        capacity *= 2;
+        buffer = realloc(buffer, capacity);
+    }
+
+    return buffer;
+}
+
+// Splits the manifest into jobs in place. Every job's argv starts with a
+// placeholder program name so that handlers see the same layout as main().
+static struct BatchJob *ParseManifest(char *text, int size, int *numJobs)
+{
+    int capacity = 256;
+    struct BatchJob *jobs = malloc(sizeof(struct BatchJob) * capacity);
+    int pos = 0;
+
+    *numJobs = 0;
+
+    while (pos < size)
+    {
+        int lineEnd = pos;
+
+        while (lineEnd < size && text[lineEnd] != '\n')
+            lineEnd++;
+
+        text[lineEnd] = 0;
+
+        char *line = &text[pos];
+        int maxArgs = 2 + (lineEnd - pos + 1) / 2;
+        char **argv = malloc(sizeof(char *) * maxArgs);
+        int argc = 0;
+
+        if (argv == NULL)
+            FATAL_ERROR("Failed to allocate memory for manifest job.\n");
+
+        argv[argc++] = "gbagfx";
+
+        while (*line != 0)
+        {
+            while (isspace((unsigned char)*line))
+                *line++ = 0;
+
+            if (*line == 0 || (argc == 1 && *line == '#'))
+                break;
+
+            argv[argc++] = line;
+
+            while (*line != 0 && !isspace((unsigned char)*line))
+                line++;
+        }
+
+        pos = lineEnd + 1;
+
+        if (argc == 1)
+        {
+            free(argv);
+            continue;
+        }
+
+        if (argc < 3)
+            FATAL_ERROR("Manifest job \"%s\" has no output path.\n", argv[1]);
+
+        if (*numJobs == capacity)
+        {
+            capacity *= 2;
+            jobs = realloc(jobs, sizeof(struct BatchJob) * capacity);
+        }
+
+        if (jobs == NULL)
+            FATAL_ERROR("Failed to allocate memory for manifest jobs.\n");
+
+        jobs[*numJobs].argc = argc;
+        jobs[*numJobs].argv = argv;
+        (*numJobs)++;
+    }
+
+    return jobs;
+}
+
+static void *BatchWorker(void *arg)
+{
+    struct BatchQueue *queue = arg;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&queue->mutex);
+        int job = queue->nextJob++;
+        pthread_mutex_unlock(&queue->mutex);
+
+        if (job >= queue->numJobs)
+            return NULL;
+
+        queue->func(queue->jobs[job].argc, queue->jobs[job].argv);
+    }
+}
+
+void RunBatch(char *manifestPath, int numThreads, BatchJobFunc func)
+{
+    int manifestSize;
+    unsigned char *manifest = ReadManifest(manifestPath, &manifestSize);
+
+    // Room for the terminator of a final line that has no newline.
+    manifest = realloc(manifest, manifestSize + 1);
+
+    if (manifest == NULL)
+        FATAL_ERROR("Failed to allocate memory for reading manifest.\n");
+
+    struct BatchQueue queue;
+
+    queue.jobs = ParseManifest((char *)manifest, manifestSize, &queue.numJobs);
+    queue.nextJob = 0;
+    queue.func = func;
+    pthread_mutex_init(&queue.mutex, NULL);
+
+    if (numThreads > queue.numJobs)
+        numThreads = queue.numJobs;
+
+    if (numThreads <= 1)
+    {
+        BatchWorker(&queue);
+    }
+    else
+    {
+        pthread_t *threads = malloc(sizeof(pthread_t) * numThreads);
+
+        if (threads == NULL)
+            FATAL_ERROR("Failed to allocate memory for worker threads.\n");
+
+        for (int i = 0; i < numThreads; i++)
+            if (pthread_create(&threads[i], NULL, BatchWorker, &queue) != 0)
+                FATAL_ERROR("Failed to create worker thread.\n");
+
+        for (int i = 0; i < numThreads; i++)
+            pthread_join(threads[i], NULL);
+
+        free(threads);
+    }
+
+    pthread_mutex_destroy(&queue.mutex);
+
+    for (int i = 0; i < queue.numJobs; i++)
+        free(queue.jobs[i].argv);
+
+    free(queue.jobs);
+    free(manifest);
+}
+
+int GetDefaultThreadCount(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (count > 0)
+        return (int)count;
+#endif
+    return 1;
+}
@@ -0,0 +1,15 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+typedef void (*BatchJobFunc)(int argc, char **argv);
+
+// Runs every job listed in the manifest on a pool of numThreads workers.
+// Each non-empty line of the manifest holds the arguments of one normal
+// gbagfx invocation (INPUT_PATH OUTPUT_PATH [options...]); lines starting
+// with '#' are ignored. Jobs run in no particular order, so no job may read
+// a file that another job in the same manifest writes.
+void RunBatch(char *manifestPath, int numThreads, BatchJobFunc func);
+
+int GetDefaultThreadCount(void);
+
+#endif // BATCH_H
@@ -0,0 +1,367 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "global.h"
+#include "util.h"
+#include "huff.h"
+#include "rl.h"
+#include "codec_test.h"
+
+enum
+{
+    CODEC_RL,
+    CODEC_HUFF4,
+    CODEC_HUFF8,
+    NUM_CODECS
+};
+
+static const char *const sCodecNames[NUM_CODECS] = { "rl", "huff4", "huff8" };
+
+// An 8-bit Huffman tree can only be written if every branch's children are
+// close enough to it, which is always the case for this many values or fewer.
+#define MAX_HUFF8_VALUES 64
+
+#define BENCHMARK_REPEATS 20
+#define MAX_FUZZ_SIZE 0x10000
+
+static uint32_t sRandomState;
+
+static uint32_t Random(void)
+{
+    sRandomState ^= sRandomState << 13;
+    sRandomState ^= sRandomState >> 17;
+    sRandomState ^= sRandomState << 5;
+    return sRandomState;
+}
+
+static int RandomRange(int min, int max)
+{
+    return min + Random() % (max - min + 1);
+}
+
+static unsigned char *Compress(int codec, unsigned char *src, int size, int *compressedSize)
+{
+    if (codec == CODEC_RL)
+        return RLCompress(src, size, compressedSize);
+    else
+        return HuffCompress(src, size, compressedSize, codec == CODEC_HUFF4 ? 4 : 8);
+}
+
+static unsigned char *Decompress(int codec, unsigned char *src, int size, int *uncompressedSize)
+{
+    if (codec == CODEC_RL)
+        return RLDecompress(src, size, uncompressedSize);
+    else
+        return HuffDecompress(src, size, uncompressedSize);
+}
+
+// Whether the codec can compress the data at all. The size has to fit in the
+// header, and the Huffman compressor reads whole words.
+static bool CanCompress(int codec, unsigned char *src, int size)
+{
+    if (size <= 0 || size >= 1 << 24)
+        return false;
+
+    if (codec == CODEC_RL)
+        return true;
+
+    if (size % 4 != 0)
+        return false;
+
+    if (codec == CODEC_HUFF8)
+    {
+        bool seen[256] = { false };
+        int numValues = 0;
+
+        for (int i = 0; i < size; i++)
+        {
+            if (!seen[src[i]])
+            {
+                seen[src[i]] = true;
+                numValues++;
+            }
+        }
+
+        return numValues <= MAX_HUFF8_VALUES;
+    }
+
+    return true;
+}
+
+static void CheckRoundTrip(int codec, unsigned char *data, int size, const char *description)
+{
+    int compressedSize;
+    int uncompressedSize;
+
+    if (!CanCompress(codec, data, size))
+        return;
+
+    unsigned char *compressed = Compress(codec, data, size, &compressedSize);
+    unsigned char *uncompressed = Decompress(codec, compressed, compressedSize, &uncompressedSize);
+
+    if (uncompressedSize != size || memcmp(uncompressed, data, size) != 0)
+        FATAL_ERROR("%s: %s (%d bytes) doesn't decompress back to itself.\n", sCodecNames[codec], description, size);
+
+    free(uncompressed);
+    free(compressed);
+}
+
+static void CheckAllCodecs(unsigned char *data, int size, const char *description)
+{
+    for (int codec = 0; codec < NUM_CODECS; codec++)
+        CheckRoundTrip(codec, data, size, description);
+}
+
+// Stores the pos-th value of the given bit depth, low nybble first, as the
+// Huffman compressor reads them. The data has to start out zeroed.
+static void PutValue(unsigned char *data, int pos, int bitDepth, int value)
+{
+    if (bitDepth == 8)
+        data[pos] = value;
+    else
+        data[pos / 2] |= value << (4 * (pos % 2));
+}
+
+// Fills data with numValues values whose counts follow the Fibonacci
+// sequence, which gives the deepest Huffman tree there is for that many
+// values. Returns the size of the data, which is a whole number of words.
+static int MakeFibonacciData(unsigned char *data, int bitDepth, int numValues)
+{
+    int valuesPerWord = 32 / bitDepth;
+    int count = 1;
+    int prevCount = 1;
+    int pos = 0;
+
+    for (int value = 0; value < numValues; value++)
+    {
+        for (int i = 0; i < count; i++)
+            PutValue(data, pos++, bitDepth, value);
+
+        int nextCount = count + prevCount;
+        prevCount = count;
+        count = nextCount;
+    }
+
+    while (pos % valuesPerWord != 0)
+        PutValue(data, pos++, bitDepth, numValues - 1);
+
+    return pos * bitDepth / 8;
+}
+
+// Inputs at the edges of what each format can express: the smallest sizes,
+// runs and literal stretches around their longest encodable lengths, a single
+// value, and trees as deep as they get.
+static void CheckDegenerateInputs(unsigned char *data)
+{
+    char description[64];
+
+    for (int size = 1; size <= 16; size++)
+    {
+        memset(data, 0, size);
+        CheckAllCodecs(data, size, "zeros");
+
+        for (int i = 0; i < size; i++)
+            data[i] = i * 0x35 + 1;
+        CheckAllCodecs(data, size, "distinct bytes");
+    }
+
+    for (int value = 0; value < 256; value += 0xFF)
+    {
+        for (int size = 124; size <= 140; size++)
+        {
+            memset(data, value, size);
+            snprintf(description, sizeof(description), "a run of 0x%02X", value);
+            CheckAllCodecs(data, size, description);
+        }
+    }
+
+    // A run of each length, then one that is interrupted after each length.
+    for (int length = 1; length <= 300; length++)
+    {
+        memset(data, 0xAA, length);
+        memset(data + length, 0x55, 4);
+        snprintf(description, sizeof(description), "a run of %d", length);
+        CheckAllCodecs(data, length + 4, description);
+
+        for (int i = 0; i < length; i++)
+            data[i] = i & 1 ? 0x12 : 0x34;
+        snprintf(description, sizeof(description), "%d alternating bytes", length);
+        CheckAllCodecs(data, length, description);
+    }
+
+    // Pairs of equal bytes, which are never long enough to be a run.
+    for (int i = 0; i < 1024; i++)
+        data[i] = i / 2;
+    CheckAllCodecs(data, 1024, "pairs of bytes");
+
+    for (int i = 0; i < 4096; i++)
+        data[i] = i;
+    CheckAllCodecs(data, 4096, "every byte value");
+
+    for (int numValues = 2; numValues <= 16; numValues++)
+    {
+        memset(data, 0, MAX_FUZZ_SIZE);
+        snprintf(description, sizeof(description), "a %d-value 4-bit Fibonacci tree", numValues);
+        CheckRoundTrip(CODEC_HUFF4, data, MakeFibonacciData(data, 4, numValues), description);
+    }
+
+    // The largest of these is all that fits in MAX_FUZZ_SIZE.
+    for (int numValues = 2; numValues <= 21; numValues++)
+    {
+        memset(data, 0, MAX_FUZZ_SIZE);
+        snprintf(description, sizeof(description), "a %d-value 8-bit Fibonacci tree", numValues);
+        CheckRoundTrip(CODEC_HUFF8, data, MakeFibonacciData(data, 8, numValues), description);
+    }
+}
+
+// Fills data with one of several kinds of random content, and returns which.
+static const char *MakeRandomData(unsigned char *data, int size)
+{
+    unsigned char alphabet[MAX_HUFF8_VALUES];
+    int alphabetSize = RandomRange(1, MAX_HUFF8_VALUES);
+
+    for (int i = 0; i < alphabetSize; i++)
+        alphabet[i] = Random();
+
+    switch (Random() % 4)
+    {
+    case 0:
+        for (int i = 0; i < size; i++)
+            data[i] = Random();
+        return "random bytes";
+    case 1:
+        for (int i = 0; i < size; i++)
+            data[i] = alphabet[Random() % alphabetSize];
+        return "random bytes from a small set";
+    case 2:
+        for (int i = 0; i < size; )
+        {
+            int length = RandomRange(1, 200);
+            unsigned char value = alphabet[Random() % alphabetSize];
+
+            for (; length > 0 && i < size; length--)
+                data[i++] = value;
+        }
+        return "random runs";
+    default:
+        // Each value is half as likely as the one before, which makes for
+        // long codes.
+        for (int i = 0; i < size; i++)
+        {
+            uint32_t bits = Random() | 0x80000000;
+            data[i] = alphabet[__builtin_ctz(bits) % alphabetSize];
+        }
+        return "skewed random bytes";
+    }
+}
+
+void RunCodecFuzz(int numCases, unsigned int seed)
+{
+    unsigned char *data = malloc(MAX_FUZZ_SIZE);
+    char description[96];
+
+    if (data == NULL)
+        FATAL_ERROR("Failed to allocate memory for fuzzing.\n");
+
+    CheckDegenerateInputs(data);
+
+    sRandomState = seed * 2654435761u + 1;
+    if (sRandomState == 0)
+        sRandomState = 1;
+
+    for (int i = 0; i < numCases; i++)
+    {
+        int maxSize = i % 16 == 0 ? MAX_FUZZ_SIZE : i % 4 == 0 ? 4096 : 64;
+        int size = RandomRange(1, maxSize);
+        const char *kind = MakeRandomData(data, size);
+
+        snprintf(description, sizeof(description), "case %d of seed %u, %s", i, seed, kind);
+        CheckRoundTrip(CODEC_RL, data, size, description);
+        CheckRoundTrip(CODEC_HUFF4, data, size & ~3, description);
+        CheckRoundTrip(CODEC_HUFF8, data, size & ~3, description);
+    }
+
+    free(data);
+
+    printf("All codecs passed %d cases with seed %u.\n", numCases, seed);
+}
+
+void RunCodecBenchmark(int numFiles, char **paths)
+{
+    double compressSeconds[NUM_CODECS] = { 0 };
+    double decompressSeconds[NUM_CODECS] = { 0 };
+    long inputBytes[NUM_CODECS] = { 0 };
+    long outputBytes[NUM_CODECS] = { 0 };
+    long totalBytes = 0;
+
+    for (int f = 0; f < numFiles; f++)
+    {
+        int size;
+        unsigned char *data = ReadWholeFile(paths[f], &size);
+
+        totalBytes += size;
+
+        for (int codec = 0; codec < NUM_CODECS; codec++)
+        {
+            int compressedSize;
+            int uncompressedSize;
+            unsigned char *compressed = NULL;
+            unsigned char *uncompressed = NULL;
+
+            if (!CanCompress(codec, data, size))
+                continue;
+
+            clock_t start = clock();
+
+            for (int r = 0; r < BENCHMARK_REPEATS; r++)
+            {
+                free(compressed);
+                compressed = Compress(codec, data, size, &compressedSize);
+            }
+
+            compressSeconds[codec] += (double)(clock() - start) / CLOCKS_PER_SEC / BENCHMARK_REPEATS;
+            start = clock();
+
+            for (int r = 0; r < BENCHMARK_REPEATS; r++)
+            {
+                free(uncompressed);
+                uncompressed = Decompress(codec, compressed, compressedSize, &uncompressedSize);
+            }
+
+            decompressSeconds[codec] += (double)(clock() - start) / CLOCKS_PER_SEC / BENCHMARK_REPEATS;
+
+            if (uncompressedSize != size || memcmp(uncompressed, data, size) != 0)
+                FATAL_ERROR("%s: \"%s\" doesn't decompress back to itself.\n", sCodecNames[codec], paths[f]);
+
+            inputBytes[codec] += size;
+            outputBytes[codec] += compressedSize;
+
+            free(uncompressed);
+            free(compressed);
+        }
+
+        free(data);
+    }
+
+    printf("%d files, %ld bytes\n", numFiles, totalBytes);
+
+    for (int codec = 0; codec < NUM_CODECS; codec++)
+    {
+        if (inputBytes[codec] == 0)
+        {
+            printf("%-6s no files it can compress\n", sCodecNames[codec]);
+            continue;
+        }
+
+        printf("%-6s compress %8.3f ms %8.1f MB/s  decompress %8.3f ms %8.1f MB/s  ratio %.3f\n",
+               sCodecNames[codec],
+               compressSeconds[codec] * 1000,
+               compressSeconds[codec] > 0 ? inputBytes[codec] / compressSeconds[codec] / 1e6 : 0.0,
+               decompressSeconds[codec] * 1000,
+               decompressSeconds[codec] > 0 ? inputBytes[codec] / decompressSeconds[codec] / 1e6 : 0.0,
+               (double)outputBytes[codec] / inputBytes[codec]);
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef CODEC_TEST_H
+#define CODEC_TEST_H
+
+// Times the Huffman and RL codecs over the given files, checking that each
+// file decompresses back to itself.
+void RunCodecBenchmark(int numFiles, char **paths);
+
+// Checks that the Huffman and RL codecs give back exactly what they were
+// given, first for a fixed set of awkward inputs and then for numCases
+// random ones generated from seed. Exits with an error on the first mismatch.
+void RunCodecFuzz(int numCases, unsigned int seed);
+
+#endif // CODEC_TEST_H
@@ -1,11 +1,14 @@
 // Copyright (c) 2015 YamaArashi
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <setjmp.h>
 #include <png.h>
 #include "global.h"
 #include "convert_png.h"
 #include "gfx.h"
+#include "util.h"
 
 static FILE *PngReadOpen(char *path, png_structp *pngStruct, png_infop *pngInfo)
 {
@@ -45,13 +48,11 @@ static FILE *PngReadOpen(char *path, png_structp *pngStruct, png_infop *pngInfo)
     return fp;
 }
 
-static unsigned char *ConvertBitDepth(unsigned char *src, int srcBitDepth, int destBitDepth, int numPixels)
+// dest must be zeroed.
+static void ConvertBitDepthInto(unsigned char *src, unsigned char *dest, int srcBitDepth, int destBitDepth, int numPixels)
 {
     // Round the number of bits up to the next 8 and divide by 8 to get the number of bytes.
     int srcSize = ((numPixels * srcBitDepth + 7) & ~7) / 8;
-    int destSize = ((numPixels * destBitDepth + 7) & ~7) / 8;
-    unsigned char *output = calloc(destSize, 1);
-    unsigned char *dest = output;
     int i;
     int j;
     int destBit = 8 - destBitDepth;
@@ -75,19 +76,20 @@ static unsigned char *ConvertBitDepth(unsigned char *src, int srcBitDepth, int d
             }
         }
     }
-
-    return output;
 }
 
-void ReadPng(char *path, struct Image *image)
+static unsigned char *ConvertBitDepth(unsigned char *src, int srcBitDepth, int destBitDepth, int numPixels)
 {
-    png_structp png_ptr;
-    png_infop info_ptr;
+    int destSize = ((numPixels * destBitDepth + 7) & ~7) / 8;
+    unsigned char *output = calloc(destSize, 1);
 
-    FILE *fp = PngReadOpen(path, &png_ptr, &info_ptr);
+    ConvertBitDepthInto(src, output, srcBitDepth, destBitDepth, numPixels);
 
-    int bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+    return output;
+}
 
+static void ReadPngHeader(char *path, png_structp png_ptr, png_infop info_ptr, struct Image *image)
+{
     int color_type = png_get_color_type(png_ptr, info_ptr);
 
     if (color_type != PNG_COLOR_TYPE_GRAY && color_type != PNG_COLOR_TYPE_PALETTE)
@@ -99,6 +101,18 @@ void ReadPng(char *path, struct Image *image)
 
     image->width = png_get_image_width(png_ptr, info_ptr);
     image->height = png_get_image_height(png_ptr, info_ptr);
+}
+
+void ReadPng(char *path, struct Image *image)
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+
+    FILE *fp = PngReadOpen(path, &png_ptr, &info_ptr);
+
+    int bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+
+    ReadPngHeader(path, png_ptr, info_ptr, image);
 
     int rowbytes = png_get_rowbytes(png_ptr, info_ptr);
 
@@ -185,7 +199,7 @@ void SetPngPalette(png_structp png_ptr, png_infop info_ptr, struct Palette *pale
     free(colors);
 }
 
-void WritePng(char *path, struct Image *image)
+static FILE *PngWriteOpen(char *path, struct Image *image, png_structp *pngStruct, png_infop *pngInfo)
 {
     FILE *fp = fopen(path, "wb");
 
@@ -227,6 +241,19 @@ void WritePng(char *path, struct Image *image)
 
     png_write_info(png_ptr, info_ptr);
 
+    *pngStruct = png_ptr;
+    *pngInfo = info_ptr;
+
+    return fp;
+}
+
+void WritePng(char *path, struct Image *image)
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+
+    FILE *fp = PngWriteOpen(path, image, &png_ptr, &info_ptr);
+
     png_bytepp row_pointers = malloc(image->height * sizeof(png_bytep));
 
     if (row_pointers == NULL)
@@ -252,3 +279,155 @@ void WritePng(char *path, struct Image *image)
     png_destroy_write_struct(&png_ptr, &info_ptr);
     free(row_pointers);
 }
+
+static void ReadPngRow(char *path, png_structp png_ptr, unsigned char *row)
+{
+    if (setjmp(png_jmpbuf(png_ptr)))
+        FATAL_ERROR("Error reading from \"%s\".\n", path);
+
+    png_read_row(png_ptr, row, NULL);
+}
+
+static void WritePngRow(char *path, png_structp png_ptr, unsigned char *row)
+{
+    if (setjmp(png_jmpbuf(png_ptr)))
+        FATAL_ERROR("Error writing \"%s\".\n", path);
+
+    png_write_row(png_ptr, row);
+}
+
+static void WritePngEnd(char *path, png_structp png_ptr)
+{
+    if (setjmp(png_jmpbuf(png_ptr)))
+        FATAL_ERROR("Error ending write of \"%s\".\n", path);
+
+    png_write_end(png_ptr, NULL);
+}
+
+// Converts a PNG to a .1bpp, .4bpp or .8bpp file. The rows are read one band
+// of metatile rows at a time and made into tiles straight away, so only that
+// band is ever held as pixels, rather than the whole image.
+void ConvertPngToTiles(char *inputPath, char *outputPath, int numTiles, int bitDepth, int metatileWidth, int metatileHeight)
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+    struct Image image;
+
+    FILE *fp = PngReadOpen(inputPath, &png_ptr, &info_ptr);
+
+    ReadPngHeader(inputPath, png_ptr, info_ptr, &image);
+
+    int pngBitDepth = png_get_bit_depth(png_ptr, info_ptr);
+    bool invertColors = !image.hasPalette;
+
+    // The rows of an interlaced image are only complete after the last pass,
+    // so it has to be read whole.
+    if (png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE)
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        fclose(fp);
+
+        image.bitDepth = bitDepth;
+        image.tilemap.data.affine = NULL;
+        ReadPng(inputPath, &image);
+        WriteImage(outputPath, numTiles, bitDepth, metatileWidth, metatileHeight, &image, invertColors);
+        FreeImage(&image);
+        return;
+    }
+
+    if (pngBitDepth != bitDepth && pngBitDepth != 1 && pngBitDepth != 2 && pngBitDepth != 4 && pngBitDepth != 8)
+        FATAL_ERROR("Bit depth of image must be 1, 2, 4, or 8.\n");
+
+    numTiles = GetImageTileCount(image.width, image.height, numTiles, metatileWidth, metatileHeight);
+
+    int tileSize = bitDepth * 8;
+    int tilesWidth = image.width / 8;
+    int bandHeight = metatileHeight * 8;
+    int tilesPerBand = tilesWidth * metatileHeight;
+    int rowSize = image.width * bitDepth / 8;
+    unsigned char *pngRow = malloc(png_get_rowbytes(png_ptr, info_ptr));
+    unsigned char *band = malloc(bandHeight * rowSize);
+    unsigned char *tiles = malloc(numTiles * tileSize);
+
+    if (pngRow == NULL || band == NULL || tiles == NULL)
+        FATAL_ERROR("Failed to allocate memory for pixels.\n");
+
+    // Rows past the last tile are still read, so that their colors are checked
+    // like the rest.
+    for (int y = 0, tileNum = 0; y < image.height; y += bandHeight, tileNum += tilesPerBand)
+    {
+        for (int i = 0; i < bandHeight; i++)
+        {
+            unsigned char *row = band + i * rowSize;
+
+            if (pngBitDepth == bitDepth)
+            {
+                ReadPngRow(inputPath, png_ptr, row);
+            }
+            else
+            {
+                ReadPngRow(inputPath, png_ptr, pngRow);
+                memset(row, 0, rowSize);
+                ConvertBitDepthInto(pngRow, row, pngBitDepth, bitDepth, image.width);
+            }
+        }
+
+        if (tileNum < numTiles)
+        {
+            int bandTiles = numTiles - tileNum < tilesPerBand ? numTiles - tileNum : tilesPerBand;
+
+            ConvertToTiles(band, tiles + tileNum * tileSize, bandTiles, bitDepth, tilesWidth / metatileWidth, metatileWidth, metatileHeight, invertColors);
+        }
+    }
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    fclose(fp);
+
+    WriteWholeFile(outputPath, tiles, numTiles * tileSize);
+
+    free(pngRow);
+    free(band);
+    free(tiles);
+}
+
+// Writes tiles from ReadImageTiles to a PNG, turning them into pixels one band
+// of metatile rows at a time.
+void WritePngFromTiles(char *path, unsigned char *tiles, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+
+    FILE *fp = PngWriteOpen(path, image, &png_ptr, &info_ptr);
+
+    int tileSize = image->bitDepth * 8;
+    int tilesWidth = image->width / 8;
+    int bandHeight = metatileHeight * 8;
+    int tilesPerBand = tilesWidth * metatileHeight;
+    int rowSize = png_get_rowbytes(png_ptr, info_ptr);
+    unsigned char *band = malloc(bandHeight * rowSize);
+
+    if (band == NULL)
+        FATAL_ERROR("Failed to allocate memory for pixels.\n");
+
+    for (int y = 0, tileNum = 0; y < image->height; y += bandHeight, tileNum += tilesPerBand)
+    {
+        memset(band, 0, bandHeight * rowSize);
+
+        if (tileNum < numTiles)
+        {
+            int bandTiles = numTiles - tileNum < tilesPerBand ? numTiles - tileNum : tilesPerBand;
+
+            ConvertFromTiles(tiles + tileNum * tileSize, band, bandTiles, image->bitDepth, tilesWidth / metatileWidth, metatileWidth, metatileHeight, invertColors);
+        }
+
+        for (int i = 0; i < bandHeight; i++)
+            WritePngRow(path, png_ptr, band + i * rowSize);
+    }
+
+    WritePngEnd(path, png_ptr);
+
+    fclose(fp);
+
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    free(band);
+}
@@ -8,5 +8,7 @@
 void ReadPng(char *path, struct Image *image);
 void WritePng(char *path, struct Image *image);
 void ReadPngPalette(char *path, struct Palette *palette);
+void ConvertPngToTiles(char *inputPath, char *outputPath, int numTiles, int bitDepth, int metatileWidth, int metatileHeight);
+void WritePngFromTiles(char *path, unsigned char *tiles, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors);
 
 #endif // CONVERT_PNG_H
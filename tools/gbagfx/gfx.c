@@ -345,7 +345,41 @@ static unsigned char *DecodeTilemap(unsigned char *tiles, struct Tilemap *tilema
     return decoded;
 }
 
-void ReadImage(char *path, int tilesWidth, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
+// The pixels may be just a band of whole metatile rows out of a bigger image,
+// which is how the PNG conversions stream an image through a small buffer.
+void ConvertFromTiles(unsigned char *tiles, unsigned char *pixels, int numTiles, int bitDepth, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	switch (bitDepth) {
+	case 1:
+		ConvertFromTiles1Bpp(tiles, pixels, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	case 4:
+		ConvertFromTiles4Bpp(tiles, pixels, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	case 8:
+		ConvertFromTiles8Bpp(tiles, pixels, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	}
+}
+
+void ConvertToTiles(unsigned char *pixels, unsigned char *tiles, int numTiles, int bitDepth, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	switch (bitDepth) {
+	case 1:
+		ConvertToTiles1Bpp(pixels, tiles, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	case 4:
+		ConvertToTiles4Bpp(pixels, tiles, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	case 8:
+		ConvertToTiles8Bpp(pixels, tiles, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	}
+}
+
+// Reads the tiles of an image, decoding its tilemap if it has one, and sets
+// the size and bit depth of the image without converting it to pixels.
+unsigned char *ReadImageTiles(char *path, int tilesWidth, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, int *numTiles_p)
 {
 	int tileSize = bitDepth * 8;
 
@@ -375,40 +409,24 @@ void ReadImage(char *path, int tilesWidth, int bitDepth, int metatileWidth, int
 	image->width = tilesWidth * 8;
 	image->height = tilesHeight * 8;
 	image->bitDepth = bitDepth;
-	image->pixels = calloc(tilesWidth * tilesHeight, tileSize);
-
-	if (image->pixels == NULL)
-		FATAL_ERROR("Failed to allocate memory for pixels.\n");
-
-	int metatilesWide = tilesWidth / metatileWidth;
-
-	switch (bitDepth) {
-	case 1:
-		ConvertFromTiles1Bpp(buffer, image->pixels, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 4:
-		ConvertFromTiles4Bpp(buffer, image->pixels, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 8:
-		ConvertFromTiles8Bpp(buffer, image->pixels, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	}
+	image->pixels = NULL;
 
-	free(buffer);
+	*numTiles_p = numTiles;
+	return buffer;
 }
 
-void WriteImage(char *path, int numTiles, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
+// Checks the size of an image for WriteImage and returns the number of tiles
+// to write.
+int GetImageTileCount(int width, int height, int numTiles, int metatileWidth, int metatileHeight)
 {
-	int tileSize = bitDepth * 8;
-
-	if (image->width % 8 != 0)
-		FATAL_ERROR("The width in pixels (%d) isn't a multiple of 8.\n", image->width);
+	if (width % 8 != 0)
+		FATAL_ERROR("The width in pixels (%d) isn't a multiple of 8.\n", width);
 
-	if (image->height % 8 != 0)
-		FATAL_ERROR("The height in pixels (%d) isn't a multiple of 8.\n", image->height);
+	if (height % 8 != 0)
+		FATAL_ERROR("The height in pixels (%d) isn't a multiple of 8.\n", height);
 
-	int tilesWidth = image->width / 8;
-	int tilesHeight = image->height / 8;
+	int tilesWidth = width / 8;
+	int tilesHeight = height / 8;
 
 	if (tilesWidth % metatileWidth != 0)
 		FATAL_ERROR("The width in tiles (%d) isn't a multiple of the specified metatile width (%d)", tilesWidth, metatileWidth);
@@ -423,31 +441,201 @@ void WriteImage(char *path, int numTiles, int bitDepth, int metatileWidth, int m
 	else if (numTiles > maxNumTiles)
 		FATAL_ERROR("The specified number of tiles (%d) is greater than the maximum possible value (%d).\n", numTiles, maxNumTiles);
 
+	return numTiles;
+}
+
+void WriteImage(char *path, int numTiles, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
+{
+	int tileSize = bitDepth * 8;
+
+	numTiles = GetImageTileCount(image->width, image->height, numTiles, metatileWidth, metatileHeight);
+
 	int bufferSize = numTiles * tileSize;
 	unsigned char *buffer = malloc(bufferSize);
 
 	if (buffer == NULL)
 		FATAL_ERROR("Failed to allocate memory for pixels.\n");
 
-	int metatilesWide = tilesWidth / metatileWidth;
+	int metatilesWide = image->width / 8 / metatileWidth;
 
-	switch (bitDepth) {
-	case 1:
-		ConvertToTiles1Bpp(image->pixels, buffer, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 4:
-		ConvertToTiles4Bpp(image->pixels, buffer, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 8:
-		ConvertToTiles8Bpp(image->pixels, buffer, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	}
+	ConvertToTiles(image->pixels, buffer, numTiles, bitDepth, metatilesWide, metatileWidth, metatileHeight, invertColors);
 
 	WriteWholeFile(path, buffer, bufferSize);
 
 	free(buffer);
 }
 
+// One variant of a tile in the tileset: the tile itself or one of its flips.
+// The variant number is the tile's index in the tileset times 4, plus 1 if
+// it is flipped horizontally and 2 if it is flipped vertically.
+struct TileVariantSlot {
+	uint64_t hash;
+	int variant;
+};
+
+static uint64_t HashTile(unsigned char *tile)
+{
+	uint64_t hash = 0xCBF29CE484222325ULL;
+
+	for (int i = 0; i < 64; i++) {
+		hash ^= tile[i];
+		hash *= 0x100000001B3ULL;
+	}
+
+	return hash;
+}
+
+// Returns the slot that holds the given tile, or the empty slot where it
+// belongs if no variant in the table matches it.
+static struct TileVariantSlot *FindTileVariant(struct TileVariantSlot *table, int tableMask, unsigned char *variants, unsigned char *tile, uint64_t hash)
+{
+	for (int i = hash & tableMask; ; i = (i + 1) & tableMask) {
+		struct TileVariantSlot *slot = &table[i];
+
+		if (slot->variant < 0)
+			return slot;
+
+		if (slot->hash == hash && memcmp(&variants[slot->variant * 64], tile, 64) == 0)
+			return slot;
+	}
+}
+
+// Writes the distinct tiles of an 8bpp image (as read by ReadPng with a bit
+// depth of 8) to path, and a tilemap that rebuilds the image from them to
+// tilemapPath. Unless the map is affine, a tile that is a horizontal or
+// vertical flip of an earlier one is stored only once, and the flip is put
+// in its map entry instead. In a 4bpp tileset, each tile may use colors from
+// one 16-color palette of the image, whose number goes in its map entry.
+void WriteTileset(char *path, char *tilemapPath, int bitDepth, bool isAffine, struct Image *image, bool invertColors)
+{
+	if (bitDepth != 4 && bitDepth != 8)
+		FATAL_ERROR("Tilemaps can only be made for 4bpp and 8bpp images.\n");
+
+	if (isAffine && bitDepth != 8)
+		FATAL_ERROR("affine maps are necessarily 8bpp\n");
+
+	int numTiles = GetImageTileCount(image->width, image->height, 0, 1, 1);
+	int tilesWidth = image->width / 8;
+	int maxColor = invertColors ? (1 << bitDepth) - 1 : 255;
+	int numVariants = isAffine ? 1 : 4;
+	int maxUniqueTiles = isAffine ? 256 : 1024;
+	int tableSize = 1;
+
+	while (tableSize < maxUniqueTiles * numVariants * 2)
+		tableSize *= 2;
+
+	unsigned char *variants = malloc(maxUniqueTiles * numVariants * 64);
+	struct TileVariantSlot *table = malloc(tableSize * sizeof(struct TileVariantSlot));
+	int mapEntrySize = isAffine ? 1 : 2;
+	unsigned char *tilemap = malloc(numTiles * mapEntrySize);
+
+	if (variants == NULL || table == NULL || tilemap == NULL)
+		FATAL_ERROR("Failed to allocate memory for tileset.\n");
+
+	for (int i = 0; i < tableSize; i++)
+		table[i].variant = -1;
+
+	int numUniqueTiles = 0;
+
+	for (int i = 0; i < numTiles; i++) {
+		unsigned char tile[64];
+		int tileX = (i % tilesWidth) * 8;
+		int tileY = (i / tilesWidth) * 8;
+		int palno = 0;
+
+		for (int j = 0; j < 64; j++) {
+			int pixel = image->pixels[(tileY + j / 8) * image->width + tileX + j % 8];
+
+			if (pixel > maxColor)
+				FATAL_ERROR("Image exceeds the maximum color value for a %ibpp image.\n", bitDepth);
+
+			tile[j] = invertColors ? maxColor - pixel : pixel;
+		}
+
+		if (bitDepth == 4) {
+			palno = tile[0] >> 4;
+
+			for (int j = 0; j < 64; j++) {
+				if ((tile[j] >> 4) != palno)
+					FATAL_ERROR("The tile at (%d, %d) uses colors from more than one palette.\n", tileX, tileY);
+
+				tile[j] &= 0xF;
+			}
+		}
+
+		uint64_t hash = HashTile(tile);
+		struct TileVariantSlot *slot = FindTileVariant(table, tableSize - 1, variants, tile, hash);
+
+		if (slot->variant < 0) {
+			if (numUniqueTiles == maxUniqueTiles)
+				FATAL_ERROR("The image has more than %d distinct tiles.\n", maxUniqueTiles);
+
+			int firstVariant = numUniqueTiles * numVariants;
+
+			numUniqueTiles++;
+
+			for (int v = 0; v < numVariants; v++) {
+				unsigned char *variant = &variants[(firstVariant + v) * 64];
+
+				memcpy(variant, tile, 64);
+
+				if (v & 1)
+					HflipTile(variant, 8);
+				if (v & 2)
+					VflipTile(variant, 8);
+
+				uint64_t variantHash = HashTile(variant);
+				struct TileVariantSlot *variantSlot = FindTileVariant(table, tableSize - 1, variants, variant, variantHash);
+
+				// A symmetric tile equals some of its own flips, and the
+				// unflipped match is the one to keep.
+				if (variantSlot->variant < 0) {
+					variantSlot->hash = variantHash;
+					variantSlot->variant = firstVariant + v;
+				}
+			}
+
+			slot = FindTileVariant(table, tableSize - 1, variants, tile, hash);
+		}
+
+		if (isAffine) {
+			tilemap[i] = slot->variant;
+		} else {
+			// The flip bits of the variant number are where the map entry
+			// wants them.
+			uint16_t value = (slot->variant / 4) | ((slot->variant & 3) << 10) | (palno << 12);
+
+			tilemap[i * 2] = value & 0xFF;
+			tilemap[i * 2 + 1] = value >> 8;
+		}
+	}
+
+	int tileSize = bitDepth * 8;
+	unsigned char *tiles = malloc(numUniqueTiles * tileSize);
+
+	if (tiles == NULL)
+		FATAL_ERROR("Failed to allocate memory for tileset.\n");
+
+	for (int i = 0; i < numUniqueTiles; i++) {
+		unsigned char *tile = &variants[i * numVariants * 64];
+
+		if (bitDepth == 4) {
+			for (int j = 0; j < 32; j++)
+				tiles[i * 32 + j] = tile[j * 2] | (tile[j * 2 + 1] << 4);
+		} else {
+			memcpy(&tiles[i * 64], tile, 64);
+		}
+	}
+
+	WriteWholeFile(path, tiles, numUniqueTiles * tileSize);
+	WriteWholeFile(tilemapPath, tilemap, numTiles * mapEntrySize);
+
+	free(tiles);
+	free(tilemap);
+	free(table);
+	free(variants);
+}
+
 void FreeImage(struct Image *image)
 {
     if (image->tilemap.data.affine != NULL)
@@ -44,8 +44,12 @@ struct Image {
 	bool isAffine;
 };
 
-void ReadImage(char *path, int tilesWidth, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors);
+void ConvertFromTiles(unsigned char *tiles, unsigned char *pixels, int numTiles, int bitDepth, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors);
+void ConvertToTiles(unsigned char *pixels, unsigned char *tiles, int numTiles, int bitDepth, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors);
+unsigned char *ReadImageTiles(char *path, int tilesWidth, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, int *numTiles_p);
+int GetImageTileCount(int width, int height, int numTiles, int metatileWidth, int metatileHeight);
 void WriteImage(char *path, int numTiles, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors);
+void WriteTileset(char *path, char *tilemapPath, int bitDepth, bool isAffine, struct Image *image, bool invertColors);
 void FreeImage(struct Image *image);
 void ReadGbaPalette(char *path, struct Palette *palette);
 void WriteGbaPalette(char *path, struct Palette *palette);
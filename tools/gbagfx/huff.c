@@ -6,91 +6,16 @@
 #include "global.h"
 #include "huff.h"
 
-static int cmp_tree(const void * a0, const void * b0) {
-    return ((struct HuffData *)a0)->value - ((struct HuffData *)b0)->value;
-}
-
-typedef int (*cmpfun)(const void *, const void *);
-
-int msort_r(void * data, size_t count, size_t size, cmpfun cmp, void * buffer) {
-    /*
-     * Out-of-place mergesort (stable sort)
-     * Returns 1 on success, 0 on failure
-     */
-    void * leftPtr;
-    void * rightPtr;
-    void * leftEnd;
-    void * rightEnd;
-    int i;
-
-    switch (count) {
-    case 0:
-        // Should never be here
-        return 0;
-
-    case 1:
-        // Nothing to do here
-        break;
-
-    case 2:
-        // Swap the two entries if the right one compares higher.
-        if (cmp(data, data + size) > 0) {
-            memcpy(buffer, data, size);
-            memcpy(data, data + size, size);
-            memcpy(data + size, buffer, size);
-        }
-        break;
-    default:
-        // Merge sort out-of-place.
-        leftPtr = data;
-        leftEnd = rightPtr = data + count / 2 * size;
-        rightEnd = data + count * size;
-
-        // Sort the left half
-        if (!msort_r(leftPtr, count / 2, size, cmp, buffer))
-            return 0;
-
-        // Sort the right half
-        if (!msort_r(rightPtr, count / 2 + (count & 1), size, cmp, buffer))
-            return 0;
-
-        // Merge the sorted halves out of place
-        i = 0;
-        do {
-            if (cmp(leftPtr, rightPtr) <= 0) {
-                memcpy(buffer + i * size, leftPtr, size);
-                leftPtr += size;
-            } else {
-                memcpy(buffer + i * size, rightPtr, size);
-                rightPtr += size;
-            }
+// Orders leaves by frequency, and leaves of equal frequency by value, which
+// is the order that a stable sort of the frequency table puts them in.
+static int cmp_leaves(const void * a0, const void * b0) {
+    const HuffNode_t * a = a0;
+    const HuffNode_t * b = b0;
 
-        } while (++i < count && leftPtr < leftEnd && rightPtr < rightEnd);
-
-        // Copy the remainder
-        if (i < count) {
-            if (leftPtr < leftEnd) {
-                memcpy(buffer + i * size, leftPtr, leftEnd - leftPtr);
-            }
-            else {
-                memcpy(buffer + i * size, rightPtr, rightEnd - rightPtr);
-            }
-        }
-
-        // Copy the merged data back
-        memcpy(data, buffer, count * size);
-        break;
-    }
-
-    return 1;
-}
+    if (a->header.value != b->header.value)
+        return a->header.value < b->header.value ? -1 : 1;
 
-int msort(void * data, size_t count, size_t size, cmpfun cmp) {
-    void * buffer = malloc(count * size);
-    if (buffer == NULL) return 0;
-    int result = msort_r(data, count, size, cmp, buffer);
-    free(buffer);
-    return result;
+    return a->leaf.key - b->leaf.key;
 }
 
 static void write_tree(unsigned char * dest, HuffNode_t * tree, int nitems, struct BitEncoding * encoding) {
@@ -99,57 +24,50 @@ static void write_tree(unsigned char * dest, HuffNode_t * tree, int nitems, stru
      * breadth-first manner.  We attempt to emulate that here.
      */
 
-    int i, j, k;
+    int i, head;
 
-    // There are (2 * nitems - 1) nodes in the binary tree.  Allocate that.
+    // There are (2 * nitems - 1) nodes in the binary tree.  Allocate that,
+    // along with the path to each node and its depth.
     HuffNode_t * traversal = calloc(2 * nitems - 1, sizeof(HuffNode_t));
-    if (traversal == NULL)
+    uint64_t * paths = calloc(2 * nitems - 1, sizeof(uint64_t));
+    int * depths = calloc(2 * nitems - 1, sizeof(int));
+    if (traversal == NULL || paths == NULL || depths == NULL)
         FATAL_ERROR("Fatal error while compressing Huff file.\n");
 
     // The first node is the root of the tree.
     traversal[0] = *tree;
     i = 1;
 
-    // Copy the tree into a breadth-first ordering using brute force.
-    for (int depth = 1; i < 2 * nitems - 1; depth++) {
-        // Consider every possible path up to the current depth.
-        for (j = 0; i < 2 * nitems - 1 && j < 1 << depth; j++) {
-            // The index of the path is used to encode the path itself.
-            // Start from the most significant relevant bit and work our way down.
-            // Keep track of the current and previous nodes.
-            HuffNode_t * currNode = traversal;
-            HuffNode_t * parent = NULL;
-            for (k = 0; k < depth; k++) {
-                if (currNode->header.isLeaf)
-                    break;
-                parent = currNode;
-                if ((j >> (depth - k - 1)) & 1)
-                    currNode = currNode->branch.right;
-                else
-                    currNode = currNode->branch.left;
-            }
-            // Check that the length of the current path equals the current depth.
-            if (k == depth) {
-                // Make sure we can encode the current branch.
-                // Bail here if we cannot.
-                // This is only applicable for 8-bit encodings.
-                if (traversal + i - parent > 128)
-                    FATAL_ERROR("Fatal error while compressing Huff file: unable to encode binary tree.\n");
-                // Copy the current node, and update its parent.
-                traversal[i] = *currNode;
-                if (parent != NULL) {
-                    if ((j & 1) == 1)
-                        parent->branch.right = traversal + i;
-                    else
-                        parent->branch.left = traversal + i;
-                }
-                // Encode the path through the tree in the lookup table
-                if (traversal[i].header.isLeaf) {
-                    encoding[traversal[i].leaf.key].nbits = depth;
-                    encoding[traversal[i].leaf.key].bitstring = j;
-                }
-                i++;
+    // Copy the tree into a breadth-first ordering, which visits each depth
+    // from left to right.  The path to a node is encoded with its left
+    // branches as 0 bits and its right branches as 1 bits.
+    for (head = 0; head < i; head++) {
+        HuffNode_t * currNode = traversal + head;
+
+        if (currNode->header.isLeaf) {
+            // Encode the path through the tree in the lookup table
+            encoding[currNode->leaf.key].nbits = depths[head];
+            encoding[currNode->leaf.key].bitstring = paths[head];
+            continue;
+        }
+
+        for (int right = 0; right < 2; right++) {
+            // Make sure we can encode the current branch.
+            // Bail here if we cannot.
+            // This is only applicable for 8-bit encodings.
+            if (traversal + i - currNode > 128)
+                FATAL_ERROR("Fatal error while compressing Huff file: unable to encode binary tree.\n");
+            // Copy the child node, and update its parent.
+            if (right) {
+                traversal[i] = *currNode->branch.right;
+                currNode->branch.right = traversal + i;
+            } else {
+                traversal[i] = *currNode->branch.left;
+                currNode->branch.left = traversal + i;
             }
+            paths[i] = (paths[head] << 1) | right;
+            depths[i] = depths[head] + 1;
+            i++;
         }
     }
 
@@ -171,6 +89,8 @@ static void write_tree(unsigned char * dest, HuffNode_t * tree, int nitems, stru
         }
     }
 
+    free(depths);
+    free(paths);
     free(traversal);
 }
 
@@ -262,12 +182,15 @@ unsigned char * HuffCompress(unsigned char * src, int srcSize, int * compressedS
 #endif // DEBUG
 
     // Sort the frequency table.
-    if (!msort(freqs, nitems, sizeof(HuffNode_t), cmp_tree))
-        goto fail;
+    qsort(freqs, nitems, sizeof(HuffNode_t), cmp_leaves);
 
     // Prune zero-frequency values.
     for (int i = 0; i < nitems; i++) {
         if (freqs[i].header.value != 0) {
+            // The root of the tree has to be a branch, so if there is only
+            // one value, keep an unused one to go with it.
+            if (i == nitems - 1)
+                i--;
             if (i > 0) {
                 for (int j = i; j < nitems; j++) {
                     freqs[j - i] = freqs[j];
@@ -286,8 +209,6 @@ unsigned char * HuffCompress(unsigned char * src, int srcSize, int * compressedS
         goto fail;
 
     // Iteratively collapse the two least frequent nodes.
-    HuffNode_t * endptr = freqs + nitems - 2;
-
     for (int i = 0; i < nitems - 1; i++) {
         HuffNode_t * left = freqs;
         HuffNode_t * right = freqs + 1;
@@ -295,13 +216,21 @@ unsigned char * HuffCompress(unsigned char * src, int srcSize, int * compressedS
         tree[i * 2 + 1] = *left;
         for (int j = 0; j < nitems - i - 2; j++)
             freqs[j] = freqs[j + 2];
-        endptr->header.isLeaf = 0;
-        endptr->header.value = tree[i * 2].header.value + tree[i * 2 + 1].header.value;
-        endptr->branch.left = tree + i * 2;
-        endptr->branch.right = tree + i * 2 + 1;
-        endptr--;
-        if (i < nitems - 2 && !msort(freqs, nitems - i - 1, sizeof(HuffNode_t), cmp_tree))
-            goto fail;
+
+        HuffNode_t merged;
+        merged.header.isLeaf = 0;
+        merged.header.value = tree[i * 2].header.value + tree[i * 2 + 1].header.value;
+        merged.branch.left = tree + i * 2;
+        merged.branch.right = tree + i * 2 + 1;
+
+        // The rest of the table is still sorted, so the new node just goes
+        // after every node that is not more frequent.
+        int pos = nitems - i - 2;
+        while (pos > 0 && freqs[pos - 1].header.value > merged.header.value) {
+            freqs[pos] = freqs[pos - 1];
+            pos--;
+        }
+        freqs[pos] = merged;
     }
 
     // Write the tree breadth-first, and create the path lookup table.
@@ -324,7 +253,10 @@ unsigned char * HuffCompress(unsigned char * src, int srcSize, int * compressedS
         }
     }
 
+    // The decoder reads each word from its most significant bit, so the bits
+    // of the last word have to be moved up to there.
     if (destBitPos != 0) {
+        destBuf <<= 32 - destBitPos;
         write_32_le(dest, &destPos, &destBuf, &destBitPos);
     }
 
@@ -342,8 +274,55 @@ fail:
     FATAL_ERROR("Fatal error while compressing Huff file.\n");
 }
 
+// Number of bits that the decoder looks up at once.
+#define HUFF_LOOKUP_BITS 10
+
+struct HuffLookup {
+    unsigned short value; // the decoded value, or the tree node to go on from
+    unsigned char nbits;
+    bool isLeaf;
+};
+
+// Fills the part of the lookup table under the tree node at treePos, whose
+// path from the root is the depth bits of prefix.
+static bool fill_lookup(struct HuffLookup * lookup, unsigned char * src, int srcSize, int treePos, int prefix, int depth) {
+    unsigned char treeView = src[treePos];
+
+    for (int curBit = 0; curBit < 2; curBit++) {
+        bool isLeaf = ((treeView << curBit) & 0x80) != 0;
+        int childPos = (treePos & ~1) + ((treeView & 0x3F) + 1) * 2 + curBit;
+        int childPrefix = (prefix << 1) | curBit;
+
+        if (childPos >= srcSize)
+            return false;
+
+        if (isLeaf) {
+            // Every entry that starts with the leaf's path decodes to it.
+            int shift = HUFF_LOOKUP_BITS - depth - 1;
+            for (int i = 0; i < 1 << shift; i++) {
+                struct HuffLookup * entry = &lookup[(childPrefix << shift) | i];
+                entry->value = src[childPos];
+                entry->nbits = depth + 1;
+                entry->isLeaf = true;
+            }
+        } else if (depth + 1 == HUFF_LOOKUP_BITS) {
+            struct HuffLookup * entry = &lookup[childPrefix];
+            entry->value = childPos;
+            entry->nbits = HUFF_LOOKUP_BITS;
+            entry->isLeaf = false;
+        } else if (!fill_lookup(lookup, src, srcSize, childPos, childPrefix, depth + 1)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Codes are looked up HUFF_LOOKUP_BITS bits at a time, and only codes longer
+// than that walk the rest of the way down the tree one bit at a time. The
+// bits come from the most significant end of each 32-bit word, as on the GBA.
 unsigned char * HuffDecompress(unsigned char * src, int srcSize, int * uncompressedSize_p) {
-    if (srcSize < 4)
+    if (srcSize < 5)
         goto fail;
 
     int bitDepth = *src & 15;
@@ -352,44 +331,100 @@ unsigned char * HuffDecompress(unsigned char * src, int srcSize, int * uncompres
 
     int destSize = (src[3] << 16) | (src[2] << 8) | src[1];
 
+    // The data is written a word at a time.
+    if (destSize == 0 || destSize % 4 != 0)
+        goto fail;
+
     unsigned char *dest = malloc(destSize);
 
     if (dest == NULL)
         goto fail;
 
-    int treePos = 5;
+    struct HuffLookup lookup[1 << HUFF_LOOKUP_BITS];
+
+    if (!fill_lookup(lookup, src, srcSize, 5, 0, 0))
+        goto fail;
+
     int treeSize = (src[4] + 1) * 2;
     int srcPos = 4 + treeSize;
+    // A partial last word reads as if it was padded with zeros.
+    int64_t bitsLeft = srcPos < srcSize ? (int64_t)((srcSize - srcPos + 3) / 4) * 32 : 0;
+    uint64_t window = 0;
+    int windowBits = 0;
     int destPos = 0;
     int curValPos = 0;
-    uint32_t destTmp = 0;
-    uint32_t window;
 
     for (;;)
     {
-        if (srcPos >= srcSize)
-            goto fail;
-        read_32_le(src, &srcPos, &window);
-        for (int i = 0; i < 32; i++) {
-            int curBit = (window >> 31) & 1;
-            unsigned char treeView = src[treePos];
-            bool isLeaf = ((treeView << curBit) & 0x80) != 0;
-            treePos &= ~1; // align
-            treePos += ((treeView & 0x3F) + 1) * 2 + curBit;
-            if (isLeaf) {
-                destTmp >>= bitDepth;
-                destTmp |= (src[treePos] << (32 - bitDepth));
-                curValPos++;
-                if (curValPos == 32 / bitDepth) {
-                    write_32_le(dest, &destPos, &destTmp, &curValPos);
-                    if (destPos == destSize) {
-                        *uncompressedSize_p = destSize;
-                        return dest;
+        // Keep at least 32 bits in the window.
+        if (windowBits <= 32) {
+            uint32_t word = 0;
+            for (int i = 0; i < 4; i++) {
+                if (srcPos + i < srcSize)
+                    word |= src[srcPos + i] << (8 * i);
+            }
+            srcPos += 4;
+            window |= (uint64_t)word << (32 - windowBits);
+            windowBits += 32;
+        }
+
+        struct HuffLookup entry = lookup[window >> (64 - HUFF_LOOKUP_BITS)];
+        int value = entry.value;
+
+        window <<= entry.nbits;
+        windowBits -= entry.nbits;
+        bitsLeft -= entry.nbits;
+
+        if (!entry.isLeaf) {
+            int treePos = value;
+
+            for (;;) {
+                if (windowBits == 0) {
+                    uint32_t word = 0;
+                    for (int i = 0; i < 4; i++) {
+                        if (srcPos + i < srcSize)
+                            word |= src[srcPos + i] << (8 * i);
                     }
+                    srcPos += 4;
+                    window = (uint64_t)word << 32;
+                    windowBits = 32;
                 }
-                treePos = 5;
+
+                int curBit = window >> 63;
+                unsigned char treeView = src[treePos];
+                bool isLeaf = ((treeView << curBit) & 0x80) != 0;
+                treePos &= ~1; // align
+                treePos += ((treeView & 0x3F) + 1) * 2 + curBit;
+                window <<= 1;
+                windowBits--;
+                bitsLeft--;
+
+                if (treePos >= srcSize)
+                    goto fail;
+
+                if (isLeaf)
+                    break;
             }
-            window <<= 1;
+
+            value = src[treePos];
+        }
+
+        if (bitsLeft < 0)
+            goto fail;
+
+        if (bitDepth == 8) {
+            dest[destPos++] = value;
+        } else if (curValPos == 0) {
+            dest[destPos] = value & 0xF;
+            curValPos = 1;
+        } else {
+            dest[destPos++] |= value << 4;
+            curValPos = 0;
+        }
+
+        if (destPos == destSize) {
+            *uncompressedSize_p = destSize;
+            return dest;
         }
     }
 
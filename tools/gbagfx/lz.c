@@ -69,7 +69,140 @@ fail:
 	FATAL_ERROR("Fatal error while decompressing LZ file.\n");
 }
 
-unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+#define LZ_MIN_BLOCK_SIZE 3
+#define LZ_MAX_BLOCK_SIZE 18
+#define LZ_MAX_DISTANCE 0x1000
+#define LZ_HASH_BITS 16
+
+// Finds the longest match at each position using hash chains over the
+// first three bytes of every earlier position. Candidates are visited in
+// order of increasing distance, so ties resolve to the nearest block just
+// like an exhaustive search would.
+struct LZMatchFinder {
+	unsigned char *src;
+	int srcSize;
+	int minDistance;
+	int insertPos;
+	int *head;
+	int *prev;
+};
+
+static unsigned int LZHash(unsigned char *src)
+{
+	unsigned int value = (src[0] << 16) | (src[1] << 8) | src[2];
+
+	return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void LZInitMatchFinder(struct LZMatchFinder *finder, unsigned char *src, int srcSize, int minDistance)
+{
+	finder->src = src;
+	finder->srcSize = srcSize;
+	finder->minDistance = minDistance;
+	finder->insertPos = 0;
+	finder->head = malloc(sizeof(int) * (1 << LZ_HASH_BITS));
+	finder->prev = malloc(sizeof(int) * srcSize);
+
+	if (finder->head == NULL || finder->prev == NULL)
+		FATAL_ERROR("Failed to allocate memory for LZ match finder.\n");
+
+	for (int i = 0; i < (1 << LZ_HASH_BITS); i++)
+		finder->head[i] = -1;
+}
+
+static void LZFreeMatchFinder(struct LZMatchFinder *finder)
+{
+	free(finder->head);
+	free(finder->prev);
+}
+
+// Positions must be queried in increasing order.
+static int LZFindMatch(struct LZMatchFinder *finder, int srcPos, int *bestBlockDistance)
+{
+	unsigned char *src = finder->src;
+	int bestBlockSize = 0;
+
+	for (; finder->insertPos < srcPos; finder->insertPos++) {
+		int pos = finder->insertPos;
+
+		if (pos + LZ_MIN_BLOCK_SIZE <= finder->srcSize) {
+			unsigned int hash = LZHash(&src[pos]);
+			finder->prev[pos] = finder->head[hash];
+			finder->head[hash] = pos;
+		}
+	}
+
+	*bestBlockDistance = 0;
+
+	if (srcPos + LZ_MIN_BLOCK_SIZE > finder->srcSize)
+		return 0;
+
+	int maxBlockSize = finder->srcSize - srcPos;
+
+	if (maxBlockSize > LZ_MAX_BLOCK_SIZE)
+		maxBlockSize = LZ_MAX_BLOCK_SIZE;
+
+	for (int blockStart = finder->head[LZHash(&src[srcPos])]; blockStart >= 0; blockStart = finder->prev[blockStart]) {
+		int blockDistance = srcPos - blockStart;
+
+		if (blockDistance > LZ_MAX_DISTANCE)
+			break;
+
+		if (blockDistance < finder->minDistance)
+			continue;
+
+		int blockSize = 0;
+
+		while (blockSize < maxBlockSize && src[blockStart + blockSize] == src[srcPos + blockSize])
+			blockSize++;
+
+		if (blockSize > bestBlockSize) {
+			*bestBlockDistance = blockDistance;
+			bestBlockSize = blockSize;
+
+			if (blockSize == maxBlockSize)
+				break;
+		}
+	}
+
+	return bestBlockSize;
+}
+
+// Chooses between a literal and every usable block length at each position,
+// minimizing the total size of the stream (9 bits per literal, 17 per block).
+static void LZPlanOptimalParse(struct LZMatchFinder *finder, int *blockSizes, int *blockDistances)
+{
+	int srcSize = finder->srcSize;
+	int *cost = malloc(sizeof(int) * (srcSize + 1));
+
+	if (cost == NULL)
+		FATAL_ERROR("Failed to allocate memory for LZ optimal parse.\n");
+
+	for (int srcPos = 0; srcPos < srcSize; srcPos++)
+		blockSizes[srcPos] = LZFindMatch(finder, srcPos, &blockDistances[srcPos]);
+
+	cost[srcSize] = 0;
+
+	for (int srcPos = srcSize - 1; srcPos >= 0; srcPos--) {
+		int longestBlockSize = blockSizes[srcPos];
+		int bestBlockSize = 0;
+
+		cost[srcPos] = 9 + cost[srcPos + 1];
+
+		for (int blockSize = LZ_MIN_BLOCK_SIZE; blockSize <= longestBlockSize; blockSize++) {
+			if (17 + cost[srcPos + blockSize] < cost[srcPos]) {
+				cost[srcPos] = 17 + cost[srcPos + blockSize];
+				bestBlockSize = blockSize;
+			}
+		}
+
+		blockSizes[srcPos] = bestBlockSize;
+	}
+
+	free(cost);
+}
+
+unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance, const bool optimal)
 {
 	if (srcSize <= 0)
 		goto fail;
@@ -90,6 +223,22 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 	dest[2] = (unsigned char)(srcSize >> 8);
 	dest[3] = (unsigned char)(srcSize >> 16);
 
+	struct LZMatchFinder finder;
+	int *plannedBlockSizes = NULL;
+	int *plannedBlockDistances = NULL;
+
+	LZInitMatchFinder(&finder, src, srcSize, minDistance);
+
+	if (optimal) {
+		plannedBlockSizes = malloc(sizeof(int) * srcSize);
+		plannedBlockDistances = malloc(sizeof(int) * srcSize);
+
+		if (plannedBlockSizes == NULL || plannedBlockDistances == NULL)
+			goto fail;
+
+		LZPlanOptimalParse(&finder, plannedBlockSizes, plannedBlockDistances);
+	}
+
 	int srcPos = 0;
 	int destPos = 4;
 
@@ -98,31 +247,17 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 		*flags = 0;
 
 		for (int i = 0; i < 8; i++) {
-			int bestBlockDistance = 0;
-			int bestBlockSize = 0;
-			int blockDistance = minDistance;
+			int bestBlockDistance;
+			int bestBlockSize;
 
-			while (blockDistance <= srcPos && blockDistance <= 0x1000) {
-				int blockStart = srcPos - blockDistance;
-				int blockSize = 0;
-
-				while (blockSize < 18
-				    && srcPos + blockSize < srcSize
-				    && src[blockStart + blockSize] == src[srcPos + blockSize])
-					blockSize++;
-
-				if (blockSize > bestBlockSize) {
-					bestBlockDistance = blockDistance;
-					bestBlockSize = blockSize;
-
-					if (blockSize == 18)
-						break;
-				}
-
-				blockDistance++;
+			if (optimal) {
+				bestBlockSize = plannedBlockSizes[srcPos];
+				bestBlockDistance = plannedBlockDistances[srcPos];
+			} else {
+				bestBlockSize = LZFindMatch(&finder, srcPos, &bestBlockDistance);
 			}
 
-			if (bestBlockSize >= 3) {
+			if (bestBlockSize >= LZ_MIN_BLOCK_SIZE) {
 				*flags |= (0x80 >> i);
 				srcPos += bestBlockSize;
 				bestBlockSize -= 3;
@@ -142,6 +277,10 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 						dest[destPos++] = 0;
 				}
 
+				LZFreeMatchFinder(&finder);
+				free(plannedBlockSizes);
+				free(plannedBlockDistances);
+
 				*compressedSize = destPos;
 				return dest;
 			}
@@ -13,6 +13,9 @@
 #include "rl.h"
 #include "font.h"
 #include "huff.h"
+#include "batch.h"
+#include "build_cache.h"
+#include "codec_test.h"
 
 struct CommandHandler
 {
@@ -59,27 +62,35 @@ void ConvertGbaToPng(char *inputPath, char *outputPath, struct GbaToPngOptions *
         image.tilemap.data.affine = NULL;
     }
 
-    ReadImage(inputPath, options->width, options->bitDepth, options->metatileWidth, options->metatileHeight, &image, !image.hasPalette);
+    int numTiles;
+    unsigned char *tiles = ReadImageTiles(inputPath, options->width, options->bitDepth, options->metatileWidth, options->metatileHeight, &image, &numTiles);
 
     image.hasTransparency = options->hasTransparency;
 
-    WritePng(outputPath, &image);
+    WritePngFromTiles(outputPath, tiles, numTiles, options->metatileWidth, options->metatileHeight, &image, !image.hasPalette);
 
+    free(tiles);
     FreeImage(&image);
 }
 
 void ConvertPngToGba(char *inputPath, char *outputPath, struct PngToGbaOptions *options)
 {
-    struct Image image;
-
-    image.bitDepth = options->bitDepth;
-    image.tilemap.data.affine = NULL; // initialize to NULL to avoid issues in FreeImage
+    if (options->tilemapFilePath != NULL)
+    {
+        struct Image image;
 
-    ReadPng(inputPath, &image);
+        // Read one byte per pixel, so that the palette number of each tile
+        // can be told apart from its colors.
+        image.bitDepth = 8;
+        image.tilemap.data.affine = NULL;
 
-    WriteImage(outputPath, options->numTiles, options->bitDepth, options->metatileWidth, options->metatileHeight, &image, !image.hasPalette);
+        ReadPng(inputPath, &image);
+        WriteTileset(outputPath, options->tilemapFilePath, options->bitDepth, options->isAffineMap, &image, !image.hasPalette);
+        FreeImage(&image);
+        return;
+    }
 
-    FreeImage(&image);
+    ConvertPngToTiles(inputPath, outputPath, options->numTiles, options->bitDepth, options->metatileWidth, options->metatileHeight);
 }
 
 void HandleGbaToPngCommand(char *inputPath, char *outputPath, int argc, char **argv)
@@ -229,12 +240,29 @@ void HandlePngToGbaCommand(char *inputPath, char *outputPath, int argc, char **a
             if (options.metatileHeight < 1)
                 FATAL_ERROR("metatile height must be positive.\n");
         }
+        else if (strcmp(option, "-tilemap") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No tilemap value following \"-tilemap\".\n");
+            i++;
+            options.tilemapFilePath = argv[i];
+        }
+        else if (strcmp(option, "-affine") == 0)
+        {
+            options.isAffineMap = true;
+        }
         else
         {
             FATAL_ERROR("Unrecognized option \"%s\".\n", option);
         }
     }
 
+    if (options.tilemapFilePath != NULL && (options.numTiles != 0 || options.metatileWidth != 1 || options.metatileHeight != 1))
+        FATAL_ERROR("\"-tilemap\" can't be used with \"-num_tiles\", \"-mwidth\" or \"-mheight\".\n");
+
+    if (options.isAffineMap && options.tilemapFilePath == NULL)
+        FATAL_ERROR("\"-affine\" needs \"-tilemap\".\n");
+
     ConvertPngToGba(inputPath, outputPath, &options);
 }
 
@@ -375,6 +403,7 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
 {
     int overflowSize = 0;
     int minDistance = 2; // default, for compatibility with LZ77UnCompVram()
+    bool optimal = false;
 
     for (int i = 3; i < argc; i++)
     {
@@ -406,6 +435,12 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
             if (minDistance < 1)
                 FATAL_ERROR("LZ min search distance must be positive.\n");
         }
+        else if (strcmp(option, "-optimal") == 0)
+        {
+            // Produces smaller output than the original compressor, so it
+            // can't be used for anything that has to match the ROM.
+            optimal = true;
+        }
         else
         {
             FATAL_ERROR("Unrecognized option \"%s\".\n", option);
@@ -422,7 +457,7 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
     unsigned char *buffer = ReadWholeFileZeroPadded(inputPath, &fileSize, overflowSize);
 
     int compressedSize;
-    unsigned char *compressedData = LZCompress(buffer, fileSize + overflowSize, &compressedSize, minDistance);
+    unsigned char *compressedData = LZCompress(buffer, fileSize + overflowSize, &compressedSize, minDistance, optimal);
 
     compressedData[1] = (unsigned char)fileSize;
     compressedData[2] = (unsigned char)(fileSize >> 8);
@@ -535,12 +570,59 @@ void HandleHuffDecompressCommand(char *inputPath, char *outputPath, int argc UNU
     free(uncompressedData);
 }
 
-int main(int argc, char **argv)
+// Identifies the output format of gbagfx in cache keys. Bump this whenever a
+// change to gbagfx changes what it writes for the same input and options, so
+// that outputs cached by older builds aren't used.
+#define GBAGFX_CACHE_VERSION "gbagfx 1"
+
+// The output of a conversion only depends on the input's contents, the
+// extensions and options, and the contents of the files that the options
+// read from: the palette, and the tilemap when converting to PNG.
+void InitCacheKey(struct BuildCacheKey *key, char *inputPath, char *inputFileExtension, char *outputFileExtension, int argc, char **argv)
 {
-    char converted = 0;
+    BuildCacheKeyInit(key, GBAGFX_CACHE_VERSION);
+    BuildCacheKeyAddString(key, inputFileExtension);
+    BuildCacheKeyAddString(key, outputFileExtension);
 
-    if (argc < 3)
-        FATAL_ERROR("Usage: gbagfx INPUT_PATH OUTPUT_PATH [options...]\n");
+    if (!BuildCacheKeyAddFile(key, inputPath))
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", inputPath);
+
+    bool tilemapIsInput = strcmp(outputFileExtension, "png") == 0;
+
+    for (int i = 3; i < argc; i++)
+    {
+        BuildCacheKeyAddString(key, argv[i]);
+
+        if (i + 1 < argc && (strcmp(argv[i], "-palette") == 0 || (tilemapIsInput && strcmp(argv[i], "-tilemap") == 0)))
+        {
+            i++;
+            BuildCacheKeyAddString(key, argv[i]);
+
+            if (!BuildCacheKeyAddFile(key, argv[i]))
+                FATAL_ERROR("Failed to open \"%s\" for reading.\n", argv[i]);
+        }
+    }
+}
+
+// Making a tileset from a PNG also writes its tilemap, and the cache only
+// holds one output per conversion.
+bool WritesTilemap(char *inputFileExtension, int argc, char **argv)
+{
+    if (strcmp(inputFileExtension, "png") != 0)
+        return false;
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-tilemap") == 0)
+            return true;
+    }
+
+    return false;
+}
+
+void ConvertFile(int argc, char **argv)
+{
+    char converted = 0;
 
     struct CommandHandler handlers[] =
     {
@@ -610,7 +692,25 @@ int main(int argc, char **argv)
         if ((handlers[i].inputFileExtension == NULL || strcmp(handlers[i].inputFileExtension, inputFileExtension) == 0)
             && (handlers[i].outputFileExtension == NULL || strcmp(handlers[i].outputFileExtension, outputFileExtension) == 0))
         {
+            struct BuildCacheKey cacheKey;
+            bool useCache = BuildCacheEnabled() && !WritesTilemap(inputFileExtension, argc, argv);
+
+            if (useCache)
+            {
+                InitCacheKey(&cacheKey, inputPath, inputFileExtension, outputFileExtension, argc, argv);
+
+                if (BuildCacheFetch(&cacheKey, outputPath))
+                {
+                    converted = 1;
+                    break;
+                }
+            }
+
             handlers[i].function(inputPath, outputPath, argc, argv);
+
+            if (useCache)
+                BuildCacheStore(&cacheKey, outputPath);
+
             converted = 1;
             break;
         }
@@ -621,6 +721,100 @@ int main(int argc, char **argv)
 
     if (!converted)
         FATAL_ERROR("Don't know how to convert \"%s\" to \"%s\".\n", argv[1], argv[2]);
+}
+
+void HandleBatchCommand(int argc, char **argv)
+{
+    char *manifestPath = argv[2];
+    int numThreads = GetDefaultThreadCount();
+
+    for (int i = 3; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-j") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No thread count following \"-j\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &numThreads))
+                FATAL_ERROR("Failed to parse thread count.\n");
+
+            if (numThreads < 1)
+                FATAL_ERROR("Thread count must be positive.\n");
+        }
+        else
+        {
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+        }
+    }
+
+    RunBatch(manifestPath, numThreads, ConvertFile);
+}
+
+void HandleFuzzCommand(int argc, char **argv)
+{
+    int numCases = 2000;
+    int seed = 1;
+
+    for (int i = 2; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-n") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No case count following \"-n\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &numCases))
+                FATAL_ERROR("Failed to parse case count.\n");
+
+            if (numCases < 0)
+                FATAL_ERROR("Case count must not be negative.\n");
+        }
+        else if (strcmp(option, "-seed") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No seed following \"-seed\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &seed))
+                FATAL_ERROR("Failed to parse seed.\n");
+        }
+        else
+        {
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+        }
+    }
+
+    RunCodecFuzz(numCases, seed);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--fuzz") == 0)
+    {
+        HandleFuzzCommand(argc, argv);
+        return 0;
+    }
+
+    if (argc < 3)
+        FATAL_ERROR("Usage: gbagfx INPUT_PATH OUTPUT_PATH [options...]\n"
+                    "       gbagfx -batch MANIFEST_PATH [-j THREADS]\n"
+                    "       gbagfx --benchmark FILE...\n"
+                    "       gbagfx --fuzz [-n CASES] [-seed SEED]\n");
+
+    if (strcmp(argv[1], "-batch") == 0)
+        HandleBatchCommand(argc, argv);
+    else if (strcmp(argv[1], "--benchmark") == 0)
+        RunCodecBenchmark(argc - 2, &argv[2]);
+    else
+        ConvertFile(argc, argv);
 
     return 0;
 }
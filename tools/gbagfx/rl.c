@@ -2,6 +2,8 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 #include "global.h"
 #include "rl.h"
 
@@ -31,23 +33,23 @@ unsigned char *RLDecompress(unsigned char *src, int srcSize, int *uncompressedSi
         if (compressed)
         {
             int length = (flags & 0x7F) + 3;
-            unsigned char data = src[srcPos++];
 
-            if (destPos + length > destSize)
+            if (destPos + length > destSize || srcPos >= srcSize)
                 goto fail;
 
-            for (int i = 0; i < length; i++)
-                dest[destPos++] = data;
+            memset(&dest[destPos], src[srcPos++], length);
+            destPos += length;
         }
         else
         {
             int length = (flags & 0x7F) + 1;
 
-            if (destPos + length > destSize)
+            if (destPos + length > destSize || srcPos + length > srcSize)
                 goto fail;
 
-            for (int i = 0; i < length; i++)
-                dest[destPos++] = src[srcPos++];
+            memcpy(&dest[destPos], &src[srcPos], length);
+            srcPos += length;
+            destPos += length;
         }
 
         if (destPos == destSize)
@@ -61,6 +63,73 @@ fail:
     FATAL_ERROR("Fatal error while decompressing RL file.\n");
 }
 
+// Reads eight bytes as a little-endian word, which compilers turn into a
+// single load on little-endian hosts.
+static inline uint64_t Read64(unsigned char *p)
+{
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24)
+        | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+// Returns the index of the first zero byte of value, or 8 if it has none.
+// A borrow only moves towards the more significant bytes, so the lowest
+// byte that the subtraction flags is always a real zero byte.
+static inline int FirstZeroByte(uint64_t value)
+{
+    uint64_t zeros = (value - 0x0101010101010101ULL) & ~value & 0x8080808080808080ULL;
+
+    return zeros == 0 ? 8 : __builtin_ctzll(zeros) / 8;
+}
+
+// Returns the first position in [pos, end) where three equal bytes start,
+// or end if there is none. Eight positions are checked at a time, by
+// comparing the bytes at each of them with the two bytes after it.
+static int FindRun(unsigned char *src, int pos, int end, int srcSize)
+{
+    while (pos < end && pos + 10 <= srcSize)
+    {
+        uint64_t a = Read64(&src[pos]);
+        uint64_t b = Read64(&src[pos + 1]);
+        uint64_t c = Read64(&src[pos + 2]);
+        int i = FirstZeroByte((a ^ b) | (a ^ c));
+
+        if (i < 8)
+            return pos + i < end ? pos + i : end;
+
+        pos += 8;
+    }
+
+    for (; pos < end; pos++)
+    {
+        if (pos + 2 < srcSize && src[pos] == src[pos + 1] && src[pos] == src[pos + 2])
+            return pos;
+    }
+
+    return end;
+}
+
+// Returns how many bytes from pos on, up to maxLength, equal src[pos].
+static int GetRunLength(unsigned char *src, int pos, int maxLength)
+{
+    uint64_t pattern = src[pos] * 0x0101010101010101ULL;
+    int length = 0;
+
+    while (length + 8 <= maxLength)
+    {
+        uint64_t diff = Read64(&src[pos + length]) ^ pattern;
+
+        if (diff != 0)
+            return length + __builtin_ctzll(diff) / 8;
+
+        length += 8;
+    }
+
+    while (length < maxLength && src[pos + length] == src[pos])
+        length++;
+
+    return length;
+}
+
 unsigned char *RLCompress(unsigned char *src, int srcSize, int *compressedSize)
 {
     if (srcSize <= 0)
@@ -87,40 +156,26 @@ unsigned char *RLCompress(unsigned char *src, int srcSize, int *compressedSize)
 
     for (;;)
     {
-        bool compress = false;
         int uncompressedStart = srcPos;
-        int uncompressedLength = 0;
+        int uncompressedEnd = srcSize - srcPos < (0x7F + 1) ? srcSize : srcPos + (0x7F + 1);
 
-        while (srcPos < srcSize && uncompressedLength < (0x7F + 1))
-        {
-            compress = (srcPos + 2 < srcSize && src[srcPos] == src[srcPos + 1] && src[srcPos] == src[srcPos + 2]);
+        srcPos = FindRun(src, srcPos, uncompressedEnd, srcSize);
 
-            if (compress)
-                break;
+        bool compress = (srcPos < uncompressedEnd);
+        int uncompressedLength = srcPos - uncompressedStart;
 
-            srcPos++;
-            uncompressedLength++;
-        }
-        
         if (uncompressedLength > 0)
         {
             dest[destPos++] = uncompressedLength - 1;
-
-            for (int i = 0; i < uncompressedLength; i++)
-                dest[destPos++] = src[uncompressedStart + i];
+            memcpy(&dest[destPos], &src[uncompressedStart], uncompressedLength);
+            destPos += uncompressedLength;
         }
 
         if (compress)
         {
             unsigned char data = src[srcPos];
-            int compressedLength = 0;
-
-            while (compressedLength < (0x7F + 3)
-                && srcPos + compressedLength < srcSize
-                && src[srcPos + compressedLength] == data)
-            {
-                compressedLength++;
-            }
+            int maxLength = srcSize - srcPos < (0x7F + 3) ? srcSize - srcPos : (0x7F + 3);
+            int compressedLength = GetRunLength(src, srcPos, maxLength);
 
             dest[destPos++] = 0x80 | (compressedLength - 3);
             dest[destPos++] = data;
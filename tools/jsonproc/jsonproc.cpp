@@ -2,7 +2,10 @@
 
 #include "jsonproc.h"
 
+#include <cstdlib>
+#include <fstream>
 #include <map>
+#include <unordered_map>
 
 #include <string>
 using std::string; using std::to_string;
@@ -11,31 +14,38 @@ using std::string; using std::to_string;
 using namespace inja;
 using json = nlohmann::json;
 
-std::map<string, string> customVars;
+#include "template_cache.h"
 
-void set_custom_var(string key, string value)
+// Variables set by the templates with setVar/setVarInt. They are cleared
+// before each output is rendered.
+std::unordered_map<string, string> customVars;
+
+// The files that the output being rendered is generated from.
+string jsonfilepath;
+string templateFilepath;
+
+void set_custom_var(const string &key, string value)
 {
-    customVars[key] = value;
+    customVars[key] = std::move(value);
 }
 
-string get_custom_var(string key)
+const string &get_custom_var(const string &key)
 {
-    return customVars[key];
+    static const string empty;
+    auto it = customVars.find(key);
+
+    return it != customVars.end() ? it->second : empty;
 }
 
 int main(int argc, char *argv[])
 {
-    if (argc != 4)
-        FATAL_ERROR("USAGE: jsonproc <json-filepath> <template-filepath> <output-filepath>\n");
-
-    string jsonfilepath = argv[1];
-    string templateFilepath = argv[2];
-    string outputFilepath = argv[3];
+    if (argc < 4 || (argc - 1) % 3 != 0)
+        FATAL_ERROR("USAGE: jsonproc <json-filepath> <template-filepath> <output-filepath> [<json-filepath> <template-filepath> <output-filepath> ...]\n");
 
     Environment env;
 
     // Add custom command callbacks.
-    env.add_callback("doNotModifyHeader", 0, [jsonfilepath, templateFilepath](Arguments& args) {
+    env.add_callback("doNotModifyHeader", 0, [](Arguments& args) {
         return "//\n// DO NOT MODIFY THIS FILE! It is auto-generated from " + jsonfilepath +" and Inja template " + templateFilepath + "\n//\n";
     });
 
@@ -47,28 +57,21 @@ int main(int argc, char *argv[])
     });
 
     env.add_callback("setVar", 2, [=](Arguments& args) {
-        string key = args.at(0)->get<string>();
-        string value = args.at(1)->get<string>();
-        set_custom_var(key, value);
+        set_custom_var(args.at(0)->get_ref<const string&>(), args.at(1)->get<string>());
         return "";
     });
 
     env.add_callback("setVarInt", 2, [=](Arguments& args) {
-        string key = args.at(0)->get<string>();
-        string value = to_string(args.at(1)->get<int>());
-        set_custom_var(key, value);
+        set_custom_var(args.at(0)->get_ref<const string&>(), to_string(args.at(1)->get<int>()));
         return "";
     });
 
     env.add_callback("getVar", 1, [=](Arguments& args) {
-        string key = args.at(0)->get<string>();
-        return get_custom_var(key);
+        return get_custom_var(args.at(0)->get_ref<const string&>());
     });
 
     env.add_callback("concat", 2, [](Arguments& args) {
-        string first = args.at(0)->get<string>();
-        string second = args.at(1)->get<string>();
-        return first + second;
+        return args.at(0)->get_ref<const string&>() + args.at(1)->get_ref<const string&>();
     });
 
     env.add_callback("removePrefix", 2, [](Arguments& args) {
@@ -96,13 +99,39 @@ int main(int argc, char *argv[])
         return args.at(0)->empty();
     });
 
-    try
-    {
-        env.write_with_json_file(templateFilepath, jsonfilepath, outputFilepath);
-    }
-    catch (const std::exception& e)
+    const char *cacheDir = std::getenv("TOOL_CACHE_DIR");
+    TemplateCache templates(env, cacheDir != nullptr ? cacheDir : "");
+
+    // Outputs that share a JSON file or template only load it once.
+    std::map<string, json> jsonFiles;
+
+    for (int i = 1; i < argc; i += 3)
     {
-        FATAL_ERROR("JSONPROC_ERROR: %s\n", e.what());
+        jsonfilepath = argv[i];
+        templateFilepath = argv[i + 1];
+        string outputFilepath = argv[i + 2];
+
+        customVars.clear();
+
+        try
+        {
+            auto it = jsonFiles.find(jsonfilepath);
+
+            if (it == jsonFiles.end())
+                it = jsonFiles.emplace(jsonfilepath, env.load_json(jsonfilepath)).first;
+
+            // Render fully before opening the output, so that an error does
+            // not leave a truncated file behind.
+            string output = env.render(templates.get(templateFilepath), it->second);
+            std::ofstream file(outputFilepath);
+
+            if (!(file << output))
+                FATAL_ERROR("JSONPROC_ERROR: failed to write \"%s\"\n", outputFilepath.c_str());
+        }
+        catch (const std::exception& e)
+        {
+            FATAL_ERROR("JSONPROC_ERROR: %s\n", e.what());
+        }
     }
 
     return 0;
@@ -0,0 +1,170 @@
+// template_cache.cpp
+
+#include "template_cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define MakeDir(path) _mkdir(path)
+#define GetPid() _getpid()
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define MakeDir(path) mkdir(path, 0777)
+#define GetPid() getpid()
+#endif
+
+using std::string;
+using json = nlohmann::json;
+using inja::Bytecode;
+
+// Bump when the entry format or the bundled Inja changes so that old entries
+// are ignored.
+static const int template_cache_version = 1;
+
+static std::uint64_t hash_text(const string &text)
+{
+    std::uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+static bool has_includes(const inja::Template &tmpl)
+{
+    for (const Bytecode &bc : tmpl.bytecodes) {
+        if (bc.op == Bytecode::Op::Include)
+            return true;
+    }
+
+    return false;
+}
+
+TemplateCache::TemplateCache(inja::Environment &env, string dir) : m_env(env), m_dir(dir)
+{
+    if (!m_dir.empty()) {
+        MakeDir(m_dir.c_str());
+        m_dir += "/jsonproc-templates";
+        MakeDir(m_dir.c_str());
+    }
+}
+
+const inja::Template &TemplateCache::get(const string &path)
+{
+    auto it = m_templates.find(path);
+
+    if (it != m_templates.end())
+        return it->second;
+
+    inja::Template &tmpl = m_templates[path];
+
+    if (m_dir.empty()) {
+        tmpl = m_env.parse_template(path);
+        return tmpl;
+    }
+
+    string text = m_env.load_file(path);
+    char key[64];
+
+    std::snprintf(key, sizeof(key), "%016llx-%zx-v%d",
+        (unsigned long long)hash_text(text), text.size(), template_cache_version);
+
+    string entry_path = m_dir + "/" + key;
+
+    if (read_entry(entry_path, tmpl))
+        return tmpl;
+
+    tmpl = m_env.parse_template(path);
+
+    if (!has_includes(tmpl))
+        write_entry(entry_path, tmpl);
+
+    return tmpl;
+}
+
+// An entry is the CBOR encoding of an array with one [op, args, flags, value,
+// str] array per bytecode. Anything that does not decode to that is treated
+// as a miss.
+bool TemplateCache::read_entry(const string &entry_path, inja::Template &tmpl)
+{
+    std::ifstream file(entry_path, std::ios::binary);
+
+    if (!file)
+        return false;
+
+    std::vector<std::uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    json entry;
+
+    try {
+        entry = json::from_cbor(bytes);
+    } catch (const std::exception &) {
+        return false;
+    }
+
+    if (!entry.is_array())
+        return false;
+
+    std::vector<Bytecode> bytecodes;
+
+    bytecodes.reserve(entry.size());
+
+    for (const json &item : entry) {
+        if (!item.is_array() || item.size() != 5 || !item[0].is_number_unsigned() || !item[1].is_number_unsigned()
+         || !item[2].is_number_unsigned() || !item[4].is_string())
+            return false;
+
+        unsigned int op = item[0].get<unsigned int>();
+
+        if (op > static_cast<unsigned int>(Bytecode::Op::EndLoop))
+            return false;
+
+        bytecodes.emplace_back(static_cast<Bytecode::Op>(op), item[1].get<unsigned int>());
+
+        Bytecode &bc = bytecodes.back();
+
+        bc.flags = item[2].get<unsigned int>();
+        bc.value = item[3];
+        bc.str = item[4].get_ref<const string &>();
+    }
+
+    tmpl.bytecodes = std::move(bytecodes);
+    return true;
+}
+
+// Entries are written to a temporary file and renamed into place, so
+// concurrent runs never read a partially written entry.
+void TemplateCache::write_entry(const string &entry_path, const inja::Template &tmpl)
+{
+    json entry = json::array();
+
+    for (const Bytecode &bc : tmpl.bytecodes)
+        entry.push_back(json::array({ static_cast<unsigned int>(bc.op), bc.args, bc.flags, bc.value, bc.str }));
+
+    std::vector<std::uint8_t> bytes = json::to_cbor(entry);
+    char suffix[32];
+
+    std::snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)GetPid());
+
+    string tmp_path = entry_path + suffix;
+    std::FILE *fp = std::fopen(tmp_path.c_str(), "wb");
+
+    if (fp == nullptr)
+        return;
+
+    bool success = (std::fwrite(bytes.data(), 1, bytes.size(), fp) == bytes.size());
+
+    success = (std::fclose(fp) == 0) && success;
+
+    if (!success || std::rename(tmp_path.c_str(), entry_path.c_str()) != 0)
+        std::remove(tmp_path.c_str());
+}
@@ -0,0 +1,34 @@
+// template_cache.h
+
+#ifndef TEMPLATE_CACHE_H
+#define TEMPLATE_CACHE_H
+
+#include <map>
+#include <string>
+
+#include <inja.hpp>
+
+// Hands out parsed Inja templates. A template is only parsed once per run,
+// and if a cache directory is given, its bytecode is also kept there between
+// runs, keyed by a hash of the template text. Templates that include other
+// templates are always parsed, since the bytecode alone does not cover the
+// included files.
+class TemplateCache
+{
+public:
+    TemplateCache(inja::Environment &env, std::string dir);
+
+    // Throws like inja::Environment::parse_template if the template cannot
+    // be read or parsed.
+    const inja::Template &get(const std::string &path);
+
+private:
+    inja::Environment &m_env;
+    std::string m_dir;
+    std::map<std::string, inja::Template> m_templates;
+
+    bool read_entry(const std::string &entry_path, inja::Template &tmpl);
+    void write_entry(const std::string &entry_path, const inja::Template &tmpl);
+};
+
+#endif // TEMPLATE_CACHE_H
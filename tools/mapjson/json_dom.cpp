@@ -0,0 +1,435 @@
+// json_dom.cpp
+
+#include <cstdlib>
+#include <cstdio>
+#include "json_dom.h"
+
+using std::string;
+using std::vector;
+
+static const int max_depth = 200;
+static const size_t arena_block_size = 64 * 1024;
+
+static const JsonValue empty_value;
+
+string operator+(StringView a, const char *b) {
+    string result(a.data, a.size);
+    result += b;
+    return result;
+}
+
+const JsonValue &JsonValue::operator[](size_t index) const {
+    if (m_type != ARRAY || index >= m_count)
+        return empty_value;
+    return m_items[index];
+}
+
+const JsonValue &JsonValue::operator[](StringView key) const {
+    const JsonValue *value = find(key);
+    return value != nullptr ? *value : empty_value;
+}
+
+// Searches from the back so that the last of any duplicate keys wins.
+const JsonValue *JsonValue::find(StringView key) const {
+    if (m_type != OBJECT)
+        return nullptr;
+
+    for (size_t i = m_count; i > 0; i--) {
+        if (m_members[i - 1].key == key)
+            return &m_members[i - 1].value;
+    }
+
+    return nullptr;
+}
+
+void *JsonArena::allocate(size_t size) {
+    const size_t align = alignof(std::max_align_t);
+
+    size = (size + align - 1) & ~(align - 1);
+
+    if (m_blocks.empty() || m_capacity - m_pos < size) {
+        m_capacity = size > arena_block_size ? size : arena_block_size;
+        m_blocks.emplace_back(new char[m_capacity]);
+        m_pos = 0;
+    }
+
+    void *ptr = m_blocks.back().get() + m_pos;
+    m_pos += size;
+    return ptr;
+}
+
+class JsonParser {
+public:
+    JsonParser(const char *text, size_t size, JsonArena &arena)
+        : m_start(text), m_pos(text), m_end(text + size), m_arena(arena) {}
+
+    bool parse(JsonValue &root, string &err);
+
+private:
+    const char *m_start;
+    const char *m_pos;
+    const char *m_end;
+    JsonArena &m_arena;
+    string m_err;
+
+    // Scratch space for the elements of the arrays and objects being parsed.
+    // Each one is copied into the arena in one go once it is complete.
+    vector<JsonValue> m_items;
+    vector<JsonMember> m_members;
+
+    bool fail(const char *message);
+    void skip_whitespace();
+    bool expect_literal(const char *literal);
+    bool parse_value(JsonValue &value, int depth);
+    bool parse_string(StringView &str);
+    bool parse_number(JsonValue &value);
+    bool parse_array(JsonValue &value, int depth);
+    bool parse_object(JsonValue &value, int depth);
+};
+
+bool JsonParser::fail(const char *message) {
+    if (!m_err.empty())
+        return false;
+
+    int line = 1;
+
+    for (const char *p = m_start; p < m_pos && p < m_end; p++) {
+        if (*p == '\n')
+            line++;
+    }
+
+    char buffer[256];
+    std::snprintf(buffer, sizeof(buffer), "line %d: %s", line, message);
+    m_err = buffer;
+    return false;
+}
+
+void JsonParser::skip_whitespace() {
+    while (m_pos < m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\n' || *m_pos == '\r'))
+        m_pos++;
+}
+
+bool JsonParser::expect_literal(const char *literal) {
+    size_t length = std::strlen(literal);
+
+    if (static_cast<size_t>(m_end - m_pos) < length || std::memcmp(m_pos, literal, length) != 0)
+        return fail("invalid literal");
+
+    m_pos += length;
+    return true;
+}
+
+bool JsonParser::parse(JsonValue &root, string &err) {
+    bool ok = parse_value(root, 0);
+
+    if (ok) {
+        skip_whitespace();
+        if (m_pos != m_end)
+            ok = fail("unexpected trailing content");
+    }
+
+    if (!ok)
+        err = m_err;
+
+    return ok;
+}
+
+bool JsonParser::parse_value(JsonValue &value, int depth) {
+    if (depth > max_depth)
+        return fail("exceeded maximum nesting depth");
+
+    skip_whitespace();
+
+    if (m_pos == m_end)
+        return fail("unexpected end of input");
+
+    switch (*m_pos) {
+    case '{':
+        return parse_object(value, depth);
+    case '[':
+        return parse_array(value, depth);
+    case '"': {
+        StringView str;
+        if (!parse_string(str))
+            return false;
+        value.m_type = JsonValue::STRING;
+        value.m_string = str.data;
+        value.m_count = str.size;
+        return true;
+    }
+    case 't':
+        value.m_type = JsonValue::BOOL;
+        value.m_boolean = true;
+        return expect_literal("true");
+    case 'f':
+        value.m_type = JsonValue::BOOL;
+        value.m_boolean = false;
+        return expect_literal("false");
+    case 'n':
+        value.m_type = JsonValue::NUL;
+        return expect_literal("null");
+    default:
+        return parse_number(value);
+    }
+}
+
+static void append_utf8(char *&out, unsigned long code) {
+    if (code < 0x80) {
+        *out++ = code;
+    } else if (code < 0x800) {
+        *out++ = 0xC0 | (code >> 6);
+        *out++ = 0x80 | (code & 0x3F);
+    } else if (code < 0x10000) {
+        *out++ = 0xE0 | (code >> 12);
+        *out++ = 0x80 | ((code >> 6) & 0x3F);
+        *out++ = 0x80 | (code & 0x3F);
+    } else {
+        *out++ = 0xF0 | (code >> 18);
+        *out++ = 0x80 | ((code >> 12) & 0x3F);
+        *out++ = 0x80 | ((code >> 6) & 0x3F);
+        *out++ = 0x80 | (code & 0x3F);
+    }
+}
+
+static bool read_hex4(const char *p, const char *end, unsigned long &code) {
+    if (end - p < 4)
+        return false;
+
+    code = 0;
+
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        code <<= 4;
+        if (c >= '0' && c <= '9')
+            code |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            code |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            code |= c - 'A' + 10;
+        else
+            return false;
+    }
+
+    return true;
+}
+
+// Strings without escapes are returned as views into the text. Only strings
+// with escapes are decoded, into the arena.
+bool JsonParser::parse_string(StringView &str) {
+    const char *start = ++m_pos;
+    bool has_escapes = false;
+
+    while (m_pos < m_end && *m_pos != '"') {
+        unsigned char c = *m_pos;
+
+        if (c < 0x20)
+            return fail("unescaped control character in string");
+
+        if (c == '\\') {
+            has_escapes = true;
+            m_pos++;
+            if (m_pos == m_end)
+                break;
+        }
+
+        m_pos++;
+    }
+
+    if (m_pos == m_end)
+        return fail("unterminated string");
+
+    const char *finish = m_pos++;
+
+    if (!has_escapes) {
+        str = StringView(start, finish - start);
+        return true;
+    }
+
+    char *buffer = static_cast<char *>(m_arena.allocate(finish - start));
+    char *out = buffer;
+
+    for (const char *p = start; p < finish; p++) {
+        if (*p != '\\') {
+            *out++ = *p;
+            continue;
+        }
+
+        p++;
+
+        switch (*p) {
+        case '"':  *out++ = '"'; break;
+        case '\\': *out++ = '\\'; break;
+        case '/':  *out++ = '/'; break;
+        case 'b':  *out++ = '\b'; break;
+        case 'f':  *out++ = '\f'; break;
+        case 'n':  *out++ = '\n'; break;
+        case 'r':  *out++ = '\r'; break;
+        case 't':  *out++ = '\t'; break;
+        case 'u': {
+            unsigned long code;
+
+            if (!read_hex4(p + 1, finish, code))
+                return fail("invalid \\u escape in string");
+            p += 4;
+
+            // Combine a surrogate pair into one code point.
+            unsigned long low;
+            if (code >= 0xD800 && code <= 0xDBFF && finish - p >= 7 && p[1] == '\\' && p[2] == 'u'
+             && read_hex4(p + 3, finish, low) && low >= 0xDC00 && low <= 0xDFFF) {
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+            }
+
+            append_utf8(out, code);
+            break;
+        }
+        default:
+            return fail("invalid escape in string");
+        }
+    }
+
+    str = StringView(buffer, out - buffer);
+    return true;
+}
+
+bool JsonParser::parse_number(JsonValue &value) {
+    const char *start = m_pos;
+
+    if (m_pos < m_end && *m_pos == '-')
+        m_pos++;
+
+    if (m_pos == m_end || *m_pos < '0' || *m_pos > '9')
+        return fail("expected value");
+
+    while (m_pos < m_end && ((*m_pos >= '0' && *m_pos <= '9') || *m_pos == '.' || *m_pos == 'e'
+                          || *m_pos == 'E' || *m_pos == '+' || *m_pos == '-'))
+        m_pos++;
+
+    // The text is NUL-terminated, so strtod cannot run off the end. It must
+    // stop exactly where the JSON number ends.
+    char *end;
+
+    value.m_type = JsonValue::NUMBER;
+    value.m_number = std::strtod(start, &end);
+
+    if (end != m_pos)
+        return fail("invalid number");
+
+    return true;
+}
+
+bool JsonParser::parse_array(JsonValue &value, int depth) {
+    size_t first = m_items.size();
+
+    m_pos++;
+    skip_whitespace();
+
+    if (m_pos < m_end && *m_pos == ']') {
+        m_pos++;
+    } else {
+        for (;;) {
+            JsonValue item;
+
+            if (!parse_value(item, depth + 1))
+                return false;
+
+            m_items.push_back(item);
+            skip_whitespace();
+
+            if (m_pos < m_end && *m_pos == ',') {
+                m_pos++;
+            } else if (m_pos < m_end && *m_pos == ']') {
+                m_pos++;
+                break;
+            } else {
+                return fail("expected ',' or ']' in array");
+            }
+        }
+    }
+
+    size_t count = m_items.size() - first;
+    JsonValue *items = static_cast<JsonValue *>(m_arena.allocate(count * sizeof(JsonValue)));
+
+    if (count != 0)
+        std::memcpy(items, &m_items[first], count * sizeof(JsonValue));
+
+    m_items.resize(first);
+
+    value.m_type = JsonValue::ARRAY;
+    value.m_items = items;
+    value.m_count = count;
+    return true;
+}
+
+bool JsonParser::parse_object(JsonValue &value, int depth) {
+    size_t first = m_members.size();
+
+    m_pos++;
+    skip_whitespace();
+
+    if (m_pos < m_end && *m_pos == '}') {
+        m_pos++;
+    } else {
+        for (;;) {
+            JsonMember member;
+
+            skip_whitespace();
+
+            if (m_pos == m_end || *m_pos != '"')
+                return fail("expected string key in object");
+
+            if (!parse_string(member.key))
+                return false;
+
+            skip_whitespace();
+
+            if (m_pos == m_end || *m_pos != ':')
+                return fail("expected ':' in object");
+
+            m_pos++;
+
+            if (!parse_value(member.value, depth + 1))
+                return false;
+
+            m_members.push_back(member);
+            skip_whitespace();
+
+            if (m_pos < m_end && *m_pos == ',') {
+                m_pos++;
+            } else if (m_pos < m_end && *m_pos == '}') {
+                m_pos++;
+                break;
+            } else {
+                return fail("expected ',' or '}' in object");
+            }
+        }
+    }
+
+    size_t count = m_members.size() - first;
+    JsonMember *members = static_cast<JsonMember *>(m_arena.allocate(count * sizeof(JsonMember)));
+
+    if (count != 0)
+        std::memcpy(members, &m_members[first], count * sizeof(JsonMember));
+
+    m_members.resize(first);
+
+    value.m_type = JsonValue::OBJECT;
+    value.m_members = members;
+    value.m_count = count;
+    return true;
+}
+
+bool JsonDocument::parse(string text, string &err) {
+    m_text.reset(new string(std::move(text)));
+    m_arena = JsonArena();
+    m_root = JsonValue();
+
+    JsonParser parser(m_text->data(), m_text->size(), m_arena);
+
+    if (!parser.parse(m_root, err)) {
+        m_root = JsonValue();
+        return false;
+    }
+
+    return true;
+}
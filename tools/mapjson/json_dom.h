@@ -0,0 +1,125 @@
+// json_dom.h
+
+#ifndef JSON_DOM_H
+#define JSON_DOM_H
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A non-owning view of a string, in the spirit of C++17's std::string_view.
+struct StringView {
+    const char *data;
+    size_t size;
+
+    StringView() : data(""), size(0) {}
+    StringView(const char *data, size_t size) : data(data), size(size) {}
+    StringView(const char *str) : data(str), size(std::strlen(str)) {}
+    StringView(const std::string &str) : data(str.data()), size(str.size()) {}
+
+    bool empty() const { return size == 0; }
+    std::string str() const { return std::string(data, size); }
+
+    bool operator==(StringView other) const {
+        return size == other.size && std::memcmp(data, other.data, size) == 0;
+    }
+    bool operator!=(StringView other) const { return !(*this == other); }
+};
+
+std::string operator+(StringView a, const char *b);
+
+struct JsonMember;
+
+// A JSON value. Values never own their contents: strings point into the
+// parsed text or the document's arena, and arrays and objects are runs of
+// values in the arena. Looking up something that is missing or of the
+// wrong type gives an empty value, like json11 did.
+class JsonValue {
+public:
+    enum Type {
+        NUL, NUMBER, BOOL, STRING, ARRAY, OBJECT
+    };
+
+    JsonValue() : m_type(NUL), m_count(0) { m_number = 0; }
+
+    Type type() const { return m_type; }
+    bool is_null() const { return m_type == NUL; }
+
+    int int_value() const { return m_type == NUMBER ? static_cast<int>(m_number) : 0; }
+    bool bool_value() const { return m_type == BOOL && m_boolean; }
+    StringView string_value() const {
+        return m_type == STRING ? StringView(m_string, m_count) : StringView();
+    }
+
+    // Array access.
+    size_t size() const { return m_type == ARRAY ? m_count : 0; }
+    const JsonValue *begin() const { return m_type == ARRAY ? m_items : nullptr; }
+    const JsonValue *end() const { return m_type == ARRAY ? m_items + m_count : nullptr; }
+    const JsonValue &operator[](size_t index) const;
+
+    // Object access.
+    bool has(StringView key) const { return find(key) != nullptr; }
+    const JsonValue &operator[](StringView key) const;
+    const JsonValue &operator[](const char *key) const { return (*this)[StringView(key)]; }
+
+private:
+    friend class JsonParser;
+
+    Type m_type;
+    size_t m_count;
+    union {
+        double m_number;
+        bool m_boolean;
+        const char *m_string;
+        const JsonValue *m_items;
+        const JsonMember *m_members;
+    };
+
+    const JsonValue *find(StringView key) const;
+};
+
+struct JsonMember {
+    StringView key;
+    JsonValue value;
+};
+
+// Bump allocator that backs all the values of a document.
+class JsonArena {
+public:
+    JsonArena() : m_pos(0), m_capacity(0) {}
+    JsonArena(const JsonArena &) = delete;
+    JsonArena(JsonArena &&) = default;
+    JsonArena &operator=(JsonArena &&) = default;
+
+    void *allocate(size_t size);
+
+private:
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    size_t m_pos;
+    size_t m_capacity;
+};
+
+// A parsed JSON file. The document owns the text and the arena that all of
+// its values point into, so it has to outlive every value taken from it.
+class JsonDocument {
+public:
+    JsonDocument() {}
+    JsonDocument(const JsonDocument &) = delete;
+    JsonDocument(JsonDocument &&) = default;
+    JsonDocument &operator=(JsonDocument &&) = default;
+
+    // Takes over the text, which should be moved in to avoid a copy. Returns
+    // false and sets err if it is not valid JSON.
+    bool parse(std::string text, std::string &err);
+
+    const JsonValue &root() const { return m_root; }
+
+private:
+    std::unique_ptr<std::string> m_text;
+    JsonArena m_arena;
+    JsonValue m_root;
+};
+
+#endif // JSON_DOM_H
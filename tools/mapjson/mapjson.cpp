@@ -18,14 +18,17 @@ using std::map;
 #include <fstream>
 using std::ofstream; using std::ifstream;
 
-#include <sstream>
-using std::ostringstream;
-
 #include <limits>
 using std::numeric_limits;
 
-#include "json11.h"
-using json11::Json;
+#include <atomic>
+using std::atomic;
+
+#include <thread>
+using std::thread;
+
+#include "json_dom.h"
+#include "text_builder.h"
 
 #include "mapjson.h"
 
@@ -49,7 +52,7 @@ string read_text_file(string filepath) {
     return text;
 }
 
-void write_text_file(string filepath, string text) {
+void write_text_file(string filepath, const string &text) {
     ofstream out_file(filepath, std::ofstream::binary);
 
     if (!out_file.is_open())
@@ -60,22 +63,63 @@ void write_text_file(string filepath, string text) {
     out_file.close();
 }
 
-string generate_map_header_text(Json map_data, Json layouts_data, string version) {
-    string map_layout_id = map_data["layout"].string_value();
+// Leaves the file untouched if it already holds this text, so that make does
+// not rebuild whatever depends on it.
+void write_text_file_if_changed(string filepath, const string &text) {
+    ifstream in_file(filepath, std::ifstream::binary);
+
+    if (in_file.is_open()) {
+        in_file.seekg(0, std::ios::end);
+
+        if (in_file.tellg() == static_cast<std::streamoff>(text.size())) {
+            string old_text(text.size(), '\0');
+
+            in_file.seekg(0, std::ios::beg);
+            in_file.read(&old_text[0], old_text.size());
+
+            if (in_file && old_text == text)
+                return;
+        }
+
+        in_file.close();
+    }
+
+    write_text_file(filepath, text);
+}
+
+void write_output_file(string filepath, const string &text, bool skip_unchanged) {
+    if (skip_unchanged)
+        write_text_file_if_changed(filepath, text);
+    else
+        write_text_file(filepath, text);
+}
+
+JsonDocument read_json_file(string filepath) {
+    JsonDocument document;
+    string err;
+
+    if (!document.parse(read_text_file(filepath), err))
+        FATAL_ERROR("%s: %s\n", filepath.c_str(), err.c_str());
+
+    return document;
+}
+
+string generate_map_header_text(const JsonValue &map_data, const JsonValue &layouts_data, string version) {
+    StringView map_layout_id = map_data["layout"].string_value();
 
-    vector<Json> matched;
+    vector<const JsonValue *> matched;
 
-    for (auto &field : layouts_data["layouts"].array_items()) {
+    for (auto &field : layouts_data["layouts"]) {
         if (map_layout_id == field["id"].string_value())
-            matched.push_back(field);
+            matched.push_back(&field);
     }
 
     if (matched.size() != 1)
-        FATAL_ERROR("Failed to find matching layout for %s.\n", map_layout_id.c_str());
+        FATAL_ERROR("Failed to find matching layout for %s.\n", map_layout_id.str().c_str());
 
-    Json layout = matched[0];
+    const JsonValue &layout = *matched[0];
 
-    ostringstream text;
+    TextBuilder text(4 * 1024);
 
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/maps/" 
          << map_data["name"].string_value() 
@@ -84,18 +128,18 @@ string generate_map_header_text(Json map_data, Json layouts_data, string version
     text << map_data["name"].string_value() << ":\n"
          << "\t.4byte " << layout["name"].string_value() << "\n";
 
-    if (map_data.object_items().find("shared_events_map") != map_data.object_items().end())
+    if (map_data.has("shared_events_map"))
         text << "\t.4byte " << map_data["shared_events_map"].string_value() << "_MapEvents\n";
     else
         text << "\t.4byte " << map_data["name"].string_value() << "_MapEvents\n";
 
-    if (map_data.object_items().find("shared_scripts_map") != map_data.object_items().end())
+    if (map_data.has("shared_scripts_map"))
         text << "\t.4byte " << map_data["shared_scripts_map"].string_value() << "_MapScripts\n";
     else
         text << "\t.4byte " << map_data["name"].string_value() << "_MapScripts\n";
 
-    if (map_data.object_items().find("connections") != map_data.object_items().end()
-     && map_data["connections"].array_items().size() > 0)
+    if (map_data.has("connections")
+     && map_data["connections"].size() > 0)
         text << "\t.4byte " << map_data["name"].string_value() << "_MapConnections\n";
     else
         text << "\t.4byte 0x0\n";
@@ -122,11 +166,11 @@ string generate_map_header_text(Json map_data, Json layouts_data, string version
     return text.str();
 }
 
-string generate_map_connections_text(Json map_data) {
-    if (map_data["connections"] == Json())
+string generate_map_connections_text(const JsonValue &map_data) {
+    if (map_data["connections"].is_null())
         return string("\n");
 
-    ostringstream text;
+    TextBuilder text(4 * 1024);
 
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/maps/" 
          << map_data["name"].string_value() 
@@ -134,7 +178,7 @@ string generate_map_connections_text(Json map_data) {
 
     text << map_data["name"].string_value() << "_MapConnectionsList:\n";
 
-    for (auto &connection : map_data["connections"].array_items()) {
+    for (auto &connection : map_data["connections"]) {
         text << "\tconnection "
              << connection["direction"].string_value() << ", "
              << connection["offset"].int_value() << ", "
@@ -142,17 +186,17 @@ string generate_map_connections_text(Json map_data) {
     }
 
     text << "\n" << map_data["name"].string_value() << "_MapConnections:\n"
-         << "\t.4byte " << map_data["connections"].array_items().size() << "\n"
+         << "\t.4byte " << map_data["connections"].size() << "\n"
          << "\t.4byte " << map_data["name"].string_value() << "_MapConnectionsList\n\n";
 
     return text.str();
 }
 
-string generate_map_events_text(Json map_data) {
-    if (map_data.object_items().find("shared_events_map") != map_data.object_items().end())
+string generate_map_events_text(const JsonValue &map_data) {
+    if (map_data.has("shared_events_map"))
         return string("\n");
 
-    ostringstream text;
+    TextBuilder text(4 * 1024);
 
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/maps/" 
          << map_data["name"].string_value() 
@@ -160,11 +204,11 @@ string generate_map_events_text(Json map_data) {
 
     string objects_label, warps_label, coords_label, bgs_label;
 
-    if (map_data["object_events"].array_items().size() > 0) {
+    if (map_data["object_events"].size() > 0) {
         objects_label = map_data["name"].string_value() + "_ObjectEvents";
         text << objects_label << ":\n";
-        for (unsigned int i = 0; i < map_data["object_events"].array_items().size(); i++) {
-            auto obj_event = map_data["object_events"].array_items()[i];
+        for (unsigned int i = 0; i < map_data["object_events"].size(); i++) {
+            const JsonValue &obj_event = map_data["object_events"][i];
             text << "\tobject_event " << i + 1 << ", "
                  << obj_event["graphics_id"].string_value() << ", 0, "
                  << obj_event["x"].int_value() << ", "
@@ -183,10 +227,10 @@ string generate_map_events_text(Json map_data) {
         objects_label = "0x0";
     }
 
-    if (map_data["warp_events"].array_items().size() > 0) {
+    if (map_data["warp_events"].size() > 0) {
         warps_label = map_data["name"].string_value() + "_MapWarps";
         text << warps_label << ":\n";
-        for (auto &warp_event : map_data["warp_events"].array_items()) {
+        for (auto &warp_event : map_data["warp_events"]) {
             text << "\twarp_def "
                  << warp_event["x"].int_value() << ", "
                  << warp_event["y"].int_value() << ", "
@@ -199,10 +243,10 @@ string generate_map_events_text(Json map_data) {
         warps_label = "0x0";
     }
 
-    if (map_data["coord_events"].array_items().size() > 0) {
+    if (map_data["coord_events"].size() > 0) {
         coords_label = map_data["name"].string_value() + "_MapCoordEvents";
         text << coords_label << ":\n";
-        for (auto &coord_event : map_data["coord_events"].array_items()) {
+        for (auto &coord_event : map_data["coord_events"]) {
             if (coord_event["type"].string_value() == "trigger") {
                 text << "\tcoord_event "
                      << coord_event["x"].int_value() << ", "
@@ -212,7 +256,7 @@ string generate_map_events_text(Json map_data) {
                      << coord_event["var_value"].string_value() << ", "
                      << coord_event["script"].string_value() << "\n";
             }
-            else if (coord_event["type"] == "weather") {
+            else if (coord_event["type"].string_value() == "weather") {
                 text << "\tcoord_weather_event "
                      << coord_event["x"].int_value() << ", "
                      << coord_event["y"].int_value() << ", "
@@ -225,11 +269,11 @@ string generate_map_events_text(Json map_data) {
         coords_label = "0x0";
     }
 
-    if (map_data["bg_events"].array_items().size() > 0) {
+    if (map_data["bg_events"].size() > 0) {
         bgs_label = map_data["name"].string_value() + "_MapBGEvents";
         text << bgs_label << ":\n";
-        for (auto &bg_event : map_data["bg_events"].array_items()) {
-            if (bg_event["type"] == "sign") {
+        for (auto &bg_event : map_data["bg_events"]) {
+            if (bg_event["type"].string_value() == "sign") {
                 text << "\tbg_event "
                      << bg_event["x"].int_value() << ", "
                      << bg_event["y"].int_value() << ", "
@@ -237,7 +281,7 @@ string generate_map_events_text(Json map_data) {
                      << bg_event["player_facing_dir"].string_value() << ", "
                      << bg_event["script"].string_value() << "\n";
             }
-            else if (bg_event["type"] == "hidden_item") {
+            else if (bg_event["type"].string_value() == "hidden_item") {
                 text << "\tbg_hidden_item_event "
                      << bg_event["x"].int_value() << ", "
                      << bg_event["y"].int_value() << ", "
@@ -245,7 +289,7 @@ string generate_map_events_text(Json map_data) {
                      << bg_event["item"].string_value() << ", "
                      << bg_event["flag"].string_value() << "\n";
             }
-            else if (bg_event["type"] == "secret_base") {
+            else if (bg_event["type"].string_value() == "secret_base") {
                 text << "\tbg_secret_base_event "
                      << bg_event["x"].int_value() << ", "
                      << bg_event["y"].int_value() << ", "
@@ -271,63 +315,59 @@ string get_directory_name(string filename) {
     return filename.substr(0, dir_pos + 1);
 }
 
-void process_map(string map_filepath, string layouts_filepath, string version) {
-    string mapdata_err, layouts_err;
-
-    string mapdata_json_text = read_text_file(map_filepath);
-    string layouts_json_text = read_text_file(layouts_filepath);
-
-    Json map_data = Json::parse(mapdata_json_text, mapdata_err);
-    if (map_data == Json())
-        FATAL_ERROR("%s\n", mapdata_err.c_str());
-
-    Json layouts_data = Json::parse(layouts_json_text, layouts_err);
-    if (layouts_data == Json())
-        FATAL_ERROR("%s\n", layouts_err.c_str());
-
+void write_map_files(string map_filepath, const JsonValue &map_data, const JsonValue &layouts_data, string version, bool skip_unchanged) {
     string header_text = generate_map_header_text(map_data, layouts_data, version);
     string events_text = generate_map_events_text(map_data);
     string connections_text = generate_map_connections_text(map_data);
 
     string files_dir = get_directory_name(map_filepath);
-    write_text_file(files_dir + "header.inc", header_text);
-    write_text_file(files_dir + "events.inc", events_text);
-    write_text_file(files_dir + "connections.inc", connections_text);
+    write_output_file(files_dir + "header.inc", header_text, skip_unchanged);
+    write_output_file(files_dir + "events.inc", events_text, skip_unchanged);
+    write_output_file(files_dir + "connections.inc", connections_text, skip_unchanged);
 }
 
-string generate_groups_text(Json groups_data) {
-    ostringstream text;
+void process_map(string map_filepath, string layouts_filepath, string version) {
+    JsonDocument map_data = read_json_file(map_filepath);
+    JsonDocument layouts_data = read_json_file(layouts_filepath);
+
+    write_map_files(map_filepath, map_data.root(), layouts_data.root(), version, false);
+}
+
+string generate_groups_text(const JsonValue &groups_data) {
+    TextBuilder text(64 * 1024);
 
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/maps/map_groups.json\n@\n\n";
 
-    for (auto &key : groups_data["group_order"].array_items()) {
-        string group = key.string_value();
+    for (auto &key : groups_data["group_order"]) {
+        StringView group = key.string_value();
         text << group << "::\n";
-        auto maps = groups_data[group].array_items();
-        for (Json &map_name : maps)
+        for (auto &map_name : groups_data[group])
             text << "\t.4byte " << map_name.string_value() << "\n";
         text << "\n";
     }
 
     text << "\t.align 2\n" << "gMapGroups::\n";
-    for (auto &group : groups_data["group_order"].array_items())
+    for (auto &group : groups_data["group_order"])
         text << "\t.4byte " << group.string_value() << "\n";
     text << "\n";
 
     return text.str();
 }
 
-string generate_connections_text(Json groups_data) {
-    vector<Json> map_names;
+string generate_connections_text(const JsonValue &groups_data) {
+    vector<StringView> map_names;
+
+    for (auto &group : groups_data["group_order"])
+    for (auto &map_name : groups_data[group.string_value()])
+        map_names.push_back(map_name.string_value());
 
-    for (auto &group : groups_data["group_order"].array_items())
-    for (auto map_name : groups_data[group.string_value()].array_items())
-        map_names.push_back(map_name);
+    vector<StringView> connections_include_order;
 
-    vector<Json> connections_include_order = groups_data["connections_include_order"].array_items();
+    for (auto &map_name : groups_data["connections_include_order"])
+        connections_include_order.push_back(map_name.string_value());
 
     if (connections_include_order.size() > 0)
-        sort(map_names.begin(), map_names.end(), [connections_include_order](const Json &a, const Json &b) {
+        sort(map_names.begin(), map_names.end(), [&connections_include_order](StringView a, StringView b) {
             auto iter_a = find(connections_include_order.begin(), connections_include_order.end(), a);
             if (iter_a == connections_include_order.end())
                 iter_a = connections_include_order.begin() + numeric_limits<int>::max();
@@ -337,55 +377,42 @@ string generate_connections_text(Json groups_data) {
             return iter_a < iter_b;
         });
 
-    ostringstream text;
+    TextBuilder text(64 * 1024);
 
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/maps/map_groups.json\n@\n\n";
 
-    for (Json map_name : map_names)
-        text << "\t.include \"data/maps/" << map_name.string_value() << "/connections.inc\"\n";
+    for (StringView map_name : map_names)
+        text << "\t.include \"data/maps/" << map_name << "/connections.inc\"\n";
 
     return text.str();
 }
 
-string generate_headers_text(Json groups_data) {
-    vector<string> map_names;
-
-    for (auto &group : groups_data["group_order"].array_items())
-    for (auto map_name : groups_data[group.string_value()].array_items())
-        map_names.push_back(map_name.string_value());
-
-    ostringstream text;
+string generate_headers_text(const JsonValue &groups_data) {
+    TextBuilder text(64 * 1024);
 
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/maps/map_groups.json\n@\n\n";
 
-    for (string map_name : map_names)
-        text << "\t.include \"data/maps/" << map_name << "/header.inc\"\n";
+    for (auto &group : groups_data["group_order"])
+    for (auto &map_name : groups_data[group.string_value()])
+        text << "\t.include \"data/maps/" << map_name.string_value() << "/header.inc\"\n";
 
     return text.str();
 }
 
-string generate_events_text(Json groups_data) {
-    vector<string> map_names;
-
-    for (auto &group : groups_data["group_order"].array_items())
-    for (auto map_name : groups_data[group.string_value()].array_items())
-        map_names.push_back(map_name.string_value());
-
-    ostringstream text;
+string generate_events_text(const JsonValue &groups_data) {
+    TextBuilder text(64 * 1024);
 
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/maps/map_groups.json\n@\n\n";
 
-    for (string map_name : map_names)
-        text << "\t.include \"data/maps/" << map_name << "/events.inc\"\n";
+    for (auto &group : groups_data["group_order"])
+    for (auto &map_name : groups_data[group.string_value()])
+        text << "\t.include \"data/maps/" << map_name.string_value() << "/events.inc\"\n";
 
     return text.str();
 }
 
-string generate_map_constants_text(string groups_filepath, Json groups_data) {
-    string file_dir = get_directory_name(groups_filepath);
-    char dir_separator = file_dir.back();
-
-    ostringstream text;
+string generate_map_constants_text(const JsonValue &groups_data, map<string, const JsonValue *> &maps_data) {
+    TextBuilder text(64 * 1024);
 
     text << "#ifndef GUARD_CONSTANTS_MAP_GROUPS_H\n"
          << "#define GUARD_CONSTANTS_MAP_GROUPS_H\n\n";
@@ -394,23 +421,21 @@ string generate_map_constants_text(string groups_filepath, Json groups_data) {
 
     int group_num = 0;
 
-    for (auto &group : groups_data["group_order"].array_items()) {
+    for (auto &group : groups_data["group_order"]) {
         text << "// Map Group " << group_num << "\n";
-        vector<Json> map_ids;
+        vector<StringView> map_ids;
         size_t max_length = 0;
 
-        for (auto &map_name : groups_data[group.string_value()].array_items()) {
-            string header_filepath = file_dir + map_name.string_value() + dir_separator + "map.json";
-            string err_str;
-            Json map_data = Json::parse(read_text_file(header_filepath), err_str);
-            map_ids.push_back(map_data["id"]);
-            if (map_data["id"].string_value().length() > max_length)
-                max_length = map_data["id"].string_value().length();
+        for (auto &map_name : groups_data[group.string_value()]) {
+            const JsonValue &map_data = *maps_data[map_name.string_value().str()];
+            map_ids.push_back(map_data["id"].string_value());
+            if (map_data["id"].string_value().size > max_length)
+                max_length = map_data["id"].string_value().size;
         }
 
         int map_id_num = 0;
-        for (Json map_id : map_ids) {
-            text << "#define " << map_id.string_value() << string((max_length - map_id.string_value().length() + 1), ' ')
+        for (StringView map_id : map_ids) {
+            text << "#define " << map_id << string((max_length - map_id.size + 1), ' ')
                  << "(" << map_id_num++ << " | (" << group_num << " << 8))\n";
         }
         text << "\n";
@@ -424,35 +449,61 @@ string generate_map_constants_text(string groups_filepath, Json groups_data) {
     return text.str();
 }
 
-void process_groups(string groups_filepath) {
-    string err;
-    Json groups_data = Json::parse(read_text_file(groups_filepath), err);
+vector<string> get_map_names(const JsonValue &groups_data) {
+    vector<string> map_names;
 
-    if (groups_data == Json())
-        FATAL_ERROR("%s\n", err.c_str());
+    for (auto &group : groups_data["group_order"])
+    for (auto &map_name : groups_data[group.string_value()])
+        map_names.push_back(map_name.string_value().str());
 
+    return map_names;
+}
+
+string get_map_filepath(string groups_filepath, string map_name) {
+    string file_dir = get_directory_name(groups_filepath);
+    char s = file_dir.back();
+
+    return file_dir + map_name + s + "map.json";
+}
+
+void write_groups_files(string groups_filepath, const JsonValue &groups_data, map<string, const JsonValue *> &maps_data, bool skip_unchanged) {
     string groups_text = generate_groups_text(groups_data);
     string connections_text = generate_connections_text(groups_data);
     string headers_text = generate_headers_text(groups_data);
     string events_text = generate_events_text(groups_data);
-    string map_header_text = generate_map_constants_text(groups_filepath, groups_data);
+    string map_header_text = generate_map_constants_text(groups_data, maps_data);
 
     string file_dir = get_directory_name(groups_filepath);
     char s = file_dir.back();
 
-    write_text_file(file_dir + "groups.inc", groups_text);
-    write_text_file(file_dir + "connections.inc", connections_text);
-    write_text_file(file_dir + "headers.inc", headers_text);
-    write_text_file(file_dir + "events.inc", events_text);
-    write_text_file(file_dir + ".." + s + ".." + s + "include" + s + "constants" + s + "map_groups.h", map_header_text);
+    write_output_file(file_dir + "groups.inc", groups_text, skip_unchanged);
+    write_output_file(file_dir + "connections.inc", connections_text, skip_unchanged);
+    write_output_file(file_dir + "headers.inc", headers_text, skip_unchanged);
+    write_output_file(file_dir + "events.inc", events_text, skip_unchanged);
+    write_output_file(file_dir + ".." + s + ".." + s + "include" + s + "constants" + s + "map_groups.h", map_header_text, skip_unchanged);
+}
+
+void process_groups(string groups_filepath) {
+    JsonDocument groups_data = read_json_file(groups_filepath);
+    vector<string> map_names = get_map_names(groups_data.root());
+    vector<JsonDocument> map_datas;
+    map<string, const JsonValue *> maps_data;
+
+    for (string map_name : map_names)
+        map_datas.push_back(read_json_file(get_map_filepath(groups_filepath, map_name)));
+
+    for (size_t i = 0; i < map_names.size(); i++)
+        maps_data[map_names[i]] = &map_datas[i].root();
+
+    write_groups_files(groups_filepath, groups_data.root(), maps_data, false);
 }
 
-string generate_layout_headers_text(Json layouts_data) {
-    ostringstream text;
+string generate_layout_headers_text(const JsonValue &layouts_data) {
+    TextBuilder text(64 * 1024);
 
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/layouts/layouts.json\n@\n\n";
 
-    for (auto &layout : layouts_data["layouts"].array_items()) {
+    for (auto &layout : layouts_data["layouts"]) {
         string border_label = layout["name"].string_value() + "_Border";
         string blockdata_label = layout["name"].string_value() + "_Blockdata";
         text << border_label << "::\n"
@@ -472,22 +523,22 @@ string generate_layout_headers_text(Json layouts_data) {
     return text.str();
 }
 
-string generate_layouts_table_text(Json layouts_data) {
-    ostringstream text;
+string generate_layouts_table_text(const JsonValue &layouts_data) {
+    TextBuilder text(64 * 1024);
 
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/layouts/layouts.json\n@\n\n";
 
     text << "\t.align 2\n"
          << layouts_data["layouts_table_label"].string_value() << "::\n";
 
-    for (auto &layout : layouts_data["layouts"].array_items())
+    for (auto &layout : layouts_data["layouts"])
         text << "\t.4byte " << layout["name"].string_value() << "\n";
 
     return text.str();
 }
 
-string generate_layouts_constants_text(Json layouts_data) {
-    ostringstream text;
+string generate_layouts_constants_text(const JsonValue &layouts_data) {
+    TextBuilder text(64 * 1024);
 
     text << "#ifndef GUARD_CONSTANTS_LAYOUTS_H\n"
          << "#define GUARD_CONSTANTS_LAYOUTS_H\n\n";
@@ -495,7 +546,7 @@ string generate_layouts_constants_text(Json layouts_data) {
     text << "//\n// DO NOT MODIFY THIS FILE! It is auto-generated from data/layouts/layouts.json\n//\n\n";
 
     int i = 0;
-    for (auto &layout : layouts_data["layouts"].array_items())
+    for (auto &layout : layouts_data["layouts"])
         text << "#define " << layout["id"].string_value() << " " << ++i << "\n";
 
     text << "\n#endif // GUARD_CONSTANTS_LAYOUTS_H\n";
@@ -503,13 +554,7 @@ string generate_layouts_constants_text(Json layouts_data) {
     return text.str();
 }
 
-void process_layouts(string layouts_filepath) {
-    string err;
-    Json layouts_data = Json::parse(read_text_file(layouts_filepath), err);
-
-    if (layouts_data == Json())
-        FATAL_ERROR("%s\n", err.c_str());
-
+void write_layouts_files(string layouts_filepath, const JsonValue &layouts_data, bool skip_unchanged) {
     string layout_headers_text = generate_layout_headers_text(layouts_data);
     string layouts_table_text = generate_layouts_table_text(layouts_data);
     string layouts_constants_text = generate_layouts_constants_text(layouts_data);
@@ -517,9 +562,53 @@ void process_layouts(string layouts_filepath) {
     string file_dir = get_directory_name(layouts_filepath);
     char s = file_dir.back();
 
-    write_text_file(file_dir + "layouts.inc", layout_headers_text);
-    write_text_file(file_dir + "layouts_table.inc", layouts_table_text);
-    write_text_file(file_dir + ".." + s + ".." + s + "include" + s + "constants" + s + "layouts.h", layouts_constants_text);
+    write_output_file(file_dir + "layouts.inc", layout_headers_text, skip_unchanged);
+    write_output_file(file_dir + "layouts_table.inc", layouts_table_text, skip_unchanged);
+    write_output_file(file_dir + ".." + s + ".." + s + "include" + s + "constants" + s + "layouts.h", layouts_constants_text, skip_unchanged);
+}
+
+void process_layouts(string layouts_filepath) {
+    JsonDocument layouts_data = read_json_file(layouts_filepath);
+
+    write_layouts_files(layouts_filepath, layouts_data.root(), false);
+}
+
+// Does the work of the groups and layouts modes and of the map mode for
+// every map in the groups, parsing each JSON file only once. The maps are
+// spread over a pool of threads, and files that would not change are not
+// rewritten.
+void process_all(string groups_filepath, string layouts_filepath, string version, unsigned num_threads) {
+    JsonDocument groups_data = read_json_file(groups_filepath);
+    JsonDocument layouts_data = read_json_file(layouts_filepath);
+    vector<string> map_names = get_map_names(groups_data.root());
+    vector<JsonDocument> map_datas(map_names.size());
+    atomic<size_t> next_map(0);
+
+    auto process_maps = [&]() {
+        for (size_t i = next_map++; i < map_names.size(); i = next_map++) {
+            string map_filepath = get_map_filepath(groups_filepath, map_names[i]);
+            map_datas[i] = read_json_file(map_filepath);
+            write_map_files(map_filepath, map_datas[i].root(), layouts_data.root(), version, true);
+        }
+    };
+
+    vector<thread> threads;
+
+    for (unsigned i = 1; i < num_threads; i++)
+        threads.push_back(thread(process_maps));
+
+    process_maps();
+
+    for (thread &t : threads)
+        t.join();
+
+    map<string, const JsonValue *> maps_data;
+
+    for (size_t i = 0; i < map_names.size(); i++)
+        maps_data[map_names[i]] = &map_datas[i].root();
+
+    write_groups_files(groups_filepath, groups_data.root(), maps_data, true);
+    write_layouts_files(layouts_filepath, layouts_data.root(), true);
 }
 
 int main(int argc, char *argv[]) {
@@ -533,8 +622,8 @@ int main(int argc, char *argv[]) {
 
     char *mode_arg = argv[1];
     string mode(mode_arg);
-    if (mode != "layouts" && mode != "map" && mode != "groups")
-        FATAL_ERROR("ERROR: <mode> must be 'layouts', 'map', or 'groups'.\n");
+    if (mode != "layouts" && mode != "map" && mode != "groups" && mode != "all")
+        FATAL_ERROR("ERROR: <mode> must be 'layouts', 'map', 'groups', or 'all'.\n");
 
     if (mode == "map") {
         if (argc != 5)
@@ -561,6 +650,19 @@ int main(int argc, char *argv[]) {
 
         process_layouts(filepath);
     }
+    else if (mode == "all") {
+        if (argc != 5 && !(argc == 7 && string(argv[5]) == "-j"))
+            FATAL_ERROR("USAGE: mapjson all <game-version> <groups_file> <layouts_file> [-j <threads>]\n");
+
+        string groups_filepath(argv[3]);
+        string layouts_filepath(argv[4]);
+        int num_threads = (argc == 7) ? std::atoi(argv[6]) : thread::hardware_concurrency();
+
+        if (num_threads < 1)
+            num_threads = 1;
+
+        process_all(groups_filepath, layouts_filepath, version, num_threads);
+    }
 
     return 0;
 }
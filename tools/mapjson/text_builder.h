@@ -0,0 +1,55 @@
+// text_builder.h
+
+#ifndef TEXT_BUILDER_H
+#define TEXT_BUILDER_H
+
+#include <string>
+#include "json_dom.h"
+
+// Builds up generated text in a single preallocated buffer. It takes the
+// same << chains that ostringstream did, without the stream overhead.
+// Booleans are written as 0 or 1.
+class TextBuilder {
+public:
+    explicit TextBuilder(size_t capacity) { m_text.reserve(capacity); }
+
+    TextBuilder &operator<<(const char *str) { m_text.append(str); return *this; }
+    TextBuilder &operator<<(const std::string &str) { m_text.append(str); return *this; }
+    TextBuilder &operator<<(StringView str) { m_text.append(str.data, str.size); return *this; }
+    TextBuilder &operator<<(char c) { m_text.push_back(c); return *this; }
+    TextBuilder &operator<<(bool value) { m_text.push_back(value ? '1' : '0'); return *this; }
+    TextBuilder &operator<<(int value) { return append_integer(value); }
+    TextBuilder &operator<<(unsigned int value) { return append_integer(value); }
+    TextBuilder &operator<<(long value) { return append_integer(value); }
+    TextBuilder &operator<<(unsigned long value) { return append_integer(value); }
+    TextBuilder &operator<<(long long value) { return append_integer(value); }
+    TextBuilder &operator<<(unsigned long long value) { return append_integer(value); }
+
+    // Hands over the text, leaving the builder empty.
+    std::string str() { return std::move(m_text); }
+
+private:
+    std::string m_text;
+
+    template <typename T>
+    TextBuilder &append_integer(T value) {
+        char buffer[24];
+        char *end = buffer + sizeof(buffer);
+        char *pos = end;
+        bool negative = value < 0;
+
+        do {
+            int digit = static_cast<int>(value % 10);
+            *--pos = '0' + (digit < 0 ? -digit : digit);
+            value /= 10;
+        } while (value != 0);
+
+        if (negative)
+            *--pos = '-';
+
+        m_text.append(pos, end - pos);
+        return *this;
+    }
+};
+
+#endif // TEXT_BUILDER_H
@@ -21,8 +21,10 @@
 #include <cstdio>
 #include <cstdarg>
 #include <cstring>
+#include <initializer_list>
 #include <vector>
 #include "agb.h"
+#include "error.h"
 #include "main.h"
 #include "midi.h"
 #include "tables.h"
@@ -42,27 +44,62 @@ static int s_memaccOp;
 static int s_memaccParam1;
 static int s_memaccParam2;
 
+// The lengths that MPlayDef.s has wait and note commands for, in the order
+// that it numbers them: the command for s_commandLengths[i] is W00 + i, or
+// TIE + i for a note.
+static const int s_commandLengths[] =
+{
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
+    28, 30, 32, 36, 40, 42, 44, 48, 52, 54, 56, 60, 64, 66, 68, 72, 76, 78, 80, 84, 88, 90, 92, 96,
+};
+
+static int LengthIndex(int length)
+{
+    for (unsigned i = 0; i < sizeof(s_commandLengths) / sizeof(s_commandLengths[0]); i++)
+        if (s_commandLengths[i] == length)
+            return i;
+
+    RaiseError("no command for a length of %d", length);
+}
+
+static std::string LabelName(const char *format, ...)
+{
+    char name[256];
+    std::va_list args;
+    va_start(args, format);
+    std::vsnprintf(name, sizeof(name), format, args);
+    va_end(args);
+    return name;
+}
+
+static void PrintLabel(const std::string& name, bool global)
+{
+    g_output.Print("%s:\n", name.c_str());
+    g_object.DefineLabel(name, global);
+}
+
 void PrintAgbHeader()
 {
-    std::fprintf(g_outputFile, "\t.include \"MPlayDef.s\"\n\n");
-    std::fprintf(g_outputFile, "\t.equ\t%s_grp, voicegroup%03u\n", g_asmLabel.c_str(), g_voiceGroup);
-    std::fprintf(g_outputFile, "\t.equ\t%s_pri, %u\n", g_asmLabel.c_str(), g_priority);
+    g_output.Print("\t.include \"MPlayDef.s\"\n\n");
+    g_output.Print("\t.equ\t%s_grp, voicegroup%03u\n", g_asmLabel.c_str(), g_voiceGroup);
+    g_output.Print("\t.equ\t%s_pri, %u\n", g_asmLabel.c_str(), g_priority);
 
     if (g_reverb >= 0)
-        std::fprintf(g_outputFile, "\t.equ\t%s_rev, reverb_set+%u\n", g_asmLabel.c_str(), g_reverb);
+        g_output.Print("\t.equ\t%s_rev, reverb_set+%u\n", g_asmLabel.c_str(), g_reverb);
     else
-        std::fprintf(g_outputFile, "\t.equ\t%s_rev, 0\n", g_asmLabel.c_str());
+        g_output.Print("\t.equ\t%s_rev, 0\n", g_asmLabel.c_str());
 
-    std::fprintf(g_outputFile, "\t.equ\t%s_mvl, %u\n", g_asmLabel.c_str(), g_masterVolume);
-    std::fprintf(g_outputFile, "\t.equ\t%s_key, %u\n", g_asmLabel.c_str(), 0);
-    std::fprintf(g_outputFile, "\t.equ\t%s_tbs, %u\n", g_asmLabel.c_str(), g_clocksPerBeat);
-    std::fprintf(g_outputFile, "\t.equ\t%s_exg, %u\n", g_asmLabel.c_str(), g_exactGateTime);
-    std::fprintf(g_outputFile, "\t.equ\t%s_cmp, %u\n", g_asmLabel.c_str(), g_compressionEnabled);
+    g_output.Print("\t.equ\t%s_mvl, %u\n", g_asmLabel.c_str(), g_masterVolume);
+    g_output.Print("\t.equ\t%s_key, %u\n", g_asmLabel.c_str(), 0);
+    g_output.Print("\t.equ\t%s_tbs, %u\n", g_asmLabel.c_str(), g_clocksPerBeat);
+    g_output.Print("\t.equ\t%s_exg, %u\n", g_asmLabel.c_str(), g_exactGateTime);
+    g_output.Print("\t.equ\t%s_cmp, %u\n", g_asmLabel.c_str(), g_compressionEnabled);
 
-    std::fprintf(g_outputFile, "\n\t.section .rodata\n");
-    std::fprintf(g_outputFile, "\t.global\t%s\n", g_asmLabel.c_str());
+    g_output.Print("\n\t.section .rodata\n");
+    g_output.Print("\t.global\t%s\n", g_asmLabel.c_str());
 
-    std::fprintf(g_outputFile, "\t.align\t2\n");
+    g_output.Print("\t.align\t2\n");
+    g_object.Align(4);
 }
 
 void ResetTrackVars()
@@ -80,66 +117,72 @@ void PrintWait(int wait)
 {
     if (wait > 0)
     {
-        std::fprintf(g_outputFile, "\t.byte\tW%02d\n", wait);
+        g_output.Print("\t.byte\tW%02d\n", wait);
+        g_object.Byte(0x80 + LengthIndex(wait));
         s_velocityChanged = true;
         s_noteChanged = true;
         s_keepLastOpName = true;
     }
 }
 
-void PrintOp(int wait, std::string name, const char *format, ...)
+// argBytes are the object bytes for the text that format gives. The command
+// byte is left out whenever the name is.
+void PrintOp(int wait, std::string name, int command, std::initializer_list<int> argBytes, const char *format, ...)
 {
     std::va_list args;
     va_start(args, format);
-    std::fprintf(g_outputFile, "\t.byte\t\t");
+    g_output.Print("\t.byte\t\t");
 
     if (format != nullptr)
     {
         if (!g_compressionEnabled || s_lastOpName != name)
         {
-            std::fprintf(g_outputFile, "%s, ", name.c_str());
+            g_output.Print("%s, ", name.c_str());
+            g_object.Byte(command);
             s_lastOpName = name;
         }
         else
         {
-            std::fprintf(g_outputFile, "        ");
+            g_output.Print("        ");
         }
-        std::vfprintf(g_outputFile, format, args);
+        g_output.VPrint(format, args);
+
+        for (int value : argBytes)
+            g_object.Byte(value);
     }
     else
     {
-        std::fputs(name.c_str(), g_outputFile);
+        g_output.Write(name.c_str(), name.size());
+        g_object.Byte(command);
         s_lastOpName = name;
     }
 
-    std::fprintf(g_outputFile, "\n");
+    g_output.Print("\n");
 
     va_end(args);
 
     PrintWait(wait);
 }
 
-void PrintByte(const char *format, ...)
+void PrintByte(std::initializer_list<int> bytes, const char *format, ...)
 {
     std::va_list args;
     va_start(args, format);
-    std::fprintf(g_outputFile, "\t.byte\t");
-    std::vfprintf(g_outputFile, format, args);
-    std::fprintf(g_outputFile, "\n");
+    g_output.Print("\t.byte\t");
+    g_output.VPrint(format, args);
+    g_output.Print("\n");
+    for (int value : bytes)
+        g_object.Byte(value);
     s_velocityChanged = true;
     s_noteChanged = true;
     s_keepLastOpName = true;
     va_end(args);
 }
 
-void PrintWord(const char *format, ...)
+void PrintWord(const std::string& label)
 {
-    std::va_list args;
-    va_start(args, format);
-    std::fprintf(g_outputFile, "\t .word\t");
-    std::vfprintf(g_outputFile, format, args);
-    std::fprintf(g_outputFile, "\n");
-    va_end(args);
+    g_output.Print("\t .word\t%s\n", label.c_str());
+    g_object.Word(label);
 }
 
 void PrintNote(const Event& event)
@@ -164,11 +207,18 @@ void PrintNote(const Event& event)
         gtpBuf[0] = 0;
 
     char opName[16];
+    int command;
 
     if (duration == -1)
+    {
         std::strcpy(opName, "TIE   ");
+        command = 0xCF;
+    }
     else
+    {
         std::snprintf(opName, sizeof(opName), "N%02u   ", duration);
+        command = 0xCF + LengthIndex(duration);
+    }
 
     bool noteChanged = true;
     bool velocityChanged = true;
@@ -207,11 +257,16 @@ void PrintNote(const Event& event)
             velocityBuf[0] = 0;
         }
 
-        PrintOp(event.time, opName, "%s%s%s", noteBuf, velocityBuf, gtpBuf);
+        if (velocityBuf[0] == 0)
+            PrintOp(event.time, opName, command, { note }, "%s%s%s", noteBuf, velocityBuf, gtpBuf);
+        else if (gateTimeParam <= 0)
+            PrintOp(event.time, opName, command, { note, velocity }, "%s%s%s", noteBuf, velocityBuf, gtpBuf);
+        else
+            PrintOp(event.time, opName, command, { note, velocity, gateTimeParam }, "%s%s%s", noteBuf, velocityBuf, gtpBuf);
     }
     else
     {
-        PrintOp(event.time, opName, 0);
+        PrintOp(event.time, opName, command, {}, nullptr);
     }
 
     s_noteChanged = noteChanged;
@@ -228,15 +283,15 @@ void PrintEndOfTieOp(const Event& event)
 
     if (!noteChanged && g_compressionEnabled)
     {
-        PrintOp(event.time, "EOT   ", nullptr);
+        PrintOp(event.time, "EOT   ", 0xCE, {}, nullptr);
     }
     else
     {
         s_lastNote = note;
         if (note >= 24)
-            PrintOp(event.time, "EOT   ", g_noteTable[note % 12], note / 12 - 2);
+            PrintOp(event.time, "EOT   ", 0xCE, { note }, g_noteTable[note % 12], note / 12 - 2);
         else
-            PrintOp(event.time, "EOT   ", g_minusNoteTable[note % 12], note / -12 + 2);
+            PrintOp(event.time, "EOT   ", 0xCE, { note }, g_minusNoteTable[note % 12], note / -12 + 2);
     }
 
     s_noteChanged = noteChanged;
@@ -245,7 +300,7 @@ void PrintEndOfTieOp(const Event& event)
 void PrintSeqLoopLabel(const Event& event)
 {
     s_blockNum = event.param1 + 1;
-    std::fprintf(g_outputFile, "%s_%u_B%u:\n", g_asmLabel.c_str(), g_agbTrack, s_blockNum);
+    PrintLabel(LabelName("%s_%u_B%u", g_asmLabel.c_str(), g_agbTrack, s_blockNum), false);
     PrintWait(event.time);
     ResetTrackVars();
 }
@@ -255,22 +310,22 @@ void PrintMemAcc(const Event& event)
     switch (s_memaccOp)
     {
     case 0x00:
-        PrintByte("MEMACC, mem_set, 0x%02X, %u", s_memaccParam1, event.param2);
+        PrintByte({ 0xB9, 0, s_memaccParam1, event.param2 }, "MEMACC, mem_set, 0x%02X, %u", s_memaccParam1, event.param2);
         break;
     case 0x01:
-        PrintByte("MEMACC, mem_add, 0x%02X, %u", s_memaccParam1, event.param2);
+        PrintByte({ 0xB9, 1, s_memaccParam1, event.param2 }, "MEMACC, mem_add, 0x%02X, %u", s_memaccParam1, event.param2);
         break;
     case 0x02:
-        PrintByte("MEMACC, mem_sub, 0x%02X, %u", s_memaccParam1, event.param2);
+        PrintByte({ 0xB9, 2, s_memaccParam1, event.param2 }, "MEMACC, mem_sub, 0x%02X, %u", s_memaccParam1, event.param2);
         break;
     case 0x03:
-        PrintByte("MEMACC, mem_mem_set, 0x%02X, 0x%02X", s_memaccParam1, event.param2);
+        PrintByte({ 0xB9, 3, s_memaccParam1, event.param2 }, "MEMACC, mem_mem_set, 0x%02X, 0x%02X", s_memaccParam1, event.param2);
         break;
     case 0x04:
-        PrintByte("MEMACC, mem_mem_add, 0x%02X, 0x%02X", s_memaccParam1, event.param2);
+        PrintByte({ 0xB9, 4, s_memaccParam1, event.param2 }, "MEMACC, mem_mem_add, 0x%02X, 0x%02X", s_memaccParam1, event.param2);
         break;
     case 0x05:
-        PrintByte("MEMACC, mem_mem_sub, 0x%02X, 0x%02X", s_memaccParam1, event.param2);
+        PrintByte({ 0xB9, 5, s_memaccParam1, event.param2 }, "MEMACC, mem_mem_sub, 0x%02X, 0x%02X", s_memaccParam1, event.param2);
         break;
     // TODO: everything else
     case 0x06:
@@ -335,10 +390,10 @@ void PrintExtendedOp(const Event& event)
     switch (s_extendedCommand)
     {
     case 0x08:
-        PrintOp(event.time, "XCMD  ", "xIECV , %u", event.param2);
+        PrintOp(event.time, "XCMD  ", 0xCD, { 0x08, event.param2 }, "xIECV , %u", event.param2);
         break;
     case 0x09:
-        PrintOp(event.time, "XCMD  ", "xIECL , %u", event.param2);
+        PrintOp(event.time, "XCMD  ", 0xCD, { 0x09, event.param2 }, "xIECL , %u", event.param2);
         break;
     default:
         PrintWait(event.time);
@@ -351,13 +406,13 @@ void PrintControllerOp(const Event& event)
     switch (event.param1)
     {
     case 0x01:
-        PrintOp(event.time, "MOD   ", "%u", event.param2);
+        PrintOp(event.time, "MOD   ", 0xC4, { event.param2 }, "%u", event.param2);
         break;
     case 0x07:
-        PrintOp(event.time, "VOL   ", "%u*%s_mvl/mxv", event.param2, g_asmLabel.c_str());
+        PrintOp(event.time, "VOL   ", 0xBE, { event.param2 * g_masterVolume / 0x7F }, "%u*%s_mvl/mxv", event.param2, g_asmLabel.c_str());
         break;
     case 0x0A:
-        PrintOp(event.time, "PAN   ", "c_v%+d", event.param2 - 64);
+        PrintOp(event.time, "PAN   ", 0xBF, { event.param2 }, "c_v%+d", event.param2 - 64);
         break;
     case 0x0C:
     case 0x10:
@@ -376,24 +431,24 @@ void PrintControllerOp(const Event& event)
         PrintWait(event.time);
         break;
     case 0x11:
-        std::fprintf(g_outputFile, "%s_%u_L%u:\n", g_asmLabel.c_str(), g_agbTrack, event.param2);
+        PrintLabel(LabelName("%s_%u_L%u", g_asmLabel.c_str(), g_agbTrack, event.param2), false);
         PrintWait(event.time);
         ResetTrackVars();
         break;
     case 0x14:
-        PrintOp(event.time, "BENDR ", "%u", event.param2);
+        PrintOp(event.time, "BENDR ", 0xC1, { event.param2 }, "%u", event.param2);
         break;
     case 0x15:
-        PrintOp(event.time, "LFOS  ", "%u", event.param2);
+        PrintOp(event.time, "LFOS  ", 0xC2, { event.param2 }, "%u", event.param2);
         break;
     case 0x16:
-        PrintOp(event.time, "MODT  ", "%u", event.param2);
+        PrintOp(event.time, "MODT  ", 0xC5, { event.param2 }, "%u", event.param2);
         break;
     case 0x18:
-        PrintOp(event.time, "TUNE  ", "c_v%+d", event.param2 - 64);
+        PrintOp(event.time, "TUNE  ", 0xC8, { event.param2 }, "c_v%+d", event.param2 - 64);
         break;
     case 0x1A:
-        PrintOp(event.time, "LFODL ", "%u", event.param2);
+        PrintOp(event.time, "LFODL ", 0xC3, { event.param2 }, "%u", event.param2);
         break;
     case 0x1D:
     case 0x1F:
@@ -405,7 +460,7 @@ void PrintControllerOp(const Event& event)
         break;
     case 0x21:
     case 0x27:
-        PrintByte("PRIO  , %u", event.param2);
+        PrintByte({ 0xBA, event.param2 }, "PRIO  , %u", event.param2);
         PrintWait(event.time);
         break;
     default:
@@ -416,8 +471,8 @@ void PrintControllerOp(const Event& event)
 
 void PrintAgbTrack(std::vector<Event>& events)
 {
-    std::fprintf(g_outputFile, "\n@**************** Track %u (Midi-Chn.%u) ****************@\n\n", g_agbTrack, g_midiChan + 1);
-    std::fprintf(g_outputFile, "%s_%u:\n", g_asmLabel.c_str(), g_agbTrack);
+    g_output.Print("\n@**************** Track %u (Midi-Chn.%u) ****************@\n\n", g_agbTrack, g_midiChan + 1);
+    PrintLabel(LabelName("%s_%u", g_asmLabel.c_str(), g_agbTrack), false);
 
     int wholeNoteCount = 0;
     int loopEndBlockNum = 0;
@@ -439,10 +494,10 @@ void PrintAgbTrack(std::vector<Event>& events)
     }
 
     if (!foundVolBeforeNote)
-        PrintByte("\tVOL   , 127*%s_mvl/mxv", g_asmLabel.c_str());
+        PrintByte({ 0xBE, 127 * g_masterVolume / 0x7F }, "\tVOL   , 127*%s_mvl/mxv", g_asmLabel.c_str());
 
     PrintWait(g_initialWait);
-    PrintByte("KEYSH , %s_key%+d", g_asmLabel.c_str(), 0);
+    PrintByte({ 0xBC, 0 }, "KEYSH , %s_key%+d", g_asmLabel.c_str(), 0);
 
     for (unsigned i = 0; events[i].type != EventType::EndOfTrack; i++)
     {
@@ -451,12 +506,12 @@ void PrintAgbTrack(std::vector<Event>& events)
         if (IsPatternBoundary(event.type))
         {
             if (s_inPattern)
-                PrintByte("PEND");
+                PrintByte({ 0xB4 }, "PEND");
             s_inPattern = false;
         }
 
         if (event.type == EventType::WholeNoteMark || event.type == EventType::Pattern)
-            std::fprintf(g_outputFile, "@ %03d   ----------------------------------------\n", wholeNoteCount++);
+            g_output.Print("@ %03d   ----------------------------------------\n", wholeNoteCount++);
 
         switch (event.type)
         {
@@ -470,13 +525,13 @@ void PrintAgbTrack(std::vector<Event>& events)
             PrintSeqLoopLabel(event);
             break;
         case EventType::LoopEnd:
-            PrintByte("GOTO");
-            PrintWord("%s_%u_B%u", g_asmLabel.c_str(), g_agbTrack, loopEndBlockNum);
+            PrintByte({ 0xB2 }, "GOTO");
+            PrintWord(LabelName("%s_%u_B%u", g_asmLabel.c_str(), g_agbTrack, loopEndBlockNum));
             PrintSeqLoopLabel(event);
             break;
         case EventType::LoopEndBegin:
-            PrintByte("GOTO");
-            PrintWord("%s_%u_B%u", g_asmLabel.c_str(), g_agbTrack, loopEndBlockNum);
+            PrintByte({ 0xB2 }, "GOTO");
+            PrintWord(LabelName("%s_%u_B%u", g_asmLabel.c_str(), g_agbTrack, loopEndBlockNum));
             PrintSeqLoopLabel(event);
             loopEndBlockNum = s_blockNum;
             break;
@@ -487,15 +542,15 @@ void PrintAgbTrack(std::vector<Event>& events)
         case EventType::WholeNoteMark:
             if (event.param2 & 0x80000000)
             {
-                std::fprintf(g_outputFile, "%s_%u_%03lu:\n", g_asmLabel.c_str(), g_agbTrack, (unsigned long)(event.param2 & 0x7FFFFFFF));
+                PrintLabel(LabelName("%s_%u_%03lu", g_asmLabel.c_str(), g_agbTrack, (unsigned long)(event.param2 & 0x7FFFFFFF)), false);
                 ResetTrackVars();
                 s_inPattern = true;
             }
             PrintWait(event.time);
             break;
         case EventType::Pattern:
-            PrintByte("PATT");
-            PrintWord("%s_%u_%03lu", g_asmLabel.c_str(), g_agbTrack, event.param2);
+            PrintByte({ 0xB3 }, "PATT");
+            PrintWord(LabelName("%s_%u_%03lu", g_asmLabel.c_str(), g_agbTrack, (unsigned long)event.param2));
 
             while (!IsPatternBoundary(events[i + 1].type))
                 i++;
@@ -503,14 +558,14 @@ void PrintAgbTrack(std::vector<Event>& events)
             ResetTrackVars();
             break;
         case EventType::Tempo:
-            PrintByte("TEMPO , %u*%s_tbs/2", 60000000 / event.param2, g_asmLabel.c_str());
+            PrintByte({ 0xBB, 60000000 / event.param2 * g_clocksPerBeat / 2 }, "TEMPO , %u*%s_tbs/2", 60000000 / event.param2, g_asmLabel.c_str());
             PrintWait(event.time);
             break;
         case EventType::InstrumentChange:
-            PrintOp(event.time, "VOICE ", "%u", event.param1);
+            PrintOp(event.time, "VOICE ", 0xBD, { event.param1 }, "%u", event.param1);
             break;
         case EventType::PitchBend:
-            PrintOp(event.time, "BEND  ", "c_v%+d", event.param2 - 64);
+            PrintOp(event.time, "BEND  ", 0xC0, { event.param2 }, "c_v%+d", event.param2 - 64);
             break;
         case EventType::Controller:
             PrintControllerOp(event);
@@ -521,27 +576,37 @@ void PrintAgbTrack(std::vector<Event>& events)
         }
     }
 
-    PrintByte("FINE");
+    PrintByte({ 0xB1 }, "FINE");
 }
 
 void PrintAgbFooter()
 {
     int trackCount = g_agbTrack - 1;
 
-    std::fprintf(g_outputFile, "\n@******************************************************@\n");
-    std::fprintf(g_outputFile, "\t.align\t2\n");
-    std::fprintf(g_outputFile, "\n%s:\n", g_asmLabel.c_str());
-    std::fprintf(g_outputFile, "\t.byte\t%u\t@ NumTrks\n", trackCount);
-    std::fprintf(g_outputFile, "\t.byte\t%u\t@ NumBlks\n", 0);
-    std::fprintf(g_outputFile, "\t.byte\t%s_pri\t@ Priority\n", g_asmLabel.c_str());
-    std::fprintf(g_outputFile, "\t.byte\t%s_rev\t@ Reverb.\n", g_asmLabel.c_str());
-    std::fprintf(g_outputFile, "\n");
-    std::fprintf(g_outputFile, "\t.word\t%s_grp\n", g_asmLabel.c_str());
-    std::fprintf(g_outputFile, "\n");
+    g_output.Print("\n@******************************************************@\n");
+    g_output.Print("\t.align\t2\n");
+    g_object.Align(4);
+    g_output.Print("\n");
+    PrintLabel(g_asmLabel, true);
+    g_output.Print("\t.byte\t%u\t@ NumTrks\n", trackCount);
+    g_output.Print("\t.byte\t%u\t@ NumBlks\n", 0);
+    g_output.Print("\t.byte\t%s_pri\t@ Priority\n", g_asmLabel.c_str());
+    g_output.Print("\t.byte\t%s_rev\t@ Reverb.\n", g_asmLabel.c_str());
+    g_object.Byte(trackCount);
+    g_object.Byte(0);
+    g_object.Byte(g_priority);
+    g_object.Byte(g_reverb >= 0 ? 0x80 + g_reverb : 0);
+    g_output.Print("\n");
+    g_output.Print("\t.word\t%s_grp\n", g_asmLabel.c_str());
+    g_object.Word(LabelName("voicegroup%03u", g_voiceGroup));
+    g_output.Print("\n");
 
     // track pointers
     for (int i = 1; i <= trackCount; i++)
-        std::fprintf(g_outputFile, "\t.word\t%s_%u\n", g_asmLabel.c_str(), i);
+    {
+        g_output.Print("\t.word\t%s_%u\n", g_asmLabel.c_str(), i);
+        g_object.Word(LabelName("%s_%u", g_asmLabel.c_str(), i));
+    }
 
-    std::fprintf(g_outputFile, "\n\t.end\n");
+    g_output.Print("\n\t.end\n");
 }
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include "elf_object.h"
+#include "error.h"
+#include "output_buffer.h"
+
+// Just the parts of the ELF format that the object needs.
+static const int kElfHeaderSize = 52;
+static const int kSectionHeaderSize = 40;
+static const int kSymbolSize = 16;
+static const int kRelocationSize = 8;
+
+static const int kEmArm = 40;
+static const std::uint32_t kEfArmEabiVer5 = 0x05000000;
+
+static const int kShtProgbits = 1;
+static const int kShtSymtab = 2;
+static const int kShtStrtab = 3;
+static const int kShtRel = 9;
+static const int kShfAlloc = 0x2;
+static const int kShfInfoLink = 0x40;
+
+static const int kStbLocal = 0;
+static const int kStbGlobal = 1;
+static const int kSttNotype = 0;
+static const int kSttSection = 3;
+
+static const int kRArmAbs32 = 2;
+
+// Section indices, in the order that the section headers are written.
+enum
+{
+    kSectionNull,
+    kSectionRodata,
+    kSectionRelRodata,
+    kSectionSymtab,
+    kSectionStrtab,
+    kSectionShstrtab,
+    kSectionCount
+};
+
+static void Put16(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+    out.push_back(value & 0xFF);
+    out.push_back((value >> 8) & 0xFF);
+}
+
+static void Put32(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+    Put16(out, value & 0xFFFF);
+    Put16(out, value >> 16);
+}
+
+static void PadTo(std::vector<std::uint8_t>& out, std::size_t alignment)
+{
+    while (out.size() % alignment != 0)
+        out.push_back(0);
+}
+
+static std::uint32_t AddString(std::vector<std::uint8_t>& table, const std::string& s)
+{
+    std::uint32_t offset = table.size();
+    table.insert(table.end(), s.begin(), s.end());
+    table.push_back(0);
+    return offset;
+}
+
+static void PutSymbol(std::vector<std::uint8_t>& out, std::uint32_t name, std::uint32_t value, int bind, int type, int section)
+{
+    Put32(out, name);
+    Put32(out, value);
+    Put32(out, 0);
+    out.push_back((bind << 4) | type);
+    out.push_back(0);
+    Put16(out, section);
+}
+
+static void PutSectionHeader(std::vector<std::uint8_t>& out, std::uint32_t name, int type, int flags,
+    std::uint32_t offset, std::uint32_t size, int link, int info, int alignment, int entrySize)
+{
+    Put32(out, name);
+    Put32(out, type);
+    Put32(out, flags);
+    Put32(out, 0);
+    Put32(out, offset);
+    Put32(out, size);
+    Put32(out, link);
+    Put32(out, info);
+    Put32(out, alignment);
+    Put32(out, entrySize);
+}
+
+void ElfObject::Word(const std::string& symbol)
+{
+    m_relocations.push_back({ (std::uint32_t)m_data.size(), symbol });
+    m_data.insert(m_data.end(), 4, 0);
+}
+
+// Pads with zeros, as .align does outside of code.
+void ElfObject::Align(int alignment)
+{
+    while (m_data.size() % alignment != 0)
+        m_data.push_back(0);
+}
+
+void ElfObject::DefineLabel(const std::string& name, bool global)
+{
+    if (!m_labelIndices.emplace(name, m_labels.size()).second)
+        RaiseError("label \"%s\" is defined more than once", name.c_str());
+
+    m_labels.push_back({ name, (std::uint32_t)m_data.size(), global });
+}
+
+// Pointers to local labels are relocated against the section symbol with the
+// label's offset stored in place, and all others against their own symbol,
+// the same way the assembler does it.
+bool ElfObject::WriteToFile(const std::string& path, bool onlyIfChanged) const
+{
+    std::vector<std::uint8_t> data = m_data;
+    std::vector<std::uint8_t> strtab(1, 0);
+    std::vector<std::uint8_t> symtab;
+    std::vector<std::uint8_t> rel;
+    std::vector<std::uint32_t> labelSymbols(m_labels.size());
+    std::unordered_map<std::string, std::uint32_t> undefinedIndices;
+
+    symtab.insert(symtab.end(), kSymbolSize, 0);
+    PutSymbol(symtab, 0, 0, kStbLocal, kSttSection, kSectionRodata);
+
+    std::uint32_t symbolCount = 2;
+
+    for (std::size_t i = 0; i < m_labels.size(); i++)
+    {
+        if (!m_labels[i].global)
+        {
+            PutSymbol(symtab, AddString(strtab, m_labels[i].name), m_labels[i].offset, kStbLocal, kSttNotype, kSectionRodata);
+            labelSymbols[i] = symbolCount++;
+        }
+    }
+
+    std::uint32_t firstGlobal = symbolCount;
+
+    for (std::size_t i = 0; i < m_labels.size(); i++)
+    {
+        if (m_labels[i].global)
+        {
+            PutSymbol(symtab, AddString(strtab, m_labels[i].name), m_labels[i].offset, kStbGlobal, kSttNotype, kSectionRodata);
+            labelSymbols[i] = symbolCount++;
+        }
+    }
+
+    for (const Relocation& relocation : m_relocations)
+    {
+        std::uint32_t symbol;
+        auto label = m_labelIndices.find(relocation.symbol);
+
+        if (label == m_labelIndices.end())
+        {
+            auto undefined = undefinedIndices.find(relocation.symbol);
+
+            if (undefined == undefinedIndices.end())
+            {
+                PutSymbol(symtab, AddString(strtab, relocation.symbol), 0, kStbGlobal, kSttNotype, 0);
+                undefined = undefinedIndices.emplace(relocation.symbol, symbolCount++).first;
+            }
+
+            symbol = undefined->second;
+        }
+        else if (m_labels[label->second].global)
+        {
+            symbol = labelSymbols[label->second];
+        }
+        else
+        {
+            std::uint32_t offset = m_labels[label->second].offset;
+
+            for (int i = 0; i < 4; i++)
+                data[relocation.offset + i] = (offset >> (8 * i)) & 0xFF;
+
+            symbol = 1;
+        }
+
+        Put32(rel, relocation.offset);
+        Put32(rel, (symbol << 8) | kRArmAbs32);
+    }
+
+    std::vector<std::uint8_t> shstrtab(1, 0);
+    std::uint32_t rodataName = AddString(shstrtab, ".rodata");
+    std::uint32_t relRodataName = AddString(shstrtab, ".rel.rodata");
+    std::uint32_t symtabName = AddString(shstrtab, ".symtab");
+    std::uint32_t strtabName = AddString(shstrtab, ".strtab");
+    std::uint32_t shstrtabName = AddString(shstrtab, ".shstrtab");
+
+    std::vector<std::uint8_t> out;
+
+    out.reserve(kElfHeaderSize + data.size() + rel.size() + symtab.size() + strtab.size() + shstrtab.size()
+        + kSectionCount * kSectionHeaderSize + 16);
+    out.resize(kElfHeaderSize);
+
+    std::uint32_t rodataOffset = out.size();
+    out.insert(out.end(), data.begin(), data.end());
+
+    PadTo(out, 4);
+    std::uint32_t relOffset = out.size();
+    out.insert(out.end(), rel.begin(), rel.end());
+
+    std::uint32_t symtabOffset = out.size();
+    out.insert(out.end(), symtab.begin(), symtab.end());
+
+    std::uint32_t strtabOffset = out.size();
+    out.insert(out.end(), strtab.begin(), strtab.end());
+
+    std::uint32_t shstrtabOffset = out.size();
+    out.insert(out.end(), shstrtab.begin(), shstrtab.end());
+
+    PadTo(out, 4);
+    std::uint32_t sectionHeaderOffset = out.size();
+
+    out.insert(out.end(), kSectionHeaderSize, 0);
+    PutSectionHeader(out, rodataName, kShtProgbits, kShfAlloc, rodataOffset, data.size(), 0, 0, 4, 0);
+    PutSectionHeader(out, relRodataName, kShtRel, kShfInfoLink, relOffset, rel.size(),
+        kSectionSymtab, kSectionRodata, 4, kRelocationSize);
+    PutSectionHeader(out, symtabName, kShtSymtab, 0, symtabOffset, symtab.size(),
+        kSectionStrtab, firstGlobal, 4, kSymbolSize);
+    PutSectionHeader(out, strtabName, kShtStrtab, 0, strtabOffset, strtab.size(), 0, 0, 1, 0);
+    PutSectionHeader(out, shstrtabName, kShtStrtab, 0, shstrtabOffset, shstrtab.size(), 0, 0, 1, 0);
+
+    std::vector<std::uint8_t> header;
+    static const std::uint8_t ident[16] = { 0x7F, 'E', 'L', 'F', 1, 1, 1 };
+
+    header.insert(header.end(), ident, ident + 16);
+    Put16(header, 1); // ET_REL
+    Put16(header, kEmArm);
+    Put32(header, 1); // EV_CURRENT
+    Put32(header, 0);
+    Put32(header, 0);
+    Put32(header, sectionHeaderOffset);
+    Put32(header, kEfArmEabiVer5);
+    Put16(header, kElfHeaderSize);
+    Put16(header, 0);
+    Put16(header, 0);
+    Put16(header, kSectionHeaderSize);
+    Put16(header, kSectionCount);
+    Put16(header, kSectionShstrtab);
+
+    std::copy(header.begin(), header.end(), out.begin());
+
+    return WriteOutputFile(path, out.data(), out.size(), true, onlyIfChanged);
+}
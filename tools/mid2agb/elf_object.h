@@ -0,0 +1,50 @@
+#ifndef ELF_OBJECT_H
+#define ELF_OBJECT_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Builds a relocatable ARM ELF object holding a single .rodata section, which
+// is what assembling the generated song with MPlayDef.s would give, so the
+// song can be linked without going through the assembler.
+class ElfObject
+{
+public:
+    ElfObject() { m_data.reserve(1 << 14); }
+
+    // Only the low 8 bits of value are kept, as with .byte.
+    void Byte(int value) { m_data.push_back((std::uint8_t)value); }
+
+    // A 32-bit pointer to symbol. If a label of that name is defined by the
+    // time the object is written, the pointer is relocated against it, and
+    // otherwise against an undefined symbol of that name.
+    void Word(const std::string& symbol);
+
+    void Align(int alignment);
+    void DefineLabel(const std::string& name, bool global);
+
+    bool WriteToFile(const std::string& path, bool onlyIfChanged) const;
+
+private:
+    struct Label
+    {
+        std::string name;
+        std::uint32_t offset;
+        bool global;
+    };
+
+    struct Relocation
+    {
+        std::uint32_t offset;
+        std::string symbol;
+    };
+
+    std::vector<std::uint8_t> m_data;
+    std::vector<Label> m_labels;
+    std::unordered_map<std::string, std::size_t> m_labelIndices;
+    std::vector<Relocation> m_relocations;
+};
+
+#endif // ELF_OBJECT_H
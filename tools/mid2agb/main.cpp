@@ -25,13 +25,22 @@
 #include <cassert>
 #include <string>
 #include <set>
+#include <vector>
 #include "main.h"
 #include "error.h"
 #include "midi.h"
 #include "agb.h"
+#include "mapped_file.h"
 
-FILE* g_inputFile = nullptr;
-FILE* g_outputFile = nullptr;
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+const std::uint8_t* g_inputData = nullptr;
+long g_inputSize = 0;
+OutputBuffer g_output;
+ElfObject g_object;
 
 std::string g_asmLabel;
 int g_masterVolume = 127;
@@ -49,6 +58,7 @@ bool g_compressionEnabled = true;
         "\n"
         "    input_file  filename(.mid) of MIDI file\n"
         "   output_file  filename(.s) for AGB file (default:input_file)\n"
+        "                or filename(.o) for an ELF object to link directly\n"
         "\n"
         "options  -L???  label for assembler (default:output_file)\n"
         "         -V???  master volume (default:127)\n"
@@ -58,6 +68,12 @@ bool g_compressionEnabled = true;
         "            -X  48 clocks/beat (default:24 clocks/beat)\n"
         "            -E  exact gate-time\n"
         "            -N  no compression\n"
+        "\n"
+        "Usage: MID2AGB --batch manifest_file [-j threads]\n"
+        "\n"
+        "    Converts one file per line of the manifest (\"-\" for stdin),\n"
+        "    where each line holds the arguments above. Outputs that would\n"
+        "    not change are left untouched.\n"
     );
     std::exit(1);
 }
@@ -127,7 +143,9 @@ static const char *GetArgument(int argc, char **argv, int& index)
     }
 }
 
-int main(int argc, char** argv)
+// Converts the single song that the command line describes. This uses the
+// global state of the converter, so it can only be done once per process.
+static void ConvertSong(int argc, char** argv, bool onlyIfChanged)
 {
     std::string inputFilename;
     std::string outputFilename;
@@ -205,29 +223,139 @@ int main(int argc, char** argv)
     if (outputFilename.empty())
         outputFilename = StripExtension(inputFilename) + ".s";
 
-    if (GetExtension(outputFilename) != "s")
-        RaiseError("output filename extension is not \"s\"");
+    std::string outputExtension = GetExtension(outputFilename);
+
+    if (outputExtension != "s" && outputExtension != "o")
+        RaiseError("output filename extension is not \"s\" or \"o\"");
 
     if (g_asmLabel.empty())
         g_asmLabel = BaseName(outputFilename);
 
-    g_inputFile = std::fopen(inputFilename.c_str(), "rb");
+    MappedFile inputFile(inputFilename);
 
-    if (g_inputFile == nullptr)
+    if (!inputFile.IsOpen())
         RaiseError("failed to open \"%s\" for reading", inputFilename.c_str());
 
-    g_outputFile = std::fopen(outputFilename.c_str(), "w");
-
-    if (g_outputFile == nullptr)
-        RaiseError("failed to open \"%s\" for writing", outputFilename.c_str());
+    g_inputData = inputFile.Data();
+    g_inputSize = inputFile.Size();
 
     ReadMidiFileHeader();
     PrintAgbHeader();
     ReadMidiTracks();
     PrintAgbFooter();
 
-    std::fclose(g_inputFile);
-    std::fclose(g_outputFile);
+    bool written;
+
+    if (outputExtension == "o")
+        written = g_object.WriteToFile(outputFilename, onlyIfChanged);
+    else
+        written = g_output.WriteToFile(outputFilename, onlyIfChanged);
+
+    if (!written)
+        RaiseError("failed to write \"%s\"", outputFilename.c_str());
+}
+
+#ifndef _WIN32
+
+// Converts every song in the manifest, each in a child process of its own
+// so that it starts from fresh converter state, with up to numJobs of them
+// running at once. Returns the exit status for the whole batch.
+static int RunBatch(const char* manifestFilename, int numJobs)
+{
+    std::FILE* fp = std::strcmp(manifestFilename, "-") == 0 ? stdin : std::fopen(manifestFilename, "r");
+
+    if (fp == nullptr)
+        RaiseError("failed to open \"%s\" for reading", manifestFilename);
+
+    std::vector<std::vector<std::string>> songs;
+    char line[4096];
+
+    while (std::fgets(line, sizeof(line), fp))
+    {
+        std::vector<std::string> args(1, "mid2agb");
+
+        for (char* arg = std::strtok(line, " \t\r\n"); arg != nullptr; arg = std::strtok(nullptr, " \t\r\n"))
+            args.push_back(arg);
+
+        if (args.size() > 1 && args[1][0] != '#')
+            songs.push_back(args);
+    }
+
+    if (fp != stdin)
+        std::fclose(fp);
+
+    std::fflush(nullptr);
+
+    int running = 0;
+    bool failed = false;
+
+    for (std::size_t i = 0; i < songs.size() || running > 0; )
+    {
+        if (i < songs.size() && running < numJobs && !failed)
+        {
+            pid_t pid = fork();
+
+            if (pid < 0)
+                RaiseError("failed to start a process for \"%s\"", songs[i][1].c_str());
+
+            if (pid == 0)
+            {
+                std::vector<char*> argv;
+
+                for (std::string& arg : songs[i])
+                    argv.push_back(&arg[0]);
+                argv.push_back(nullptr);
+
+                ConvertSong(argv.size() - 1, argv.data(), true);
+                std::exit(0);
+            }
+
+            running++;
+            i++;
+            continue;
+        }
+
+        if (running == 0)
+            break;
+
+        int status;
+
+        if (wait(&status) < 0)
+            RaiseError("failed to wait for a conversion");
+
+        running--;
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed = true;
+    }
+
+    return failed ? 1 : 0;
+}
+
+#endif // _WIN32
+
+int main(int argc, char** argv)
+{
+    if (argc >= 2 && std::strcmp(argv[1], "--batch") == 0)
+    {
+#ifdef _WIN32
+        RaiseError("batch mode is not supported on this platform");
+#else
+        int numJobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (argc == 5 && std::strcmp(argv[3], "-j") == 0)
+            numJobs = std::atoi(argv[4]);
+        else if (argc != 3)
+            PrintUsage();
+
+        if (numJobs < 1)
+            numJobs = 1;
+
+        return RunBatch(argv[2], numJobs);
+#endif
+    }
+
+    ConvertSong(argc, argv, false);
 
     return 0;
 }
@@ -21,11 +21,15 @@
 #ifndef MAIN_H
 #define MAIN_H
 
-#include <cstdio>
+#include <cstdint>
 #include <string>
+#include "elf_object.h"
+#include "output_buffer.h"
 
-extern FILE* g_inputFile;
-extern FILE* g_outputFile;
+extern const std::uint8_t* g_inputData;
+extern long g_inputSize;
+extern OutputBuffer g_output;
+extern ElfObject g_object;
 
 extern std::string g_asmLabel;
 extern int g_masterVolume;
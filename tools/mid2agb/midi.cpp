@@ -19,6 +19,7 @@
 // THE SOFTWARE.
 
 #include <cstdio>
+#include <cstring>
 #include <cassert>
 #include <string>
 #include <vector>
@@ -54,36 +55,39 @@ static int s_minNote;
 static int s_maxNote;
 static int s_runningStatus;
 
+static long s_inputPos;
+
 void Seek(long offset)
 {
-    if (std::fseek(g_inputFile, offset, SEEK_SET) != 0)
-        RaiseError("failed to seek to %l", offset);
+    // Like fseek, this may go past the end. Only reading there fails.
+    if (offset < 0)
+        RaiseError("failed to seek to %ld", offset);
+
+    s_inputPos = offset;
 }
 
 void Skip(long offset)
 {
-    if (std::fseek(g_inputFile, offset, SEEK_CUR) != 0)
-        RaiseError("failed to skip %l bytes", offset);
+    Seek(s_inputPos + offset);
 }
 
 std::string ReadSignature()
 {
-    char signature[4];
-
-    if (std::fread(signature, 4, 1, g_inputFile) != 1)
+    if (g_inputSize - s_inputPos < 4)
         RaiseError("failed to read signature");
 
-    return std::string(signature, 4);
+    std::string signature((const char*)&g_inputData[s_inputPos], 4);
+
+    s_inputPos += 4;
+    return signature;
 }
 
 std::uint32_t ReadInt8()
 {
-    int c = std::fgetc(g_inputFile);
-
-    if (c < 0)
+    if (s_inputPos >= g_inputSize)
         RaiseError("unexpected EOF");
 
-    return c;
+    return g_inputData[s_inputPos++];
 }
 
 std::uint32_t ReadInt16()
@@ -115,16 +119,21 @@ std::uint32_t ReadInt32()
 
 std::uint32_t ReadVLQ()
 {
+    long pos = s_inputPos;
     std::uint32_t val = 0;
     std::uint32_t c;
 
     do
     {
-        c = ReadInt8();
+        if (pos >= g_inputSize)
+            RaiseError("unexpected EOF");
+
+        c = g_inputData[pos++];
         val <<= 7;
         val |= (c & 0x7F);
     } while (c & 0x80);
 
+    s_inputPos = pos;
     return val;
 }
 
@@ -162,7 +171,7 @@ long ReadMidiTrackHeader(long offset)
 
     long size = ReadInt32();
 
-    s_trackDataStart = std::ftell(g_inputFile);
+    s_trackDataStart = s_inputPos;
 
     return size + 8;
 }
@@ -186,7 +195,7 @@ void DetermineEventCategory(MidiEventCategory& category, int& typeChan, int& siz
     if (typeChan < 0x80)
     {
         // If data byte was found, use the running status.
-        ungetc(typeChan, g_inputFile);
+        s_inputPos--;
         typeChan = s_runningStatus;
     }
 
@@ -238,8 +247,11 @@ std::string ReadEventText()
 
     if (length <= 2)
     {
-        if (fread(buffer, length, 1, g_inputFile) != 1)
+        if (g_inputSize - s_inputPos < (long)length)
             RaiseError("failed to read event text");
+
+        std::memcpy(buffer, &g_inputData[s_inputPos], length);
+        s_inputPos += length;
     }
     else
     {
@@ -435,7 +447,7 @@ void FindNoteEnd(Event& event)
 {
     // Save the current file position and running status
     // which get modified by CheckNoteEnd.
-    long startPos = ftell(g_inputFile);
+    long startPos = s_inputPos;
     int savedRunningStatus = s_runningStatus;
 
     event.param2 = 0;
@@ -0,0 +1,66 @@
+#include <cstdio>
+#include "output_buffer.h"
+#include "mapped_file.h"
+
+void OutputBuffer::Print(const char* format, ...)
+{
+    std::va_list args;
+    va_start(args, format);
+    VPrint(format, args);
+    va_end(args);
+}
+
+// Formats straight into the spare room at the end of the text, and only
+// formats a second time when that was not enough.
+void OutputBuffer::VPrint(const char* format, std::va_list args)
+{
+    const std::size_t guess = 256;
+    std::size_t pos = m_text.size();
+    std::va_list argsCopy;
+
+    m_text.resize(pos + guess);
+
+    va_copy(argsCopy, args);
+    int length = std::vsnprintf(&m_text[pos], guess, format, argsCopy);
+    va_end(argsCopy);
+
+    if (length < 0)
+    {
+        m_text.resize(pos);
+        return;
+    }
+
+    if ((std::size_t)length >= guess)
+    {
+        m_text.resize(pos + length + 1);
+        std::vsnprintf(&m_text[pos], length + 1, format, args);
+    }
+
+    m_text.resize(pos + length);
+}
+
+bool OutputBuffer::WriteToFile(const std::string& path, bool onlyIfChanged) const
+{
+    return WriteOutputFile(path, m_text.data(), m_text.size(), false, onlyIfChanged);
+}
+
+bool WriteOutputFile(const std::string& path, const void* data, std::size_t size, bool binary, bool onlyIfChanged)
+{
+    if (onlyIfChanged)
+    {
+        MappedFile existing(path);
+
+        if (existing.IsOpen() && existing.Size() == (long)size
+         && std::memcmp(existing.Data(), data, size) == 0)
+            return true;
+    }
+
+    std::FILE* fp = std::fopen(path.c_str(), binary ? "wb" : "w");
+
+    if (fp == nullptr)
+        return false;
+
+    bool success = std::fwrite(data, 1, size, fp) == size;
+
+    return (std::fclose(fp) == 0) && success;
+}
@@ -0,0 +1,33 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <cstdarg>
+#include <cstring>
+#include <string>
+
+// Collects the whole output file in memory, so that it is written out with
+// a single call at the end instead of one stdio call per directive.
+class OutputBuffer
+{
+public:
+    OutputBuffer() { m_text.reserve(1 << 16); }
+
+    void Write(const char* s, std::size_t length) { m_text.append(s, length); }
+    void Write(const char* s) { Write(s, std::strlen(s)); }
+    void Print(const char* format, ...);
+    void VPrint(const char* format, std::va_list args);
+
+    // Returns false if the file could not be written. If onlyIfChanged is
+    // set, a file that already holds the same text is left untouched.
+    bool WriteToFile(const std::string& path, bool onlyIfChanged) const;
+
+private:
+    std::string m_text;
+};
+
+// Writes size bytes of data to path, in binary mode if binary is set. Returns
+// false if the file could not be written. If onlyIfChanged is set, a file
+// that already holds the same bytes is left untouched.
+bool WriteOutputFile(const std::string& path, const void* data, std::size_t size, bool binary, bool onlyIfChanged);
+
+#endif // OUTPUT_BUFFER_H
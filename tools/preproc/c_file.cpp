@@ -28,37 +28,22 @@
 #include "char_util.h"
 #include "utf8.h"
 #include "string_parser.h"
+#include "mapped_file.h"
+#include "incbin_cache.h"
 
-CFile::CFile(std::string filename) : m_filename(filename)
+CFile::CFile(std::string filename, OutputBuffer& output) : m_file(filename), m_filename(filename), m_output(output)
 {
-    FILE *fp = std::fopen(filename.c_str(), "rb");
-
-    if (fp == NULL)
+    if (!m_file.IsOpen())
         FATAL_ERROR("Failed to open \"%s\" for reading.\n", filename.c_str());
 
-    std::fseek(fp, 0, SEEK_END);
-
-    m_size = std::ftell(fp);
-
-    if (m_size < 0)
-        FATAL_ERROR("File size of \"%s\" is less than zero.\n", filename.c_str());
-
-    m_buffer = new char[m_size + 1];
-
-    std::rewind(fp);
-
-    if (std::fread(m_buffer, m_size, 1, fp) != 1)
-        FATAL_ERROR("Failed to read \"%s\".\n", filename.c_str());
-
-    m_buffer[m_size] = 0;
-
-    std::fclose(fp);
-
+    m_buffer = m_file.Data();
+    m_size = m_file.Size();
     m_pos = 0;
     m_lineNum = 1;
 }
 
-CFile::CFile(CFile&& other) : m_filename(std::move(other.m_filename))
+CFile::CFile(CFile&& other)
+    : m_file(std::move(other.m_file)), m_filename(std::move(other.m_filename)), m_output(other.m_output)
 {
     m_buffer = other.m_buffer;
     m_pos = other.m_pos;
@@ -70,7 +55,6 @@ CFile::CFile(CFile&& other) : m_filename(std::move(other.m_filename))
 
 CFile::~CFile()
 {
-    delete[] m_buffer;
 }
 
 void CFile::Preproc()
@@ -83,21 +67,21 @@ void CFile::Preproc()
         {
             if (m_buffer[m_pos] == stringChar)
             {
-                std::putchar(stringChar);
+                m_output.Put(stringChar);
                 m_pos++;
                 stringChar = 0;
             }
             else if (m_buffer[m_pos] == '\\' && m_buffer[m_pos + 1] == stringChar)
             {
-                std::putchar('\\');
-                std::putchar(stringChar);
+                m_output.Put('\\');
+                m_output.Put(stringChar);
                 m_pos += 2;
             }
             else
             {
                 if (m_buffer[m_pos] == '\n')
                     m_lineNum++;
-                std::putchar(m_buffer[m_pos]);
+                m_output.Put(m_buffer[m_pos]);
                 m_pos++;
             }
         }
@@ -111,7 +95,7 @@ void CFile::Preproc()
 
             char c = m_buffer[m_pos++];
 
-            std::putchar(c);
+            m_output.Put(c);
 
             if (c == '\n')
                 m_lineNum++;
@@ -140,7 +124,7 @@ bool CFile::ConsumeNewline()
     {
         m_pos += 2;
         m_lineNum++;
-        std::putchar('\n');
+        m_output.Put('\n');
         return true;
     }
 
@@ -148,7 +132,7 @@ bool CFile::ConsumeNewline()
     {
         m_pos++;
         m_lineNum++;
-        std::putchar('\n');
+        m_output.Put('\n');
         return true;
     }
 
@@ -191,7 +175,7 @@ void CFile::TryConvertString()
 
     SkipWhitespace();
 
-    std::printf("{ ");
+    m_output.Write("{ ");
 
     while (1)
     {
@@ -213,7 +197,7 @@ void CFile::TryConvertString()
             }
 
             for (int i = 0; i < length; i++)
-                printf("0x%02X, ", s[i]);
+                m_output.Print("0x%02X, ", s[i]);
         }
         else if (m_buffer[m_pos] == ')')
         {
@@ -232,9 +216,9 @@ void CFile::TryConvertString()
     }
 
     if (noTerminator)
-        std::printf(" }");
+        m_output.Write(" }");
     else
-        std::printf("0xFF }");
+        m_output.Write("0xFF }");
 }
 
 bool CFile::CheckIdentifier(const std::string& ident)
@@ -248,48 +232,6 @@ bool CFile::CheckIdentifier(const std::string& ident)
     return (i == ident.length());
 }
 
-std::unique_ptr<unsigned char[]> CFile::ReadWholeFile(const std::string& path, int& size)
-{
-    FILE* fp = std::fopen(path.c_str(), "rb");
-
-    if (fp == nullptr)
-        RaiseError("Failed to open \"%s\" for reading.\n", path.c_str());
-
-    std::fseek(fp, 0, SEEK_END);
-
-    size = std::ftell(fp);
-
-    std::unique_ptr<unsigned char[]> buffer = std::unique_ptr<unsigned char[]>(new unsigned char[size]);
-
-    std::rewind(fp);
-
-    if (std::fread(buffer.get(), size, 1, fp) != 1)
-        RaiseError("Failed to read \"%s\".\n", path.c_str());
-
-    std::fclose(fp);
-
-    return buffer;
-}
-
-int ExtractData(const std::unique_ptr<unsigned char[]>& buffer, int offset, int size)
-{
-    switch (size)
-    {
-    case 1:
-        return buffer[offset];
-    case 2:
-        return (buffer[offset + 1] << 8)
-            | buffer[offset];
-    case 4:
-        return (buffer[offset + 3] << 24)
-            | (buffer[offset + 2] << 16)
-            | (buffer[offset + 1] << 8)
-            | buffer[offset];
-    default:
-        FATAL_ERROR("Invalid size passed to ExtractData.\n");
-    }
-}
-
 void CFile::TryConvertIncbin()
 {
     std::string idents[6] = { "INCBIN_S8", "INCBIN_U8", "INCBIN_S16", "INCBIN_U16", "INCBIN_S32", "INCBIN_U32" };
@@ -308,7 +250,6 @@ void CFile::TryConvertIncbin()
         return;
 
     int size = 1 << (incbinType / 2);
-    bool isSigned = ((incbinType % 2) == 0);
 
     long oldPos = m_pos;
     long oldLineNum = m_lineNum;
@@ -326,7 +267,7 @@ void CFile::TryConvertIncbin()
 
     m_pos++;
 
-    std::printf("{");
+    m_output.Put('{');
 
     while (true)
     {
@@ -362,25 +303,20 @@ void CFile::TryConvertIncbin()
 
         m_pos++;
 
-        int fileSize;
-        std::unique_ptr<unsigned char[]> buffer = ReadWholeFile(path, fileSize);
+        MappedFile file(path);
 
-        if ((fileSize % size) != 0)
-            RaiseError("Size %d doesn't evenly divide file size %d.\n", size, fileSize);
+        if (!file.IsOpen())
+            RaiseError("Failed to open \"%s\" for reading.\n", path.c_str());
 
-        int count = fileSize / size;
-        int offset = 0;
+        long fileSize = file.Size();
 
-        for (int i = 0; i < count; i++)
-        {
-            int data = ExtractData(buffer, offset, size);
-            offset += size;
+        if ((fileSize % size) != 0)
+            RaiseError("Size %d doesn't evenly divide file size %ld.\n", size, fileSize);
 
-            if (isSigned)
-                std::printf("%d,", data);
-            else
-                std::printf("%uu,", data);
-        }
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(file.Data());
+        const std::string& text = g_incbinCache->Expand(data, fileSize, incbinType);
+
+        m_output.Write(text.data(), text.size());
 
         SkipWhitespace();
 
@@ -395,7 +331,7 @@ void CFile::TryConvertIncbin()
 
     m_pos++;
 
-    std::printf("}");
+    m_output.Put('}');
 }
 
 // Reports a diagnostic message.
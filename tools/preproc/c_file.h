@@ -26,28 +26,31 @@
 #include <string>
 #include <memory>
 #include "preproc.h"
+#include "mapped_file.h"
+#include "output_buffer.h"
 
 class CFile
 {
 public:
-    CFile(std::string filename);
+    CFile(std::string filename, OutputBuffer& output);
     CFile(CFile&& other);
     CFile(const CFile&) = delete;
     ~CFile();
     void Preproc();
 
 private:
+    MappedFile m_file;
     char* m_buffer;
     long m_pos;
     long m_size;
     long m_lineNum;
     std::string m_filename;
+    OutputBuffer& m_output;
 
     bool ConsumeHorizontalWhitespace();
     bool ConsumeNewline();
     void SkipWhitespace();
     void TryConvertString();
-    std::unique_ptr<unsigned char[]> ReadWholeFile(const std::string& path, int& size);
     bool CheckIdentifier(const std::string& ident);
     void TryConvertIncbin();
     void ReportDiagnostic(const char* type, const char* format, std::va_list args);
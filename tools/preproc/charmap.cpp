@@ -21,11 +21,21 @@
 #include <cstdio>
 #include <cstdint>
 #include <cstdarg>
+#include <cstring>
+#include <map>
 #include "preproc.h"
 #include "charmap.h"
 #include "char_util.h"
 #include "utf8.h"
 
+#ifdef _WIN32
+#include <process.h>
+#define GetPid() _getpid()
+#else
+#include <unistd.h>
+#define GetPid() getpid()
+#endif
+
 enum LhsType
 {
     Char,
@@ -369,16 +379,124 @@ void CharmapReader::SkipWhitespace()
         m_pos++;
 }
 
-Charmap::Charmap(std::string filename)
+// Bump when the layout of the compiled image changes.
+static const std::uint32_t kCompiledCharmapVersion = 1;
+static const char kCompiledCharmapMagic[8] = { 'P', 'P', 'C', 'H', 'A', 'R', 'M', 'P' };
+static const std::uint32_t kCompiledCharmapByteOrder = 0x01020304;
+static const std::uint32_t kNumEscapes = 128;
+
+struct CompiledCharmapHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint64_t sourceSize;
+    std::uint64_t sourceHash;
+    std::uint32_t charSlots;
+    std::uint32_t constantSlots;
+    std::uint32_t stringsSize;
+    std::uint32_t imageSize;
+};
+
+struct CompiledCharmapSequence
+{
+    std::uint32_t offset;
+    std::uint32_t length;
+};
+
+// An empty slot has a code of -1.
+struct CompiledCharmapChar
+{
+    std::int32_t code;
+    CompiledCharmapSequence sequence;
+};
+
+// An empty slot has a name length of 0.
+struct CompiledCharmapConstant
+{
+    std::uint32_t hash;
+    std::uint32_t nameOffset;
+    std::uint32_t nameLength;
+    CompiledCharmapSequence sequence;
+};
+
+static std::uint64_t HashSource(const char* data, long size)
+{
+    std::uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (long i = 0; i < size; i++)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+static std::uint32_t HashCode(std::int32_t code)
+{
+    std::uint32_t hash = static_cast<std::uint32_t>(code) * 0x9E3779B1U;
+
+    return hash ^ (hash >> 16);
+}
+
+static std::uint32_t HashName(const char* name, std::size_t length)
+{
+    std::uint32_t hash = 0x811C9DC5U;
+
+    for (std::size_t i = 0; i < length; i++)
+    {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 0x01000193U;
+    }
+
+    return hash;
+}
+
+// Returns a power of two that keeps the table at most half full.
+static std::uint32_t GetSlotCount(std::size_t count)
+{
+    std::uint32_t slots = 16;
+
+    while (slots < count * 2)
+        slots *= 2;
+
+    return slots;
+}
+
+static std::size_t GetImageSize(std::uint32_t charSlots, std::uint32_t constantSlots, std::uint32_t stringsSize)
+{
+    return sizeof(CompiledCharmapHeader)
+         + kNumEscapes * sizeof(CompiledCharmapSequence)
+         + charSlots * sizeof(CompiledCharmapChar)
+         + constantSlots * sizeof(CompiledCharmapConstant)
+         + stringsSize;
+}
+
+static CompiledCharmapSequence AddString(std::string& strings, const std::string& value)
+{
+    CompiledCharmapSequence sequence;
+
+    sequence.offset = strings.size();
+    sequence.length = value.size();
+    strings += value;
+
+    return sequence;
+}
+
+static void CompileCharmap(const std::string& filename, std::uint64_t sourceSize, std::uint64_t sourceHash, std::vector<char>& image)
 {
     CharmapReader reader(filename);
+    std::map<std::int32_t, std::string> chars;
+    std::string escapes[kNumEscapes];
+    std::map<std::string, std::string> constants;
 
     for (;;)
     {
         Lhs lhs = reader.ReadLhs();
 
         if (lhs.type == LhsType::None)
-            return;
+            break;
 
         reader.ExpectEqualsSign();
 
@@ -387,22 +505,238 @@ Charmap::Charmap(std::string filename)
         switch (lhs.type)
         {
         case LhsType::Char:
-            if (m_chars.find(lhs.code) != m_chars.end())
+            if (chars.find(lhs.code) != chars.end())
                 reader.RaiseError("redefining char");
-            m_chars[lhs.code] = sequence;
+            chars[lhs.code] = sequence;
             break;
         case LhsType::Escape:
-            if (m_escapes[lhs.code].length() != 0)
+            if (escapes[lhs.code].length() != 0)
                 reader.RaiseError("redefining escape");
-            m_escapes[lhs.code] = sequence;
+            escapes[lhs.code] = sequence;
             break;
         case LhsType::Constant:
-            if (m_constants.find(lhs.name) != m_constants.end())
+            if (constants.find(lhs.name) != constants.end())
                 reader.RaiseError("redefining constant");
-            m_constants[lhs.name] = sequence;
+            constants[lhs.name] = sequence;
             break;
         }
 
         reader.ExpectEmptyRestOfLine();
     }
+
+    std::uint32_t charSlots = GetSlotCount(chars.size());
+    std::uint32_t constantSlots = GetSlotCount(constants.size());
+    std::vector<CompiledCharmapSequence> escapeTable(kNumEscapes);
+    std::vector<CompiledCharmapChar> charTable(charSlots);
+    std::vector<CompiledCharmapConstant> constantTable(constantSlots);
+    std::string strings;
+
+    for (std::uint32_t i = 0; i < kNumEscapes; i++)
+        escapeTable[i] = AddString(strings, escapes[i]);
+
+    for (CompiledCharmapChar& slot : charTable)
+    {
+        slot.code = -1;
+        slot.sequence.offset = 0;
+        slot.sequence.length = 0;
+    }
+
+    for (const auto& pair : chars)
+    {
+        std::uint32_t index = HashCode(pair.first) & (charSlots - 1);
+
+        while (charTable[index].code != -1)
+            index = (index + 1) & (charSlots - 1);
+
+        charTable[index].code = pair.first;
+        charTable[index].sequence = AddString(strings, pair.second);
+    }
+
+    std::memset(constantTable.data(), 0, constantSlots * sizeof(CompiledCharmapConstant));
+
+    for (const auto& pair : constants)
+    {
+        std::uint32_t hash = HashName(pair.first.data(), pair.first.length());
+        std::uint32_t index = hash & (constantSlots - 1);
+
+        while (constantTable[index].nameLength != 0)
+            index = (index + 1) & (constantSlots - 1);
+
+        CompiledCharmapSequence name = AddString(strings, pair.first);
+
+        constantTable[index].hash = hash;
+        constantTable[index].nameOffset = name.offset;
+        constantTable[index].nameLength = name.length;
+        constantTable[index].sequence = AddString(strings, pair.second);
+    }
+
+    CompiledCharmapHeader header;
+
+    std::memcpy(header.magic, kCompiledCharmapMagic, sizeof(header.magic));
+    header.version = kCompiledCharmapVersion;
+    header.byteOrder = kCompiledCharmapByteOrder;
+    header.sourceSize = sourceSize;
+    header.sourceHash = sourceHash;
+    header.charSlots = charSlots;
+    header.constantSlots = constantSlots;
+    header.stringsSize = strings.size();
+    header.imageSize = GetImageSize(charSlots, constantSlots, header.stringsSize);
+
+    image.clear();
+    image.reserve(header.imageSize);
+
+    const char* headerBytes = reinterpret_cast<const char*>(&header);
+    const char* escapeBytes = reinterpret_cast<const char*>(escapeTable.data());
+    const char* charBytes = reinterpret_cast<const char*>(charTable.data());
+    const char* constantBytes = reinterpret_cast<const char*>(constantTable.data());
+
+    image.insert(image.end(), headerBytes, headerBytes + sizeof(header));
+    image.insert(image.end(), escapeBytes, escapeBytes + kNumEscapes * sizeof(CompiledCharmapSequence));
+    image.insert(image.end(), charBytes, charBytes + charSlots * sizeof(CompiledCharmapChar));
+    image.insert(image.end(), constantBytes, constantBytes + constantSlots * sizeof(CompiledCharmapConstant));
+    image.insert(image.end(), strings.begin(), strings.end());
+}
+
+// The image is written to a temporary file and renamed into place, so
+// concurrent runs never map a partially written image. Failing to write it
+// is not an error; the next run just compiles the charmap again.
+static void WriteCompiledCharmap(const std::string& imagePath, const std::vector<char>& image)
+{
+    char suffix[32];
+
+    std::snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)GetPid());
+
+    std::string tmpPath = imagePath + suffix;
+    std::FILE* fp = std::fopen(tmpPath.c_str(), "wb");
+
+    if (fp == nullptr)
+        return;
+
+    bool success = (std::fwrite(image.data(), 1, image.size(), fp) == image.size());
+
+    success = (std::fclose(fp) == 0) && success;
+
+    if (!success || std::rename(tmpPath.c_str(), imagePath.c_str()) != 0)
+        std::remove(tmpPath.c_str());
+}
+
+Charmap::Charmap(std::string filename)
+    : m_header(nullptr), m_escapes(nullptr), m_chars(nullptr), m_constants(nullptr), m_strings(nullptr)
+{
+    MappedFile source(filename);
+
+    if (!source.IsOpen())
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", filename.c_str());
+
+    std::uint64_t sourceSize = source.Size();
+    std::uint64_t sourceHash = HashSource(source.Data(), source.Size());
+    std::string imagePath = filename + ".bin";
+    std::unique_ptr<MappedFile> mappedImage(new MappedFile(imagePath));
+
+    if (mappedImage->IsOpen() && UseImage(mappedImage->Data(), mappedImage->Size(), sourceSize, sourceHash))
+    {
+        m_mappedImage = std::move(mappedImage);
+        return;
+    }
+
+    CompileCharmap(filename, sourceSize, sourceHash, m_compiledImage);
+
+    if (!UseImage(m_compiledImage.data(), m_compiledImage.size(), sourceSize, sourceHash))
+        FATAL_ERROR("Failed to compile charmap \"%s\".\n", filename.c_str());
+
+    WriteCompiledCharmap(imagePath, m_compiledImage);
+}
+
+// Checks that the image matches the charmap source and is well formed, and
+// points the lookup tables into it.
+bool Charmap::UseImage(const char* image, std::size_t size, std::uint64_t sourceSize, std::uint64_t sourceHash)
+{
+    if (size < sizeof(CompiledCharmapHeader))
+        return false;
+
+    const CompiledCharmapHeader* header = reinterpret_cast<const CompiledCharmapHeader*>(image);
+
+    if (std::memcmp(header->magic, kCompiledCharmapMagic, sizeof(header->magic)) != 0
+     || header->version != kCompiledCharmapVersion
+     || header->byteOrder != kCompiledCharmapByteOrder
+     || header->sourceSize != sourceSize
+     || header->sourceHash != sourceHash)
+        return false;
+
+    if (header->charSlots == 0 || (header->charSlots & (header->charSlots - 1)) != 0
+     || header->constantSlots == 0 || (header->constantSlots & (header->constantSlots - 1)) != 0
+     || header->imageSize != size
+     || GetImageSize(header->charSlots, header->constantSlots, header->stringsSize) != size)
+        return false;
+
+    const char* pos = image + sizeof(CompiledCharmapHeader);
+    const CompiledCharmapSequence* escapes = reinterpret_cast<const CompiledCharmapSequence*>(pos);
+    pos += kNumEscapes * sizeof(CompiledCharmapSequence);
+    const CompiledCharmapChar* chars = reinterpret_cast<const CompiledCharmapChar*>(pos);
+    pos += header->charSlots * sizeof(CompiledCharmapChar);
+    const CompiledCharmapConstant* constants = reinterpret_cast<const CompiledCharmapConstant*>(pos);
+    pos += header->constantSlots * sizeof(CompiledCharmapConstant);
+
+    auto inStrings = [header](std::uint32_t offset, std::uint32_t length) {
+        return offset <= header->stringsSize && length <= header->stringsSize - offset;
+    };
+
+    for (std::uint32_t i = 0; i < kNumEscapes; i++)
+        if (!inStrings(escapes[i].offset, escapes[i].length))
+            return false;
+
+    for (std::uint32_t i = 0; i < header->charSlots; i++)
+        if (!inStrings(chars[i].sequence.offset, chars[i].sequence.length))
+            return false;
+
+    for (std::uint32_t i = 0; i < header->constantSlots; i++)
+        if (!inStrings(constants[i].nameOffset, constants[i].nameLength)
+         || !inStrings(constants[i].sequence.offset, constants[i].sequence.length))
+            return false;
+
+    m_header = header;
+    m_escapes = escapes;
+    m_chars = chars;
+    m_constants = constants;
+    m_strings = pos;
+    return true;
+}
+
+std::string Charmap::Char(std::int32_t code) const
+{
+    std::uint32_t mask = m_header->charSlots - 1;
+
+    for (std::uint32_t index = HashCode(code) & mask; m_chars[index].code != -1; index = (index + 1) & mask)
+    {
+        if (m_chars[index].code == code)
+            return std::string(&m_strings[m_chars[index].sequence.offset], m_chars[index].sequence.length);
+    }
+
+    return std::string();
+}
+
+std::string Charmap::Escape(unsigned char code) const
+{
+    if (code >= kNumEscapes)
+        return std::string();
+
+    return std::string(&m_strings[m_escapes[code].offset], m_escapes[code].length);
+}
+
+std::string Charmap::Constant(const char* identifier, std::size_t length) const
+{
+    std::uint32_t hash = HashName(identifier, length);
+    std::uint32_t mask = m_header->constantSlots - 1;
+
+    for (std::uint32_t index = hash & mask; m_constants[index].nameLength != 0; index = (index + 1) & mask)
+    {
+        const CompiledCharmapConstant& constant = m_constants[index];
+
+        if (constant.hash == hash
+         && constant.nameLength == length
+         && std::memcmp(&m_strings[constant.nameOffset], identifier, length) == 0)
+            return std::string(&m_strings[constant.sequence.offset], constant.sequence.length);
+    }
+
+    return std::string();
 }
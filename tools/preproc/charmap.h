@@ -22,43 +22,45 @@
 #define CHARMAP_H
 
 #include <cstdint>
+#include <cstddef>
+#include <memory>
 #include <string>
-#include <map>
 #include <vector>
+#include "mapped_file.h"
 
+struct CompiledCharmapHeader;
+struct CompiledCharmapSequence;
+struct CompiledCharmapChar;
+struct CompiledCharmapConstant;
+
+// The charmap is compiled into open-addressed hash tables that are stored in
+// a single flat image. The image is cached next to the charmap file as
+// "<charmap>.bin" and mapped directly on later runs, so charmap.txt is only
+// parsed again when its contents change.
 class Charmap
 {
 public:
     Charmap(std::string filename);
+    Charmap(const Charmap&) = delete;
 
-    std::string Char(std::int32_t code)
-    {
-        auto it = m_chars.find(code);
-
-        if (it == m_chars.end())
-            return std::string();
+    std::string Char(std::int32_t code) const;
+    std::string Escape(unsigned char code) const;
+    std::string Constant(const char* identifier, std::size_t length) const;
 
-        return it->second;
-    }
-
-    std::string Escape(unsigned char code)
+    std::string Constant(const std::string& identifier) const
     {
-        return m_escapes[code];
-    }
-
-    std::string Constant(std::string identifier)
-    {
-        auto it = m_constants.find(identifier);
-
-        if (it == m_constants.end())
-            return std::string();
-
-        return it->second;
+        return Constant(identifier.data(), identifier.length());
     }
 private:
-    std::map<std::int32_t, std::string> m_chars;
-    std::string m_escapes[128];
-    std::map<std::string, std::string> m_constants;
+    std::unique_ptr<MappedFile> m_mappedImage;
+    std::vector<char> m_compiledImage;
+    const CompiledCharmapHeader* m_header;
+    const CompiledCharmapSequence* m_escapes;
+    const CompiledCharmapChar* m_chars;
+    const CompiledCharmapConstant* m_constants;
+    const char* m_strings;
+
+    bool UseImage(const char* image, std::size_t size, std::uint64_t sourceSize, std::uint64_t sourceHash);
 };
 
 #endif // CHARMAP_H
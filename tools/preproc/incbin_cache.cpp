@@ -0,0 +1,194 @@
+#include <cstdint>
+#include <cstdio>
+#include "incbin_cache.h"
+#include "mapped_file.h"
+#include "sha1.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define MakeDir(path) _mkdir(path)
+#define GetPid() _getpid()
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define MakeDir(path) mkdir(path, 0777)
+#define GetPid() getpid()
+#endif
+
+// Bump when the expansion format changes so that old entries are ignored.
+static const char* const kIncbinCacheVersion = "2";
+
+IncbinCache* g_incbinCache;
+
+static void AppendDecimal(std::string& text, std::uint32_t value)
+{
+    char buffer[10];
+    int pos = sizeof(buffer);
+
+    do
+    {
+        buffer[--pos] = '0' + (value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    text.append(&buffer[pos], sizeof(buffer) - pos);
+}
+
+// The text is the same as printing every element with "%d," or "%uu,".
+void FormatIncbin(std::string& text, const unsigned char* data, long size, int incbinType)
+{
+    int elementSize = 1 << (incbinType / 2);
+    bool isSigned = ((incbinType % 2) == 0);
+
+    text.reserve(text.size() + (size / elementSize) * (isSigned ? 4 : 5));
+
+    for (long offset = 0; offset + elementSize <= size; offset += elementSize)
+    {
+        const unsigned char* element = &data[offset];
+        std::uint32_t value = element[0];
+
+        if (elementSize >= 2)
+            value |= element[1] << 8;
+        if (elementSize == 4)
+            value |= (element[2] << 16) | ((std::uint32_t)element[3] << 24);
+
+        if (isSigned)
+        {
+            if ((std::int32_t)value < 0)
+            {
+                text += '-';
+                value = -value;
+            }
+            AppendDecimal(text, value);
+            text += ',';
+        }
+        else
+        {
+            AppendDecimal(text, value);
+            text.append("u,", 2);
+        }
+    }
+}
+
+IncbinCache::IncbinCache(std::string dir, std::size_t maxBytes) : m_dir(dir), m_maxBytes(maxBytes), m_totalBytes(0)
+{
+    if (!m_dir.empty())
+    {
+        MakeDir(m_dir.c_str());
+        m_dir += "/preproc-incbin";
+        MakeDir(m_dir.c_str());
+    }
+}
+
+const std::string& IncbinCache::Expand(const unsigned char* data, long size, int incbinType)
+{
+    Sha1 sha1;
+
+    sha1.Update(data, size);
+
+    std::string key = sha1.Final() + "-" + std::to_string(incbinType);
+    auto it = m_entries.find(key);
+
+    if (it != m_entries.end())
+    {
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lruPos);
+        return it->second.text;
+    }
+
+    std::string text;
+    std::string entryPath;
+
+    if (!m_dir.empty())
+        entryPath = m_dir + "/" + key + "-v" + kIncbinCacheVersion;
+
+    if (entryPath.empty() || !ReadEntry(entryPath, text))
+    {
+        FormatIncbin(text, data, size, incbinType);
+
+        if (!entryPath.empty())
+            WriteEntry(entryPath, text);
+    }
+
+    m_newKeys.push_back(key);
+    return AddEntry(key, std::move(text)).text;
+}
+
+void IncbinCache::Insert(const std::string& key, std::string text)
+{
+    if (m_entries.find(key) == m_entries.end())
+        AddEntry(key, std::move(text));
+}
+
+void IncbinCache::TakeNewEntries(const std::function<void(const std::string& key, const std::string& text)>& func)
+{
+    for (const std::string& key : m_newKeys)
+    {
+        auto it = m_entries.find(key);
+
+        // It may have been evicted since.
+        if (it != m_entries.end())
+            func(key, it->second.text);
+    }
+
+    m_newKeys.clear();
+}
+
+IncbinCache::Entry& IncbinCache::AddEntry(const std::string& key, std::string text)
+{
+    m_lru.push_front(key);
+
+    Entry& entry = m_entries[key];
+
+    entry.text = std::move(text);
+    entry.lruPos = m_lru.begin();
+    m_totalBytes += entry.text.size();
+    Evict();
+    return entry;
+}
+
+// Never drops the most recently used entry, which the caller may still hold.
+void IncbinCache::Evict()
+{
+    while (m_totalBytes > m_maxBytes && m_lru.size() > 1)
+    {
+        auto it = m_entries.find(m_lru.back());
+
+        m_totalBytes -= it->second.text.size();
+        m_entries.erase(it);
+        m_lru.pop_back();
+    }
+}
+
+bool IncbinCache::ReadEntry(const std::string& entryPath, std::string& text)
+{
+    MappedFile file(entryPath);
+
+    if (!file.IsOpen())
+        return false;
+
+    text.assign(file.Data(), file.Size());
+    return true;
+}
+
+// Entries are written to a temporary file and renamed into place, so
+// concurrent runs never read a partially written entry.
+void IncbinCache::WriteEntry(const std::string& entryPath, const std::string& text)
+{
+    char suffix[32];
+
+    std::snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)GetPid());
+
+    std::string tmpPath = entryPath + suffix;
+    std::FILE* fp = std::fopen(tmpPath.c_str(), "wb");
+
+    if (fp == nullptr)
+        return;
+
+    bool success = (std::fwrite(text.data(), 1, text.size(), fp) == text.size());
+
+    success = (std::fclose(fp) == 0) && success;
+
+    if (!success || std::rename(tmpPath.c_str(), entryPath.c_str()) != 0)
+        std::remove(tmpPath.c_str());
+}
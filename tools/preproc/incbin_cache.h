@@ -0,0 +1,60 @@
+#ifndef INCBIN_CACHE_H
+#define INCBIN_CACHE_H
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Keeps the text that INCBIN_* macros expand to, so that a file that is
+// included several times is only formatted once. Expansions are keyed by the
+// SHA-1 of the file's contents and the element type. If a cache directory is
+// given, they are also shared between preproc runs through files in that
+// directory. The least recently used expansions are dropped once they add up
+// to more than maxBytes.
+class IncbinCache
+{
+public:
+    static const std::size_t kDefaultMaxBytes = 256 * 1024 * 1024;
+
+    IncbinCache(std::string dir, std::size_t maxBytes = kDefaultMaxBytes);
+
+    // The returned text stays valid until the next call to Expand or Insert.
+    const std::string& Expand(const unsigned char* data, long size, int incbinType);
+
+    // Adds an expansion that another process made.
+    void Insert(const std::string& key, std::string text);
+
+    // Calls func for each expansion that Expand has added since the last
+    // call, and forgets about them.
+    void TakeNewEntries(const std::function<void(const std::string& key, const std::string& text)>& func);
+
+private:
+    struct Entry
+    {
+        std::string text;
+        std::list<std::string>::iterator lruPos;
+    };
+
+    std::string m_dir;
+    std::size_t m_maxBytes;
+    std::size_t m_totalBytes;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::list<std::string> m_lru; // most recently used first
+    std::vector<std::string> m_newKeys;
+
+    Entry& AddEntry(const std::string& key, std::string text);
+    void Evict();
+    bool ReadEntry(const std::string& entryPath, std::string& text);
+    void WriteEntry(const std::string& entryPath, const std::string& text);
+};
+
+// incbinType indexes INCBIN_S8, INCBIN_U8, INCBIN_S16, INCBIN_U16, INCBIN_S32
+// and INCBIN_U32, in that order.
+void FormatIncbin(std::string& text, const unsigned char* data, long size, int incbinType);
+
+extern IncbinCache* g_incbinCache;
+
+#endif // INCBIN_CACHE_H
@@ -0,0 +1,95 @@
+#include <cstdio>
+#include <cstring>
+#include "mapped_file.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path) : m_data(nullptr), m_size(0), m_mappedSize(0)
+{
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return;
+
+    struct stat st;
+
+    if (fstat(fd, &st) == 0)
+    {
+        long pageSize = sysconf(_SC_PAGESIZE);
+
+        m_size = st.st_size;
+
+        // The rest of the last page reads as zeros, which provides the
+        // terminator for free unless the file ends exactly on a page boundary.
+        if (m_size > 0 && pageSize > 0 && (m_size % pageSize) != 0)
+        {
+            void* data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED)
+            {
+                m_data = static_cast<char*>(data);
+                m_mappedSize = m_size;
+            }
+        }
+    }
+
+    close(fd);
+
+    if (m_data != nullptr)
+        return;
+#endif
+
+    FILE* fp = std::fopen(path.c_str(), "rb");
+
+    if (fp == nullptr)
+        return;
+
+    std::fseek(fp, 0, SEEK_END);
+    m_size = std::ftell(fp);
+    std::rewind(fp);
+
+    if (m_size >= 0)
+    {
+        m_data = new char[m_size + 1];
+
+        if (m_size > 0 && std::fread(m_data, m_size, 1, fp) != 1)
+        {
+            delete[] m_data;
+            m_data = nullptr;
+        }
+        else
+        {
+            m_data[m_size] = 0;
+        }
+    }
+
+    std::fclose(fp);
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+    : m_data(other.m_data), m_size(other.m_size), m_mappedSize(other.m_mappedSize)
+{
+    other.m_data = nullptr;
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data == nullptr)
+        return;
+
+#ifndef _WIN32
+    if (m_mappedSize != 0)
+    {
+        munmap(m_data, m_mappedSize);
+        return;
+    }
+#endif
+
+    delete[] m_data;
+}
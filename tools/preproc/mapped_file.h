@@ -0,0 +1,27 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+
+// A read-only view of a whole file, memory-mapped where the platform allows
+// it. The contents are always followed by a NUL byte so that parsers can
+// look one character past the end. The view is private: writes to it are
+// never carried through to the file.
+class MappedFile
+{
+public:
+    MappedFile(const std::string& path);
+    MappedFile(MappedFile&& other);
+    MappedFile(const MappedFile&) = delete;
+    ~MappedFile();
+    bool IsOpen() const { return m_data != nullptr; }
+    char* Data() const { return m_data; }
+    long Size() const { return m_size; }
+
+private:
+    char* m_data;
+    long m_size;
+    long m_mappedSize;
+};
+
+#endif // MAPPED_FILE_H
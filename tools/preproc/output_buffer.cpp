@@ -0,0 +1,48 @@
+#include <cstdarg>
+#include "output_buffer.h"
+
+OutputBuffer::OutputBuffer(std::FILE* fp) : m_fp(fp), m_buffer(new char[kSize]), m_pos(0)
+{
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    Flush();
+    delete[] m_buffer;
+}
+
+void OutputBuffer::Print(const char* format, ...)
+{
+    char buffer[1024];
+    std::va_list args;
+
+    va_start(args, format);
+    int length = std::vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if (length < 0)
+        return;
+
+    if ((std::size_t)length < sizeof(buffer))
+    {
+        Write(buffer, length);
+    }
+    else
+    {
+        char* bigBuffer = new char[length + 1];
+
+        va_start(args, format);
+        std::vsnprintf(bigBuffer, length + 1, format, args);
+        va_end(args);
+
+        Write(bigBuffer, length);
+        delete[] bigBuffer;
+    }
+}
+
+void OutputBuffer::Flush()
+{
+    if (m_pos != 0)
+        std::fwrite(m_buffer, 1, m_pos, m_fp);
+    m_pos = 0;
+}
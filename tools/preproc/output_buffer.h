@@ -0,0 +1,56 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <cstdio>
+#include <cstring>
+
+// Collects output in a large buffer and hands it to stdio in big chunks
+// instead of one call per character.
+class OutputBuffer
+{
+public:
+    OutputBuffer(std::FILE* fp);
+    OutputBuffer(const OutputBuffer&) = delete;
+    ~OutputBuffer();
+
+    void Put(char c)
+    {
+        if (m_pos == kSize)
+            Flush();
+        m_buffer[m_pos++] = c;
+    }
+
+    void Write(const char* s, std::size_t length)
+    {
+        if (length > kSize - m_pos)
+        {
+            Flush();
+
+            if (length > kSize)
+            {
+                std::fwrite(s, 1, length, m_fp);
+                return;
+            }
+        }
+
+        std::memcpy(&m_buffer[m_pos], s, length);
+        m_pos += length;
+    }
+
+    void Write(const char* s)
+    {
+        Write(s, std::strlen(s));
+    }
+
+    void Print(const char* format, ...);
+    void Flush();
+
+private:
+    static const std::size_t kSize = 1 << 20;
+
+    std::FILE* m_fp;
+    char* m_buffer;
+    std::size_t m_pos;
+};
+
+#endif // OUTPUT_BUFFER_H
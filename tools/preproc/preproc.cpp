@@ -18,12 +18,15 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <cstring>
 #include <string>
 #include <stack>
 #include "preproc.h"
 #include "asm_file.h"
 #include "c_file.h"
 #include "charmap.h"
+#include "incbin_cache.h"
+#include "server.h"
 
 Charmap* g_charmap;
 
@@ -105,7 +108,8 @@ void PreprocAsmFile(std::string filename)
 
 void PreprocCFile(std::string filename)
 {
-    CFile cFile(filename);
+    OutputBuffer output(stdout);
+    CFile cFile(filename, output);
     cFile.Preproc();
 }
 
@@ -130,27 +134,51 @@ char* GetFileExtension(char* filename)
     return extension;
 }
 
+void PreprocFile(char* filename)
+{
+    char* extension = GetFileExtension(filename);
+
+    if (!extension)
+        FATAL_ERROR("\"%s\" has no file extension.\n", filename);
+
+    if ((extension[0] == 's') && extension[1] == 0)
+        PreprocAsmFile(filename);
+    else if ((extension[0] == 'c' || extension[0] == 'i') && extension[1] == 0)
+        PreprocCFile(filename);
+    else
+        FATAL_ERROR("\"%s\" has an unknown file extension of \"%s\".\n", filename, extension);
+}
+
 int main(int argc, char **argv)
 {
+    const char* cacheDir = std::getenv("TOOL_CACHE_DIR");
+
+    if (argc >= 3 && argc <= 4 && std::strcmp(argv[1], "--server") == 0)
+    {
+        g_incbinCache = new IncbinCache(cacheDir != nullptr ? cacheDir : "");
+        RunServer(argv[2], argc == 4 ? std::atoi(argv[3]) : 0);
+        return 0;
+    }
+
     if (argc != 3)
     {
-        std::fprintf(stderr, "Usage: %s SRC_FILE CHARMAP_FILE", argv[0]);
+        std::fprintf(stderr, "Usage: %s SRC_FILE CHARMAP_FILE\n", argv[0]);
+        std::fprintf(stderr, "       %s --server SOCKET_PATH [IDLE_SECONDS]\n", argv[0]);
         return 1;
     }
 
-    g_charmap = new Charmap(argv[2]);
+    // With PREPROC_SERVER set, hand the file to a running server if there is
+    // one and only do the work here otherwise.
+    const char* serverPath = std::getenv("PREPROC_SERVER");
+    int exitStatus;
 
-    char* extension = GetFileExtension(argv[1]);
+    if (serverPath != nullptr && serverPath[0] != 0 && RunOnServer(serverPath, argv[1], argv[2], exitStatus))
+        return exitStatus;
 
-    if (!extension)
-        FATAL_ERROR("\"%s\" has no file extension.\n", argv[1]);
+    g_charmap = new Charmap(argv[2]);
+    g_incbinCache = new IncbinCache(cacheDir != nullptr ? cacheDir : "");
 
-    if ((extension[0] == 's') && extension[1] == 0)
-        PreprocAsmFile(argv[1]);
-    else if ((extension[0] == 'c' || extension[0] == 'i') && extension[1] == 0)
-        PreprocCFile(argv[1]);
-    else
-        FATAL_ERROR("\"%s\" has an unknown file extension of \"%s\".\n", argv[1], extension);
+    PreprocFile(argv[1]);
 
     return 0;
 }
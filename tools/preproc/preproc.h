@@ -51,4 +51,6 @@ const unsigned long kMaxCharmapSequenceLength = 16;
 
 extern Charmap* g_charmap;
 
+void PreprocFile(char* filename);
+
 #endif // PREPROC_H
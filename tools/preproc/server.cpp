@@ -0,0 +1,601 @@
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "preproc.h"
+#include "incbin_cache.h"
+#include "server.h"
+
+#ifdef _WIN32
+
+void RunServer(const std::string& socketPath, int idleSeconds)
+{
+    FATAL_ERROR("Server mode is not supported on this platform.\n");
+}
+
+bool RunOnServer(const std::string& socketPath, const char* srcFile, const char* charmapFile, int& exitStatus)
+{
+    return false;
+}
+
+#else
+
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// A request is a 32-bit payload length, sent together with the client's
+// stdout and stderr as SCM_RIGHTS, followed by the payload: the client's
+// working directory, the source path and the charmap path, each terminated
+// by a NUL. The reply is the 32-bit exit status of the request.
+const std::uint32_t kMaxRequestLength = 64 * 1024;
+
+struct Request
+{
+    int stdoutFd;
+    int stderrFd;
+    std::string workingDir;
+    std::string srcFile;
+    std::string charmapFile;
+};
+
+// INCBIN expansions that a worker made, sent back over a socket so that the
+// server can keep them for later requests. Each is a 32-bit key length, a
+// 32-bit text length, the key and the text.
+struct IncbinUpload
+{
+    int fd;
+    std::string data;
+};
+
+struct WarmCharmap
+{
+    long long mtime;
+    long long size;
+    std::unique_ptr<Charmap> charmap;
+};
+
+static volatile std::sig_atomic_t s_stopRequested;
+
+static void HandleStopSignal(int)
+{
+    s_stopRequested = 1;
+}
+
+static bool MakeAddress(const std::string& socketPath, sockaddr_un& address)
+{
+    if (socketPath.size() >= sizeof(address.sun_path))
+        return false;
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    return true;
+}
+
+static int ConnectToServer(const std::string& socketPath)
+{
+    sockaddr_un address;
+
+    if (!MakeAddress(socketPath, address))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static bool WriteAll(int fd, const void* data, std::size_t size)
+{
+    const char* pos = static_cast<const char*>(data);
+
+    while (size > 0)
+    {
+        ssize_t count = send(fd, pos, size, MSG_NOSIGNAL);
+
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        pos += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+static bool ReadAll(int fd, void* data, std::size_t size)
+{
+    char* pos = static_cast<char*>(data);
+
+    while (size > 0)
+    {
+        ssize_t count = recv(fd, pos, size, 0);
+
+        if (count < 0 && errno == EINTR)
+            continue;
+
+        if (count <= 0)
+            return false;
+
+        pos += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+static std::string GetWorkingDir()
+{
+    std::vector<char> buffer(1024);
+
+    while (getcwd(buffer.data(), buffer.size()) == nullptr)
+    {
+        if (errno != ERANGE)
+            FATAL_ERROR("Failed to get the working directory.\n");
+        buffer.resize(buffer.size() * 2);
+    }
+
+    return buffer.data();
+}
+
+static bool SendRequest(int fd, const std::string& payload)
+{
+    std::uint32_t length = payload.size();
+    int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(fds))];
+    iovec iov;
+    msghdr message;
+
+    std::memset(control, 0, sizeof(control));
+    std::memset(&message, 0, sizeof(message));
+    iov.iov_base = &length;
+    iov.iov_len = sizeof(length);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t count;
+
+    do
+        count = sendmsg(fd, &message, MSG_NOSIGNAL);
+    while (count < 0 && errno == EINTR);
+
+    if (count != sizeof(length))
+        return false;
+
+    return WriteAll(fd, payload.data(), payload.size());
+}
+
+static bool ReceiveRequest(int fd, Request& request)
+{
+    std::uint32_t length = 0;
+    int fds[2] = { -1, -1 };
+    char control[CMSG_SPACE(sizeof(fds))];
+    iovec iov;
+    msghdr message;
+
+    std::memset(&message, 0, sizeof(message));
+    iov.iov_base = &length;
+    iov.iov_len = sizeof(length);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t count;
+
+    do
+        count = recvmsg(fd, &message, 0);
+    while (count < 0 && errno == EINTR);
+
+    if (count <= 0)
+        return false;
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(fds)))
+            std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    }
+
+    request.stdoutFd = fds[0];
+    request.stderrFd = fds[1];
+
+    if (fds[0] < 0 || fds[1] < 0)
+        return false;
+
+    if ((std::size_t)count < sizeof(length)
+     && !ReadAll(fd, reinterpret_cast<char*>(&length) + count, sizeof(length) - count))
+        return false;
+
+    if (length > kMaxRequestLength)
+        return false;
+
+    std::vector<char> payload(length + 1);
+
+    if (!ReadAll(fd, payload.data(), length))
+        return false;
+
+    payload[length] = 0;
+
+    std::string* fields[3] = { &request.workingDir, &request.srcFile, &request.charmapFile };
+    std::uint32_t pos = 0;
+
+    for (std::string* field : fields)
+    {
+        if (pos >= length)
+            return false;
+
+        *field = &payload[pos];
+        pos += field->size() + 1;
+    }
+
+    return !request.workingDir.empty() && !request.srcFile.empty() && !request.charmapFile.empty();
+}
+
+static void CloseRequestFds(Request& request)
+{
+    if (request.stdoutFd >= 0)
+        close(request.stdoutFd);
+    if (request.stderrFd >= 0)
+        close(request.stderrFd);
+}
+
+bool RunOnServer(const std::string& socketPath, const char* srcFile, const char* charmapFile, int& exitStatus)
+{
+    int fd = ConnectToServer(socketPath);
+
+    if (fd < 0)
+        return false;
+
+    std::string payload = GetWorkingDir();
+
+    payload += '\0';
+    payload += srcFile;
+    payload += '\0';
+    payload += charmapFile;
+    payload += '\0';
+
+    // The server only starts on a request once it has all of it, so it is
+    // still safe to fall back to doing the work here.
+    if (payload.size() > kMaxRequestLength || !SendRequest(fd, payload))
+    {
+        close(fd);
+        return false;
+    }
+
+    std::uint32_t status;
+
+    if (!ReadAll(fd, &status, sizeof(status)))
+        FATAL_ERROR("Lost the connection to the preproc server at \"%s\".\n", socketPath.c_str());
+
+    close(fd);
+    exitStatus = status;
+    return true;
+}
+
+// Loading a charmap exits on errors, so a charmap that is not warm yet is
+// first loaded in a child. The server only loads it itself once that has
+// succeeded, by which point the compiled image is normally cached as well.
+static Charmap* GetWarmCharmap(std::map<std::string, WarmCharmap>& charmaps, const std::string& path)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0)
+        return nullptr;
+
+#if defined(__linux__)
+    long long mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+    long long mtime = (long long)st.st_mtime;
+#endif
+    long long size = (long long)st.st_size;
+    auto it = charmaps.find(path);
+
+    if (it != charmaps.end() && it->second.mtime == mtime && it->second.size == size)
+        return it->second.charmap.get();
+
+    std::fflush(nullptr);
+
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        Charmap charmap(path);
+        std::_Exit(0);
+    }
+
+    int status;
+
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return nullptr;
+
+    WarmCharmap& warm = charmaps[path];
+
+    warm.mtime = mtime;
+    warm.size = size;
+    warm.charmap.reset(new Charmap(path));
+    return warm.charmap.get();
+}
+
+static void SendNewIncbinEntries(int fd)
+{
+    g_incbinCache->TakeNewEntries([fd](const std::string& key, const std::string& text)
+    {
+        std::uint32_t lengths[2] = { (std::uint32_t)key.size(), (std::uint32_t)text.size() };
+
+        WriteAll(fd, lengths, sizeof(lengths));
+        WriteAll(fd, key.data(), key.size());
+        WriteAll(fd, text.data(), text.size());
+    });
+}
+
+static void AddUploadedIncbinEntries(const std::string& data)
+{
+    std::size_t pos = 0;
+
+    while (data.size() - pos >= 8)
+    {
+        std::uint32_t lengths[2];
+
+        std::memcpy(lengths, &data[pos], sizeof(lengths));
+        pos += sizeof(lengths);
+
+        if (data.size() - pos < (std::size_t)lengths[0] + lengths[1])
+            break;
+
+        g_incbinCache->Insert(data.substr(pos, lengths[0]), data.substr(pos + lengths[0], lengths[1]));
+        pos += (std::size_t)lengths[0] + lengths[1];
+    }
+}
+
+// Runs in the worker child, which takes over the client's stdout and
+// stderr and then behaves exactly like a standalone preproc run. At the end
+// it sends the INCBIN expansions it made back to the server.
+static void RunRequest(Request& request, Charmap* charmap, int uploadFd)
+{
+    std::signal(SIGPIPE, SIG_DFL);
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+
+    dup2(request.stdoutFd, STDOUT_FILENO);
+    dup2(request.stderrFd, STDERR_FILENO);
+    CloseRequestFds(request);
+
+    if (chdir(request.workingDir.c_str()) != 0)
+        FATAL_ERROR("Failed to change to directory \"%s\".\n", request.workingDir.c_str());
+
+    // Reports the error to the client if the charmap failed to load.
+    g_charmap = (charmap != nullptr) ? charmap : new Charmap(request.charmapFile);
+
+    std::vector<char> srcFile(request.srcFile.begin(), request.srcFile.end());
+    srcFile.push_back(0);
+    PreprocFile(srcFile.data());
+
+    std::fflush(nullptr);
+    SendNewIncbinEntries(uploadFd);
+    close(uploadFd);
+
+    std::exit(0);
+}
+
+// Every request gets a supervisor child, which forks the worker, waits for
+// it and sends its exit status back. That keeps the server itself free to
+// accept the next request.
+static void HandleRequest(int clientFd, int listenFd, std::map<std::string, WarmCharmap>& charmaps, std::vector<IncbinUpload>& uploads)
+{
+    Request request;
+
+    request.stdoutFd = -1;
+    request.stderrFd = -1;
+
+    if (!ReceiveRequest(clientFd, request))
+    {
+        CloseRequestFds(request);
+        return;
+    }
+
+    std::string charmapPath = request.charmapFile;
+
+    if (charmapPath[0] != '/')
+        charmapPath = request.workingDir + "/" + charmapPath;
+
+    Charmap* charmap = GetWarmCharmap(charmaps, charmapPath);
+    int uploadFds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, uploadFds) != 0)
+    {
+        CloseRequestFds(request);
+        return;
+    }
+
+    std::fflush(nullptr);
+
+    pid_t supervisor = fork();
+
+    if (supervisor == 0)
+    {
+        close(listenFd);
+        close(uploadFds[0]);
+
+        pid_t worker = fork();
+
+        if (worker == 0)
+        {
+            close(clientFd);
+            RunRequest(request, charmap, uploadFds[1]);
+        }
+
+        close(uploadFds[1]);
+        CloseRequestFds(request);
+
+        int status = 0;
+        std::uint32_t exitStatus = 1;
+
+        if (worker > 0 && waitpid(worker, &status, 0) == worker)
+            exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+        WriteAll(clientFd, &exitStatus, sizeof(exitStatus));
+        std::_Exit(0);
+    }
+
+    close(uploadFds[1]);
+    CloseRequestFds(request);
+
+    if (supervisor < 0)
+    {
+        close(uploadFds[0]);
+        return;
+    }
+
+    IncbinUpload upload;
+
+    upload.fd = uploadFds[0];
+    uploads.push_back(upload);
+}
+
+// Reads what is waiting on an upload socket. Returns false once the worker
+// is done with it, after adding everything it sent to the cache.
+static bool ReadIncbinUpload(IncbinUpload& upload)
+{
+    char buffer[0x10000];
+    ssize_t count = recv(upload.fd, buffer, sizeof(buffer), 0);
+
+    if (count < 0 && errno == EINTR)
+        return true;
+
+    if (count > 0)
+    {
+        upload.data.append(buffer, count);
+        return true;
+    }
+
+    AddUploadedIncbinEntries(upload.data);
+    close(upload.fd);
+    return false;
+}
+
+void RunServer(const std::string& socketPath, int idleSeconds)
+{
+    sockaddr_un address;
+
+    if (!MakeAddress(socketPath, address))
+        FATAL_ERROR("Socket path \"%s\" is too long.\n", socketPath.c_str());
+
+    int existingFd = ConnectToServer(socketPath);
+
+    if (existingFd >= 0)
+    {
+        close(existingFd);
+        FATAL_ERROR("A preproc server is already listening on \"%s\".\n", socketPath.c_str());
+    }
+
+    // Nothing is listening, so whatever is left at the path is stale.
+    unlink(socketPath.c_str());
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listenFd < 0)
+        FATAL_ERROR("Failed to create a socket.\n");
+
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        FATAL_ERROR("Failed to bind to \"%s\".\n", socketPath.c_str());
+
+    if (listen(listenFd, SOMAXCONN) != 0)
+        FATAL_ERROR("Failed to listen on \"%s\".\n", socketPath.c_str());
+
+    struct sigaction stopAction;
+
+    std::memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = HandleStopSignal;
+    sigemptyset(&stopAction.sa_mask);
+    sigaction(SIGINT, &stopAction, nullptr);
+    sigaction(SIGTERM, &stopAction, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::map<std::string, WarmCharmap> charmaps;
+    std::vector<IncbinUpload> uploads;
+    std::vector<pollfd> pfds;
+
+    while (!s_stopRequested)
+    {
+        pfds.resize(uploads.size() + 1);
+
+        for (std::size_t i = 0; i < pfds.size(); i++)
+        {
+            pfds[i].fd = (i == 0) ? listenFd : uploads[i - 1].fd;
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+
+        int ready = poll(pfds.data(), pfds.size(), idleSeconds > 0 ? idleSeconds * 1000 : -1);
+
+        if (ready < 0 && errno != EINTR)
+            FATAL_ERROR("Failed to wait for requests on \"%s\".\n", socketPath.c_str());
+
+        // Reap supervisors of requests that have finished.
+        while (waitpid(-1, nullptr, WNOHANG) > 0)
+            ;
+
+        if (ready == 0)
+            break;
+
+        if (ready < 0)
+            continue;
+
+        for (std::size_t i = pfds.size() - 1; i > 0; i--)
+        {
+            if (pfds[i].revents != 0 && !ReadIncbinUpload(uploads[i - 1]))
+                uploads.erase(uploads.begin() + (i - 1));
+        }
+
+        if (pfds[0].revents == 0)
+            continue;
+
+        int clientFd = accept(listenFd, nullptr, nullptr);
+
+        if (clientFd < 0)
+            continue;
+
+        HandleRequest(clientFd, listenFd, charmaps, uploads);
+        close(clientFd);
+    }
+
+    for (IncbinUpload& upload : uploads)
+        close(upload.fd);
+
+    close(listenFd);
+    unlink(socketPath.c_str());
+}
+
+#endif // _WIN32
@@ -0,0 +1,19 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+
+// Runs preproc as a long-lived server that listens on a UNIX socket. Every
+// request is handled in a child forked from the server, so charmaps parsed by
+// earlier requests stay warm while a fatal error only ends that request. The
+// child sends the INCBIN expansions it made back to the server, so that later
+// requests find them too. If idleSeconds is positive, the server exits after
+// that long without requests.
+void RunServer(const std::string& socketPath, int idleSeconds);
+
+// Has the server listening on socketPath preprocess srcFile, writing straight
+// to this process's stdout and stderr. Returns false if no server could be
+// reached, in which case the caller should do the work itself.
+bool RunOnServer(const std::string& socketPath, const char* srcFile, const char* charmapFile, int& exitStatus);
+
+#endif // SERVER_H
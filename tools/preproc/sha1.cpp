@@ -0,0 +1,117 @@
+#include <cstdio>
+#include <cstring>
+#include "sha1.h"
+
+static std::uint32_t RotateLeft(std::uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+Sha1::Sha1() : m_length(0)
+{
+    m_state[0] = 0x67452301;
+    m_state[1] = 0xEFCDAB89;
+    m_state[2] = 0x98BADCFE;
+    m_state[3] = 0x10325476;
+    m_state[4] = 0xC3D2E1F0;
+}
+
+void Sha1::ProcessBlock()
+{
+    std::uint32_t w[80];
+
+    for (int i = 0; i < 16; i++)
+        w[i] = ((std::uint32_t)m_block[i * 4] << 24) | ((std::uint32_t)m_block[i * 4 + 1] << 16) | ((std::uint32_t)m_block[i * 4 + 2] << 8) | m_block[i * 4 + 3];
+
+    for (int i = 16; i < 80; i++)
+        w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    std::uint32_t a = m_state[0];
+    std::uint32_t b = m_state[1];
+    std::uint32_t c = m_state[2];
+    std::uint32_t d = m_state[3];
+    std::uint32_t e = m_state[4];
+
+    for (int i = 0; i < 80; i++)
+    {
+        std::uint32_t f;
+        std::uint32_t k;
+
+        if (i < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        std::uint32_t temp = RotateLeft(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = RotateLeft(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    m_state[0] += a;
+    m_state[1] += b;
+    m_state[2] += c;
+    m_state[3] += d;
+    m_state[4] += e;
+}
+
+void Sha1::Update(const void* data, std::size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    while (size > 0)
+    {
+        std::size_t blockPos = m_length % 64;
+        std::size_t count = 64 - blockPos;
+
+        if (count > size)
+            count = size;
+
+        std::memcpy(&m_block[blockPos], bytes, count);
+        m_length += count;
+        bytes += count;
+        size -= count;
+
+        if (m_length % 64 == 0)
+            ProcessBlock();
+    }
+}
+
+std::string Sha1::Final()
+{
+    std::uint64_t bitLength = m_length * 8;
+    unsigned char padding[72] = { 0x80 };
+    std::size_t paddingSize = 64 - ((m_length + 8) % 64);
+    unsigned char lengthBytes[8];
+
+    for (int i = 0; i < 8; i++)
+        lengthBytes[i] = (unsigned char)(bitLength >> (56 - i * 8));
+
+    Update(padding, paddingSize);
+    Update(lengthBytes, 8);
+
+    char hex[41];
+
+    for (int i = 0; i < 5; i++)
+        std::snprintf(&hex[i * 8], 9, "%08x", (unsigned int)m_state[i]);
+
+    return std::string(hex, 40);
+}
@@ -0,0 +1,26 @@
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// SHA-1, for naming cache entries by their contents.
+class Sha1
+{
+public:
+    Sha1();
+    void Update(const void* data, std::size_t size);
+
+    // Finishes the hash and returns it as 40 hex digits.
+    std::string Final();
+
+private:
+    std::uint32_t m_state[5];
+    std::uint64_t m_length;
+    unsigned char m_block[64];
+
+    void ProcessBlock();
+};
+
+#endif // SHA1_H
@@ -1,272 +1,261 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdint>
-#include <map>
-#include <vector>
+#include <memory>
+#include <unordered_map>
 #include <string>
 #include "ramscrgen.h"
 #include "elf.h"
+#include "mapped_file.h"
 
 #define SHN_COMMON 0xFFF2
 
-static std::string s_elfPath;
-static std::string s_archiveFilePath;
-static std::string s_archiveObjectPath;
+// A view of one ELF file, either a whole mapped file or a member of a mapped
+// archive.
+struct ElfImage
+{
+    std::string path;
+    const std::uint8_t *data;
+    std::size_t size;
+};
 
-static FILE *s_file;
+struct ArchiveMember
+{
+    std::size_t offset;
+    std::size_t size;
+};
 
-static std::uint32_t s_sectionHeaderOffset;
-static int s_sectionHeaderEntrySize;
-static int s_sectionCount;
-static int s_shstrtabIndex;
+// Everything that has been read stays mapped until the end of the run, so
+// that a file is never read twice.
+static std::unordered_map<std::string, std::unique_ptr<MappedFile>> s_files;
+static std::unordered_map<std::string, std::unordered_map<std::string, ArchiveMember>> s_archives;
+static std::unordered_map<std::string, CommonSymbolMap> s_commonSymbols;
 
-static std::uint32_t s_symtabOffset;
-static std::uint32_t s_strtabOffset;
+static const MappedFile& MapFile(const std::string& path, const std::string& displayPath)
+{
+    std::unique_ptr<MappedFile>& file = s_files[path];
 
-static std::uint32_t s_symbolCount;
-static std::uint32_t s_elfFileOffset;
+    if (!file)
+    {
+        file.reset(new MappedFile(path));
 
-struct Symbol
-{
-    std::uint32_t nameOffset;
-    std::uint32_t size;
-};
+        if (!file->IsOpen())
+            FATAL_ERROR("error: failed to open \"%s\" for reading\n", displayPath.c_str());
+    }
 
-static void Seek(long offset)
-{
-    if (std::fseek(s_file, s_elfFileOffset + offset, SEEK_SET) != 0)
-        FATAL_ERROR("error: failed to seek to %ld in \"%s\"", offset, s_elfPath.c_str());
+    return *file;
 }
 
-static void Skip(long offset)
+static void CheckRange(const ElfImage& elf, std::uint32_t offset, std::uint32_t length)
 {
-    if (std::fseek(s_file, offset, SEEK_CUR) != 0)
-        FATAL_ERROR("error: failed to skip %ld bytes in \"%s\"", offset, s_elfPath.c_str());
+    if (offset > elf.size || length > elf.size - offset)
+        FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", elf.path.c_str());
 }
 
-static std::uint32_t ReadInt8()
+static std::uint32_t ReadInt16(const ElfImage& elf, std::uint32_t offset)
 {
-    int c = std::fgetc(s_file);
+    CheckRange(elf, offset, 2);
 
-    if (c < 0)
-        FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", s_elfPath.c_str());
+    const std::uint8_t *p = elf.data + offset;
 
-    return c;
+    return p[0] | (p[1] << 8);
 }
 
-static std::uint32_t ReadInt16()
+static std::uint32_t ReadInt32(const ElfImage& elf, std::uint32_t offset)
 {
-    std::uint32_t val = 0;
-    val |= ReadInt8();
-    val |= ReadInt8() << 8;
-    return val;
-}
+    CheckRange(elf, offset, 4);
 
-static std::uint32_t ReadInt32()
-{
-    std::uint32_t val = 0;
-    val |= ReadInt8();
-    val |= ReadInt8() << 8;
-    val |= ReadInt8() << 16;
-    val |= ReadInt8() << 24;
-    return val;
+    const std::uint8_t *p = elf.data + offset;
+
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((std::uint32_t)p[3] << 24);
 }
 
-static std::string ReadString()
+static std::string ReadString(const ElfImage& elf, std::uint32_t offset)
 {
-    std::string s;
-    char c;
+    CheckRange(elf, offset, 0);
+
+    const void *end = std::memchr(elf.data + offset, 0, elf.size - offset);
 
-    while ((c = ReadInt8()) != 0)
-        s += c;
+    if (end == nullptr)
+        FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", elf.path.c_str());
 
-    return s;
+    return std::string((const char *)elf.data + offset, (const char *)end);
 }
 
-static void VerifyElfIdent()
+static void VerifyElfIdent(const ElfImage& elf)
 {
     char expectedMagic[4] = { 0x7F, 'E', 'L', 'F' };
-    char magic[4];
 
-    if (std::fread(magic, 4, 1, s_file) != 1)
-        FATAL_ERROR("error: failed to read ELF magic from \"%s\"\n", s_elfPath.c_str());
+    if (elf.size < 6)
+        FATAL_ERROR("error: failed to read ELF magic from \"%s\"\n", elf.path.c_str());
 
-    if (std::memcmp(magic, expectedMagic, 4) != 0)
-        FATAL_ERROR("error: ELF magic did not match in \"%s\"\n", s_elfPath.c_str());
+    if (std::memcmp(elf.data, expectedMagic, 4) != 0)
+        FATAL_ERROR("error: ELF magic did not match in \"%s\"\n", elf.path.c_str());
 
-    if (std::fgetc(s_file) != 1)
-        FATAL_ERROR("error: \"%s\" not 32-bit ELF\n", s_elfPath.c_str());
+    if (elf.data[4] != 1)
+        FATAL_ERROR("error: \"%s\" not 32-bit ELF\n", elf.path.c_str());
 
-    if (std::fgetc(s_file) != 1)
-        FATAL_ERROR("error: \"%s\" not little-endian ELF\n", s_elfPath.c_str());
+    if (elf.data[5] != 1)
+        FATAL_ERROR("error: \"%s\" not little-endian ELF\n", elf.path.c_str());
 }
 
-static void VerifyAr()
+// Reads the member table of an archive the first time that it is used. As
+// before, members are matched on at most the first 16 characters of their
+// name, and the first match wins.
+static const std::unordered_map<std::string, ArchiveMember>& GetArchiveMembers(const std::string& archivePath)
 {
+    auto it = s_archives.find(archivePath);
+
+    if (it != s_archives.end())
+        return it->second;
+
+    const MappedFile& file = MapFile(archivePath, archivePath);
+    std::unordered_map<std::string, ArchiveMember>& members = s_archives[archivePath];
     char expectedMagic[8] = {'!', '<', 'a', 'r', 'c', 'h', '>', '\n'};
-    char magic[8];
+    char expectedEndMagic[2] = { 0x60, 0x0a };
+    const char *data = (const char *)file.Data();
+    std::size_t size = file.Size();
 
-    if (std::fread(magic, 8, 1, s_file) != 1)
-        FATAL_ERROR("error: failed to read AR magic from \"%s\"\n", s_archiveFilePath.c_str());
+    if (size < 8)
+        FATAL_ERROR("error: failed to read AR magic from \"%s\"\n", archivePath.c_str());
 
-    if (std::memcmp(magic, expectedMagic, 8) != 0)
-        FATAL_ERROR("error: AR magic did not match in \"%s\"\n", s_archiveFilePath.c_str());
-}
+    if (std::memcmp(data, expectedMagic, 8) != 0)
+        FATAL_ERROR("error: AR magic did not match in \"%s\"\n", archivePath.c_str());
 
-static void ReadElfHeader()
-{
-    Seek(0x20);
-    s_sectionHeaderOffset = ReadInt32();
-    Seek(0x2E);
-    s_sectionHeaderEntrySize = ReadInt16();
-    s_sectionCount = ReadInt16();
-    s_shstrtabIndex = ReadInt16();
-}
+    std::size_t pos = 8;
 
-static void FindArObj()
-{
-    char file_ident[17] = {0};
-    char filesize_s[11] = {0};
-    char expectedEndMagic[2] = { 0x60, 0x0a };
-    char end_magic[2];
-    std::size_t filesize;
-
-    Seek(8);
-    while (!std::feof(s_file)) {
-        if (std::fread(file_ident, 16, 1, s_file) != 1)
-            FATAL_ERROR("error: failed to read file ident in \"%s\"\n", s_archiveFilePath.c_str());
-        Skip(32);
-        if (std::fread(filesize_s, 10, 1, s_file) != 1)
-            FATAL_ERROR("error: failed to read filesize in \"%s\"\n", s_archiveFilePath.c_str());
-        if (std::fread(end_magic, 2, 1, s_file) != 1)
-            FATAL_ERROR("error: failed to read end sentinel in \"%s\"\n", s_archiveFilePath.c_str());
-        if (std::memcmp(end_magic, expectedEndMagic, 2) != 0)
-            FATAL_ERROR("error: corrupted archive header in \"%s\" at \"%s\"\n", s_archiveFilePath.c_str(), file_ident);
-
-        char * ptr = std::strchr(file_ident, '/');
-        if (ptr != nullptr)
-            *ptr = 0;
-        filesize = std::strtoul(filesize_s, nullptr, 10);
-        if (std::strncmp(s_archiveObjectPath.c_str(), file_ident, 16) == 0) {
-            s_elfFileOffset = std::ftell(s_file);
-            return;
-        }
-        Skip(filesize);
+    while (pos < size)
+    {
+        if (size - pos < 60)
+            FATAL_ERROR("error: failed to read file ident in \"%s\"\n", archivePath.c_str());
+
+        std::string fileIdent(data + pos, 16);
+        std::string filesize(data + pos + 48, 10);
+
+        if (std::memcmp(data + pos + 58, expectedEndMagic, 2) != 0)
+            FATAL_ERROR("error: corrupted archive header in \"%s\" at \"%s\"\n", archivePath.c_str(), fileIdent.c_str());
+
+        std::size_t slashPos = fileIdent.find('/');
+
+        if (slashPos != std::string::npos)
+            fileIdent.resize(slashPos);
+
+        ArchiveMember member;
+
+        member.offset = pos + 60;
+        member.size = std::strtoul(filesize.c_str(), nullptr, 10);
+
+        if (member.size > size - member.offset)
+            member.size = size - member.offset;
+
+        members.emplace(fileIdent, member);
+
+        // Members start on even offsets.
+        pos = member.offset + member.size + ((member.offset + member.size) & 1);
     }
 
-    FATAL_ERROR("error: could not find object \"%s\" in archive \"%s\"\n", s_archiveObjectPath.c_str(), s_archiveFilePath.c_str());
+    return members;
 }
 
-static std::string GetSectionName(std::uint32_t shstrtabOffset, int index)
+static void IndexCommonSymbols(const ElfImage& elf, CommonSymbolMap& commonSymbols)
 {
-    Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * index);
-    std::uint32_t nameOffset = ReadInt32();
-    Seek(shstrtabOffset + nameOffset);
-    return ReadString();
-}
+    VerifyElfIdent(elf);
 
-static void FindTableOffsets()
-{
-    s_symtabOffset = 0;
-    s_strtabOffset = 0;
+    std::uint32_t sectionHeaderOffset = ReadInt32(elf, 0x20);
+    int sectionHeaderEntrySize = ReadInt16(elf, 0x2E);
+    int sectionCount = ReadInt16(elf, 0x30);
+    int shstrtabIndex = ReadInt16(elf, 0x32);
 
-    Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * s_shstrtabIndex + 0x10);
-    std::uint32_t shstrtabOffset = ReadInt32();
+    std::uint32_t shstrtabOffset = ReadInt32(elf, sectionHeaderOffset + sectionHeaderEntrySize * shstrtabIndex + 0x10);
+    std::uint32_t symtabOffset = 0;
+    std::uint32_t symbolCount = 0;
+    std::uint32_t strtabOffset = 0;
 
-    for (int i = 0; i < s_sectionCount; i++)
+    for (int i = 0; i < sectionCount; i++)
     {
-        std::string name = GetSectionName(shstrtabOffset, i);
+        std::uint32_t header = sectionHeaderOffset + sectionHeaderEntrySize * i;
+        std::string name = ReadString(elf, shstrtabOffset + ReadInt32(elf, header));
 
         if (name == ".symtab")
         {
-            if (s_symtabOffset)
-                FATAL_ERROR("error: mutiple .symtab sections found in \"%s\"\n", s_elfPath.c_str());
-            Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * i + 0x10);
-            s_symtabOffset = ReadInt32();
-            std::uint32_t size = ReadInt32();
-            s_symbolCount = size / 16;
+            if (symtabOffset)
+                FATAL_ERROR("error: mutiple .symtab sections found in \"%s\"\n", elf.path.c_str());
+            symtabOffset = ReadInt32(elf, header + 0x10);
+            symbolCount = ReadInt32(elf, header + 0x14) / 16;
         }
         else if (name == ".strtab")
         {
-            if (s_strtabOffset)
-                FATAL_ERROR("error: mutiple .strtab sections found in \"%s\"\n", s_elfPath.c_str());
-            Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * i + 0x10);
-            s_strtabOffset = ReadInt32();
+            if (strtabOffset)
+                FATAL_ERROR("error: mutiple .strtab sections found in \"%s\"\n", elf.path.c_str());
+            strtabOffset = ReadInt32(elf, header + 0x10);
         }
     }
 
-    if (!s_symtabOffset)
-        FATAL_ERROR("error: couldn't find .symtab section in \"%s\"\n", s_elfPath.c_str());
-
-    if (!s_strtabOffset)
-        FATAL_ERROR("error: couldn't find .strtab section in \"%s\"\n", s_elfPath.c_str());
-}
-
-static std::map<std::string, std::uint32_t> GetCommonSymbols_Shared()
-{
-    VerifyElfIdent();
-    ReadElfHeader();
-    FindTableOffsets();
-
-    std::map<std::string, std::uint32_t> commonSymbols;
+    if (!symtabOffset)
+        FATAL_ERROR("error: couldn't find .symtab section in \"%s\"\n", elf.path.c_str());
 
-    std::vector<Symbol> commonSymbolVec;
+    if (!strtabOffset)
+        FATAL_ERROR("error: couldn't find .strtab section in \"%s\"\n", elf.path.c_str());
 
-    Seek(s_symtabOffset);
+    CheckRange(elf, symtabOffset, symbolCount * 16);
 
-    for (std::uint32_t i = 0; i < s_symbolCount; i++)
+    for (std::uint32_t i = 0; i < symbolCount; i++)
     {
-        Symbol sym;
-        sym.nameOffset = ReadInt32();
-        Skip(4);
-        sym.size = ReadInt32();
-        Skip(2);
-        std::uint16_t sectionIndex = ReadInt16();
-        if (sectionIndex == SHN_COMMON)
-            commonSymbolVec.push_back(sym);
-    }
+        std::uint32_t symbol = symtabOffset + i * 16;
 
-    for (const Symbol& sym : commonSymbolVec)
-    {
-        Seek(s_strtabOffset + sym.nameOffset);
-        std::string name = ReadString();
-        commonSymbols[name] = sym.size;
+        if (ReadInt16(elf, symbol + 14) == SHN_COMMON)
+            commonSymbols[ReadString(elf, strtabOffset + ReadInt32(elf, symbol))] = ReadInt32(elf, symbol + 8);
     }
-
-    return commonSymbols;
 }
 
-std::map<std::string, std::uint32_t> GetCommonSymbolsFromLib(std::string sourcePath, std::string libpath)
+static void IndexCommonSymbolsFromLib(std::string sourcePath, std::string libpath, CommonSymbolMap& commonSymbols)
 {
+    ElfImage elf;
+
+    elf.path = sourcePath + "/" + libpath.substr(1);
+
     std::size_t colonPos = libpath.find(':');
     if (colonPos == std::string::npos)
-        FATAL_ERROR("error: missing colon separator in libfile \"%s\"\n", s_elfPath.c_str());
+        FATAL_ERROR("error: missing colon separator in libfile \"%s\"\n", elf.path.c_str());
+
+    std::string archiveObjectPath = libpath.substr(colonPos + 1);
+    std::string archiveFilePath = sourcePath + "/" + libpath.substr(1, colonPos - 1);
 
-    s_archiveObjectPath = libpath.substr(colonPos + 1);
-    s_archiveFilePath = sourcePath + "/" + libpath.substr(1, colonPos - 1);
-    s_elfPath = sourcePath + "/" + libpath.substr(1);
+    const std::unordered_map<std::string, ArchiveMember>& members = GetArchiveMembers(archiveFilePath);
+    auto member = members.find(archiveObjectPath.substr(0, 16));
 
-    s_file = std::fopen(s_archiveFilePath.c_str(), "rb");
+    if (member == members.end())
+        FATAL_ERROR("error: could not find object \"%s\" in archive \"%s\"\n", archiveObjectPath.c_str(), archiveFilePath.c_str());
 
-    if (s_file == NULL)
-        FATAL_ERROR("error: failed to open \"%s\" for reading\n", s_archiveFilePath.c_str());
+    elf.data = s_files[archiveFilePath]->Data() + member->second.offset;
+    elf.size = member->second.size;
 
-    VerifyAr();
-    FindArObj();
-    return GetCommonSymbols_Shared();
+    IndexCommonSymbols(elf, commonSymbols);
 }
 
-std::map<std::string, std::uint32_t> GetCommonSymbols(std::string sourcePath, std::string path)
+const CommonSymbolMap& GetCommonSymbols(std::string sourcePath, std::string path)
 {
-    s_elfFileOffset = 0;
+    std::string key = sourcePath + "/" + path;
+    auto it = s_commonSymbols.find(key);
+
+    if (it != s_commonSymbols.end())
+        return it->second;
+
+    CommonSymbolMap& commonSymbols = s_commonSymbols[key];
+
     if (path[0] == '*')
-        return GetCommonSymbolsFromLib(sourcePath, path);
+    {
+        IndexCommonSymbolsFromLib(sourcePath, path, commonSymbols);
+        return commonSymbols;
+    }
 
-    s_elfPath = sourcePath + "/" + path;
-    s_file = std::fopen(s_elfPath.c_str(), "rb");
+    const MappedFile& file = MapFile(key, path);
+    ElfImage elf;
 
-    if (s_file == NULL)
-        FATAL_ERROR("error: failed to open \"%s\" for reading\n", path.c_str());
+    elf.path = key;
+    elf.data = file.Data();
+    elf.size = file.Size();
 
-    return GetCommonSymbols_Shared();
+    IndexCommonSymbols(elf, commonSymbols);
+    return commonSymbols;
 }
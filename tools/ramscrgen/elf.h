@@ -22,9 +22,14 @@
 #define ELF_H
 
 #include <cstdint>
-#include <map>
 #include <string>
+#include <unordered_map>
 
-std::map<std::string, std::uint32_t> GetCommonSymbols(std::string sourcePath, std::string path);
+typedef std::unordered_map<std::string, std::uint32_t> CommonSymbolMap;
+
+// Returns the sizes of the common symbols of an object, or of an object in an
+// archive if path is "*ARCHIVE:OBJECT". Each file is only mapped and indexed
+// once per run, however many includes name it.
+const CommonSymbolMap& GetCommonSymbols(std::string sourcePath, std::string path);
 
 #endif // ELF_H
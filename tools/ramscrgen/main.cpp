@@ -27,7 +27,7 @@
 
 void HandleCommonInclude(std::string filename, std::string sourcePath, std::string symOrderPath, std::string lang)
 {
-    auto commonSymbols = GetCommonSymbols(sourcePath, filename);
+    const CommonSymbolMap& commonSymbols = GetCommonSymbols(sourcePath, filename);
     std::size_t dotIndex;
 
     if (filename[0] == '*') {
@@ -62,9 +62,10 @@ void HandleCommonInclude(std::string filename, std::string sourcePath, std::stri
         }
         else
         {
-            if (commonSymbols.count(label) == 0)
+            auto symbol = commonSymbols.find(label);
+            if (symbol == commonSymbols.end())
                 symFile.RaiseError("no common symbol named \"%s\"", label.c_str());
-            unsigned long size = commonSymbols[label];
+            unsigned long size = symbol->second;
             int alignment = 4;
             if (size > 4)
                 alignment = 8;
@@ -0,0 +1,77 @@
+#include <cstdio>
+#include "mapped_file.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path) : m_data(nullptr), m_size(0), m_mapped(false)
+{
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return;
+
+    struct stat st;
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data != MAP_FAILED)
+        {
+            m_data = static_cast<std::uint8_t*>(data);
+            m_size = st.st_size;
+            m_mapped = true;
+        }
+    }
+
+    close(fd);
+
+    if (m_data != nullptr)
+        return;
+#endif
+
+    std::FILE* fp = std::fopen(path.c_str(), "rb");
+
+    if (fp == nullptr)
+        return;
+
+    std::fseek(fp, 0, SEEK_END);
+    m_size = std::ftell(fp);
+    std::rewind(fp);
+
+    if (m_size >= 0)
+    {
+        // Allocate at least one byte so that an empty file still counts as open.
+        m_data = new std::uint8_t[m_size > 0 ? m_size : 1];
+
+        if (m_size > 0 && std::fread(m_data, m_size, 1, fp) != 1)
+        {
+            delete[] m_data;
+            m_data = nullptr;
+        }
+    }
+
+    std::fclose(fp);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data == nullptr)
+        return;
+
+#ifndef _WIN32
+    if (m_mapped)
+    {
+        munmap(m_data, m_size);
+        return;
+    }
+#endif
+
+    delete[] m_data;
+}
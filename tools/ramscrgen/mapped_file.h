@@ -0,0 +1,25 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstdint>
+#include <string>
+
+// A read-only view of a whole file, memory-mapped where the platform allows
+// it and read into memory otherwise.
+class MappedFile
+{
+public:
+    MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    ~MappedFile();
+    bool IsOpen() const { return m_data != nullptr; }
+    const std::uint8_t* Data() const { return m_data; }
+    long Size() const { return m_size; }
+
+private:
+    std::uint8_t* m_data;
+    long m_size;
+    bool m_mapped;
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,295 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "decompress.h"
+
+static int GetDecompressedSize(unsigned char *src)
+{
+	return (src[3] << 16) | (src[2] << 8) | src[1];
+}
+
+unsigned char *LZDecompress(unsigned char *src, int srcSize, int *uncompressedSize, int *compressedSize)
+{
+	if (srcSize < 4 || src[0] != 0x10)
+		return NULL;
+
+	int destSize = GetDecompressedSize(src);
+
+	if (destSize == 0)
+		return NULL;
+
+	unsigned char *dest = malloc(destSize);
+
+	if (dest == NULL)
+		return NULL;
+
+	int srcPos = 4;
+	int destPos = 0;
+
+	for (;;) {
+		if (srcPos >= srcSize)
+			goto fail;
+
+		unsigned char flags = src[srcPos++];
+
+		for (int i = 0; i < 8; i++) {
+			if (flags & 0x80) {
+				if (srcPos + 1 >= srcSize)
+					goto fail;
+
+				int blockSize = (src[srcPos] >> 4) + 3;
+				int blockDistance = (((src[srcPos] & 0xF) << 8) | src[srcPos + 1]) + 1;
+
+				srcPos += 2;
+
+				int blockPos = destPos - blockDistance;
+
+				// Some Ruby/Sapphire tilesets overflow.
+				if (destPos + blockSize > destSize)
+					blockSize = destSize - destPos;
+
+				if (blockPos < 0)
+					goto fail;
+
+				for (int j = 0; j < blockSize; j++)
+					dest[destPos++] = dest[blockPos + j];
+			} else {
+				if (srcPos >= srcSize || destPos >= destSize)
+					goto fail;
+
+				dest[destPos++] = src[srcPos++];
+			}
+
+			if (destPos == destSize) {
+				*uncompressedSize = destSize;
+				*compressedSize = srcPos;
+				return dest;
+			}
+
+			flags <<= 1;
+		}
+	}
+
+fail:
+	free(dest);
+	return NULL;
+}
+
+unsigned char *RLDecompress(unsigned char *src, int srcSize, int *uncompressedSize, int *compressedSize)
+{
+	if (srcSize < 4 || src[0] != 0x30)
+		return NULL;
+
+	int destSize = GetDecompressedSize(src);
+
+	if (destSize == 0)
+		return NULL;
+
+	unsigned char *dest = malloc(destSize);
+
+	if (dest == NULL)
+		return NULL;
+
+	int srcPos = 4;
+	int destPos = 0;
+
+	for (;;) {
+		if (srcPos >= srcSize)
+			goto fail;
+
+		unsigned char flags = src[srcPos++];
+		bool compressed = ((flags & 0x80) != 0);
+
+		if (compressed) {
+			int length = (flags & 0x7F) + 3;
+
+			if (destPos + length > destSize || srcPos >= srcSize)
+				goto fail;
+
+			memset(&dest[destPos], src[srcPos++], length);
+			destPos += length;
+		} else {
+			int length = (flags & 0x7F) + 1;
+
+			if (destPos + length > destSize || srcPos + length > srcSize)
+				goto fail;
+
+			memcpy(&dest[destPos], &src[srcPos], length);
+			srcPos += length;
+			destPos += length;
+		}
+
+		if (destPos == destSize) {
+			*uncompressedSize = destSize;
+			*compressedSize = srcPos;
+			return dest;
+		}
+	}
+
+fail:
+	free(dest);
+	return NULL;
+}
+
+// Number of bits that the Huffman decoder looks up at once.
+#define HUFF_LOOKUP_BITS 10
+
+struct HuffLookup {
+	unsigned short value; // the decoded value, or the tree node to go on from
+	unsigned char nbits;
+	bool isLeaf;
+};
+
+// Fills the part of the lookup table under the tree node at treePos, whose
+// path from the root is the depth bits of prefix.
+static bool FillHuffLookup(struct HuffLookup *lookup, unsigned char *src, int srcSize, int treePos, int prefix, int depth)
+{
+	unsigned char treeView = src[treePos];
+
+	for (int curBit = 0; curBit < 2; curBit++) {
+		bool isLeaf = ((treeView << curBit) & 0x80) != 0;
+		int childPos = (treePos & ~1) + ((treeView & 0x3F) + 1) * 2 + curBit;
+		int childPrefix = (prefix << 1) | curBit;
+
+		if (childPos >= srcSize)
+			return false;
+
+		if (isLeaf) {
+			// Every entry that starts with the leaf's path decodes to it.
+			int shift = HUFF_LOOKUP_BITS - depth - 1;
+
+			for (int i = 0; i < 1 << shift; i++) {
+				struct HuffLookup *entry = &lookup[(childPrefix << shift) | i];
+
+				entry->value = src[childPos];
+				entry->nbits = depth + 1;
+				entry->isLeaf = true;
+			}
+		} else if (depth + 1 == HUFF_LOOKUP_BITS) {
+			struct HuffLookup *entry = &lookup[childPrefix];
+
+			entry->value = childPos;
+			entry->nbits = HUFF_LOOKUP_BITS;
+			entry->isLeaf = false;
+		} else if (!FillHuffLookup(lookup, src, srcSize, childPos, childPrefix, depth + 1)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Reads the 32-bit word at srcPos, as if src was padded with zeros.
+static uint32_t ReadHuffWord(unsigned char *src, int srcSize, int srcPos)
+{
+	uint32_t word = 0;
+
+	for (int i = 0; i < 4; i++) {
+		if (srcPos + i < srcSize)
+			word |= (uint32_t)src[srcPos + i] << (8 * i);
+	}
+
+	return word;
+}
+
+unsigned char *HuffDecompress(unsigned char *src, int srcSize, int *uncompressedSize, int *compressedSize)
+{
+	if (srcSize < 5 || (src[0] != 0x24 && src[0] != 0x28))
+		return NULL;
+
+	int bitDepth = src[0] & 15;
+	int destSize = GetDecompressedSize(src);
+
+	// The data is written a word at a time.
+	if (destSize == 0 || destSize % 4 != 0)
+		return NULL;
+
+	struct HuffLookup lookup[1 << HUFF_LOOKUP_BITS];
+
+	if (!FillHuffLookup(lookup, src, srcSize, 5, 0, 0))
+		return NULL;
+
+	unsigned char *dest = malloc(destSize);
+
+	if (dest == NULL)
+		return NULL;
+
+	int srcPos = 4 + (src[4] + 1) * 2;
+	int64_t bitsLeft = srcPos < srcSize ? (int64_t)((srcSize - srcPos) / 4) * 32 : 0;
+	int64_t bitsUsed = 0;
+	uint64_t window = 0;
+	int windowBits = 0;
+	int destPos = 0;
+	int curValPos = 0;
+
+	for (;;) {
+		// Keep at least 32 bits in the window.
+		if (windowBits <= 32) {
+			window |= (uint64_t)ReadHuffWord(src, srcSize, srcPos) << (32 - windowBits);
+			srcPos += 4;
+			windowBits += 32;
+		}
+
+		struct HuffLookup entry = lookup[window >> (64 - HUFF_LOOKUP_BITS)];
+		int value = entry.value;
+
+		window <<= entry.nbits;
+		windowBits -= entry.nbits;
+		bitsUsed += entry.nbits;
+
+		if (!entry.isLeaf) {
+			int treePos = value;
+
+			for (;;) {
+				if (windowBits == 0) {
+					window = (uint64_t)ReadHuffWord(src, srcSize, srcPos) << 32;
+					srcPos += 4;
+					windowBits = 32;
+				}
+
+				int curBit = window >> 63;
+				unsigned char treeView = src[treePos];
+				bool isLeaf = ((treeView << curBit) & 0x80) != 0;
+
+				treePos &= ~1; // align
+				treePos += ((treeView & 0x3F) + 1) * 2 + curBit;
+				window <<= 1;
+				windowBits--;
+				bitsUsed++;
+
+				if (treePos >= srcSize)
+					goto fail;
+
+				if (isLeaf)
+					break;
+			}
+
+			value = src[treePos];
+		}
+
+		if (bitsUsed > bitsLeft)
+			goto fail;
+
+		if (bitDepth == 8) {
+			dest[destPos++] = value;
+		} else if (curValPos == 0) {
+			dest[destPos] = value & 0xF;
+			curValPos = 1;
+		} else {
+			dest[destPos++] |= value << 4;
+			curValPos = 0;
+		}
+
+		if (destPos == destSize) {
+			// The stream is made of whole words.
+			*uncompressedSize = destSize;
+			*compressedSize = 4 + (src[4] + 1) * 2 + (int)((bitsUsed + 31) / 32) * 4;
+			return dest;
+		}
+	}
+
+fail:
+	free(dest);
+	return NULL;
+}
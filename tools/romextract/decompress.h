@@ -0,0 +1,14 @@
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+// Decoders for the GBA BIOS compression formats, adapted from gbagfx. A ROM
+// holds no marker for where its compressed data is, so rather than failing
+// on bad input like gbagfx does, these return NULL when src doesn't start
+// with a valid stream. On success, *compressedSize is set to the number of
+// bytes of src that the stream used.
+
+unsigned char *LZDecompress(unsigned char *src, int srcSize, int *uncompressedSize, int *compressedSize);
+unsigned char *RLDecompress(unsigned char *src, int srcSize, int *uncompressedSize, int *compressedSize);
+unsigned char *HuffDecompress(unsigned char *src, int srcSize, int *uncompressedSize, int *compressedSize);
+
+#endif // DECOMPRESS_H
@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define MakeDir(path) _mkdir(path)
+#define GetPid() _getpid()
+#else
+#include <unistd.h>
+#define MakeDir(path) mkdir(path, 0777)
+#define GetPid() getpid()
+#endif
+#include "global.h"
+#include "util.h"
+#include "decompress.h"
+#include "sha1.h"
+#include "symbol_table.h"
+
+#define ROM_START 0x08000000
+
+struct Asset {
+    uint32_t address;
+    uint32_t size;
+    const char *type;
+    char hash[41];
+    bool isNew;
+};
+
+struct ExtractQueue {
+    unsigned char *rom;
+    int romSize;
+    char *outputDir;
+    struct Asset *assets;
+    int numAssets;
+    int nextAsset;
+    pthread_mutex_t mutex;
+};
+
+typedef unsigned char *(*DecompressFunc)(unsigned char *src, int srcSize, int *uncompressedSize, int *compressedSize);
+
+static const struct {
+    unsigned char header;
+    const char *type;
+    DecompressFunc func;
+} sDecompressors[] = {
+    { 0x10, "lz", LZDecompress },
+    { 0x30, "rl", RLDecompress },
+    { 0x24, "huff", HuffDecompress },
+    { 0x28, "huff", HuffDecompress },
+};
+
+// Writes data to its place in the output directory unless it is already
+// there, through a temporary file so that no other run ever sees a partial
+// object. Returns whether it had to be written.
+static bool StoreObject(char *outputDir, char *hash, unsigned char *data, int size)
+{
+    size_t pathSize = strlen(outputDir) + 1 + 2 + 1 + 38 + 64;
+    char *path = malloc(pathSize);
+    char *tmpPath = malloc(pathSize);
+
+    if (path == NULL || tmpPath == NULL)
+        FATAL_ERROR("Failed to allocate memory for object path.\n");
+
+    snprintf(path, pathSize, "%s/%.2s/%s", outputDir, hash, &hash[2]);
+
+    FILE *fp = fopen(path, "rb");
+    bool isNew = (fp == NULL);
+
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+    else
+    {
+        snprintf(tmpPath, pathSize, "%s/%.2s", outputDir, hash);
+        MakeDir(tmpPath);
+        snprintf(tmpPath, pathSize, "%s.%d.%p.tmp", path, (int)GetPid(), (void *)data);
+
+        fp = fopen(tmpPath, "wb");
+
+        if (fp == NULL)
+            FATAL_ERROR("Failed to open \"%s\" for writing.\n", tmpPath);
+
+        bool success = (fwrite(data, size, 1, fp) == 1);
+
+        success = (fclose(fp) == 0) && success;
+
+        if (!success || rename(tmpPath, path) != 0)
+        {
+            remove(tmpPath);
+            FATAL_ERROR("Failed to write \"%s\".\n", path);
+        }
+    }
+
+    free(path);
+    free(tmpPath);
+    return isNew;
+}
+
+// A symbol holds compressed data if a stream starting at it decodes to its
+// end. INCBINed .lz, .rl and .huff files are padded to a multiple of 4
+// bytes, so up to 3 bytes may be left over.
+static void ExtractAsset(struct ExtractQueue *queue, struct Asset *asset)
+{
+    unsigned char *src = &queue->rom[asset->address - ROM_START];
+    int srcSize = asset->size;
+
+    asset->type = NULL;
+
+    for (size_t i = 0; i < sizeof(sDecompressors) / sizeof(sDecompressors[0]); i++)
+    {
+        if (src[0] != sDecompressors[i].header)
+            continue;
+
+        int uncompressedSize;
+        int compressedSize;
+        unsigned char *data = sDecompressors[i].func(src, srcSize, &uncompressedSize, &compressedSize);
+
+        if (data == NULL)
+            return;
+
+        if (srcSize - compressedSize < 4)
+        {
+            struct Sha1 sha1;
+
+            Sha1Init(&sha1);
+            Sha1Update(&sha1, data, uncompressedSize);
+            Sha1Final(&sha1, asset->hash);
+
+            asset->type = sDecompressors[i].type;
+            asset->isNew = StoreObject(queue->outputDir, asset->hash, data, uncompressedSize);
+        }
+
+        free(data);
+        return;
+    }
+}
+
+static void *ExtractWorker(void *arg)
+{
+    struct ExtractQueue *queue = arg;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&queue->mutex);
+        int asset = queue->nextAsset++;
+        pthread_mutex_unlock(&queue->mutex);
+
+        if (asset >= queue->numAssets)
+            return NULL;
+
+        ExtractAsset(queue, &queue->assets[asset]);
+    }
+}
+
+static int CompareAssetAddresses(const void *a, const void *b)
+{
+    uint32_t x = ((const struct Asset *)a)->address;
+    uint32_t y = ((const struct Asset *)b)->address;
+
+    return x < y ? -1 : x > y;
+}
+
+static int CompareSymbolNames(const void *a, const void *b)
+{
+    return strcmp(((const struct Symbol *)a)->name, ((const struct Symbol *)b)->name);
+}
+
+static struct Asset *FindAsset(struct Asset *assets, int numAssets, uint32_t address)
+{
+    struct Asset key;
+
+    key.address = address;
+
+    return bsearch(&key, assets, numAssets, sizeof(struct Asset), CompareAssetAddresses);
+}
+
+static int GetDefaultThreadCount(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (count > 0)
+        return (int)count;
+#endif
+    return 1;
+}
+
+static void RunExtractQueue(struct ExtractQueue *queue, int numThreads)
+{
+    pthread_mutex_init(&queue->mutex, NULL);
+    queue->nextAsset = 0;
+
+    if (numThreads > queue->numAssets)
+        numThreads = queue->numAssets;
+
+    if (numThreads <= 1)
+    {
+        ExtractWorker(queue);
+    }
+    else
+    {
+        pthread_t *threads = malloc(sizeof(pthread_t) * numThreads);
+
+        if (threads == NULL)
+            FATAL_ERROR("Failed to allocate memory for worker threads.\n");
+
+        for (int i = 0; i < numThreads; i++)
+            if (pthread_create(&threads[i], NULL, ExtractWorker, queue) != 0)
+                FATAL_ERROR("Failed to create worker thread.\n");
+
+        for (int i = 0; i < numThreads; i++)
+            pthread_join(threads[i], NULL);
+
+        free(threads);
+    }
+
+    pthread_mutex_destroy(&queue->mutex);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+        FATAL_ERROR("Usage: romextract ROM_PATH ELF_PATH OUTPUT_DIR [-j THREADS]\n"
+                    "Decompresses every compressed asset of the ROM into OUTPUT_DIR, named\n"
+                    "by the SHA-1 of its contents, and prints \"HASH TYPE SYMBOL\" for each.\n");
+
+    char *romPath = argv[1];
+    char *elfPath = argv[2];
+    char *outputDir = argv[3];
+    int numThreads = GetDefaultThreadCount();
+
+    for (int i = 4; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-j") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No thread count following \"-j\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &numThreads))
+                FATAL_ERROR("Failed to parse thread count.\n");
+
+            if (numThreads < 1)
+                FATAL_ERROR("Thread count must be positive.\n");
+        }
+        else
+        {
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+        }
+    }
+
+    struct ExtractQueue queue;
+    struct SymbolTable symbols;
+
+    queue.rom = ReadWholeFile(romPath, &queue.romSize);
+    queue.outputDir = outputDir;
+    ReadSymbolTable(elfPath, &symbols);
+
+    // One asset for each distinct address in the ROM that has a symbol,
+    // as large as the largest symbol there.
+    uint32_t romEnd = ROM_START + queue.romSize;
+
+    queue.assets = malloc(sizeof(struct Asset) * (symbols.numSymbols + 1));
+    queue.numAssets = 0;
+
+    if (queue.assets == NULL)
+        FATAL_ERROR("Failed to allocate memory for assets.\n");
+
+    for (int i = 0; i < symbols.numSymbols; i++)
+    {
+        uint32_t address = symbols.symbols[i].address;
+        uint32_t size = symbols.symbols[i].size;
+
+        if (address >= ROM_START && address < romEnd)
+        {
+            struct Asset *asset = &queue.assets[queue.numAssets++];
+
+            asset->address = address;
+            asset->size = (size == 0 || size > romEnd - address) ? romEnd - address : size;
+            asset->type = NULL;
+        }
+    }
+
+    qsort(queue.assets, queue.numAssets, sizeof(struct Asset), CompareAssetAddresses);
+
+    int numUnique = 0;
+
+    for (int i = 0; i < queue.numAssets; i++)
+    {
+        if (numUnique > 0 && queue.assets[numUnique - 1].address == queue.assets[i].address)
+        {
+            struct Asset *last = &queue.assets[numUnique - 1];
+
+            if (last->size < queue.assets[i].size)
+                last->size = queue.assets[i].size;
+            continue;
+        }
+
+        queue.assets[numUnique++] = queue.assets[i];
+    }
+
+    queue.numAssets = numUnique;
+
+    MakeDir(outputDir);
+    RunExtractQueue(&queue, numThreads);
+
+    // Print the index by symbol name, so that the indexes of two builds can
+    // be diffed even when their assets moved.
+    qsort(symbols.symbols, symbols.numSymbols, sizeof(struct Symbol), CompareSymbolNames);
+
+    int numFound = 0;
+    int numNew = 0;
+
+    for (int i = 0; i < queue.numAssets; i++)
+    {
+        if (queue.assets[i].type != NULL)
+        {
+            numFound++;
+            numNew += queue.assets[i].isNew;
+        }
+    }
+
+    for (int i = 0; i < symbols.numSymbols; i++)
+    {
+        struct Asset *asset = FindAsset(queue.assets, queue.numAssets, symbols.symbols[i].address);
+
+        if (asset != NULL && asset->type != NULL)
+            printf("%s %s %s\n", asset->hash, asset->type, symbols.symbols[i].name);
+    }
+
+    fprintf(stderr, "%d compressed assets, %d of them new\n", numFound, numNew);
+
+    free(queue.assets);
+    free(queue.rom);
+    FreeSymbolTable(&symbols);
+    return 0;
+}
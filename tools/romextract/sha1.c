@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <string.h>
+#include "sha1.h"
+
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void Sha1Block(uint32_t state[5], const unsigned char *block)
+{
+	uint32_t w[80];
+
+	for (int i = 0; i < 16; i++)
+		w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+
+	for (int i = 16; i < 80; i++)
+		w[i] = ROTL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+	uint32_t a = state[0];
+	uint32_t b = state[1];
+	uint32_t c = state[2];
+	uint32_t d = state[3];
+	uint32_t e = state[4];
+
+	for (int i = 0; i < 80; i++) {
+		uint32_t f;
+		uint32_t k;
+
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5A827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8F1BBCDC;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6;
+		}
+
+		uint32_t temp = ROTL32(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = ROTL32(b, 30);
+		b = a;
+		a = temp;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+void Sha1Init(struct Sha1 *sha1)
+{
+	sha1->state[0] = 0x67452301;
+	sha1->state[1] = 0xEFCDAB89;
+	sha1->state[2] = 0x98BADCFE;
+	sha1->state[3] = 0x10325476;
+	sha1->state[4] = 0xC3D2E1F0;
+	sha1->length = 0;
+}
+
+void Sha1Update(struct Sha1 *sha1, const void *data, size_t size)
+{
+	const unsigned char *bytes = data;
+
+	while (size > 0) {
+		size_t blockPos = sha1->length % 64;
+		size_t count = 64 - blockPos;
+
+		if (count > size)
+			count = size;
+
+		memcpy(&sha1->block[blockPos], bytes, count);
+		sha1->length += count;
+		bytes += count;
+		size -= count;
+
+		if (sha1->length % 64 == 0)
+			Sha1Block(sha1->state, sha1->block);
+	}
+}
+
+void Sha1Final(struct Sha1 *sha1, char hex[41])
+{
+	uint64_t bitLength = sha1->length * 8;
+	unsigned char padding[72] = { 0x80 };
+	size_t paddingSize = 64 - ((sha1->length + 8) % 64);
+	unsigned char lengthBytes[8];
+
+	for (int i = 0; i < 8; i++)
+		lengthBytes[i] = (unsigned char)(bitLength >> (56 - i * 8));
+
+	Sha1Update(sha1, padding, paddingSize);
+	Sha1Update(sha1, lengthBytes, 8);
+
+	for (int i = 0; i < 5; i++)
+		sprintf(&hex[i * 8], "%08x", (unsigned int)sha1->state[i]);
+}
@@ -0,0 +1,19 @@
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Sha1 {
+	uint32_t state[5];
+	uint64_t length;
+	unsigned char block[64];
+};
+
+void Sha1Init(struct Sha1 *sha1);
+void Sha1Update(struct Sha1 *sha1, const void *data, size_t size);
+
+// Finishes the hash and writes it to hex as 40 hex digits and a terminator.
+void Sha1Final(struct Sha1 *sha1, char hex[41]);
+
+#endif // SHA1_H
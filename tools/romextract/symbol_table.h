@@ -0,0 +1,25 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <stdint.h>
+
+struct Symbol {
+    char *name;
+    uint32_t address;
+    uint32_t size;
+};
+
+// The data symbols of an ELF file's symbol table, local ones included. Most
+// have their size in the table. Labels in assembly have none, so theirs runs
+// up to the next address where a symbol or an allocated section starts or
+// ends, or is 0 if there is no such address.
+struct SymbolTable {
+    unsigned char *data;
+    struct Symbol *symbols;
+    int numSymbols;
+};
+
+void ReadSymbolTable(char *path, struct SymbolTable *table);
+void FreeSymbolTable(struct SymbolTable *table);
+
+#endif // SYMBOL_TABLE_H
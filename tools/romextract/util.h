@@ -0,0 +1,9 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stdbool.h>
+
+bool ParseNumber(char *s, char **end, int radix, int *intValue);
+unsigned char *ReadWholeFile(char *path, int *size);
+
+#endif // UTIL_H
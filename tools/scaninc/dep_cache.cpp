@@ -0,0 +1,175 @@
+#include <sys/stat.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "dep_cache.h"
+
+static const char *const CACHE_HEADER = "scaninc cache v1";
+
+static bool GetFileStamp(const std::string& path, long long& mtime, long long& size)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+
+#if defined(__linux__)
+    mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+    mtime = (long long)st.st_mtime;
+#endif
+    size = (long long)st.st_size;
+    return true;
+}
+
+DependencyCache::DependencyCache(std::string cachePath)
+    : m_cachePath(cachePath), m_dirty(false)
+{
+    if (!m_cachePath.empty())
+        Load();
+}
+
+void DependencyCache::Load()
+{
+    std::ifstream in(m_cachePath);
+
+    if (!in)
+        return;
+
+    std::string line;
+
+    if (!std::getline(in, line) || line != CACHE_HEADER)
+        return;
+
+    Entry *entry = nullptr;
+
+    while (std::getline(in, line))
+    {
+        if (line.size() < 2 || line[1] != ' ')
+            continue;
+
+        std::string value = line.substr(2);
+
+        switch (line[0])
+        {
+        case 'F':
+        {
+            std::istringstream fields(value);
+            int type;
+            Entry parsed;
+            std::string path;
+
+            if (!(fields >> type >> parsed.mtime >> parsed.size)
+             || fields.get() != ' '
+             || !std::getline(fields, path))
+            {
+                entry = nullptr;
+                break;
+            }
+
+            parsed.fresh = false;
+            parsed.file.type = static_cast<SourceFileType>(type);
+            parsed.file.srcDir = path.substr(0, path.rfind('/') + 1);
+            entry = &(m_entries[path] = parsed);
+            break;
+        }
+        case 'I':
+            if (entry != nullptr)
+                entry->file.includes.insert(value);
+            break;
+        case 'B':
+            if (entry != nullptr)
+                entry->file.incbins.insert(value);
+            break;
+        }
+    }
+}
+
+void DependencyCache::Save()
+{
+    if (m_cachePath.empty() || !m_dirty)
+        return;
+
+    std::string tmpPath = m_cachePath + ".tmp";
+    FILE *fp = std::fopen(tmpPath.c_str(), "wb");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", tmpPath.c_str());
+
+    std::fprintf(fp, "%s\n", CACHE_HEADER);
+
+    for (const auto& pair : m_entries)
+    {
+        const Entry& entry = pair.second;
+
+        std::fprintf(fp, "F %d %lld %lld %s\n", static_cast<int>(entry.file.type), entry.mtime, entry.size, pair.first.c_str());
+        for (const std::string& include : entry.file.includes)
+            std::fprintf(fp, "I %s\n", include.c_str());
+        for (const std::string& incbin : entry.file.incbins)
+            std::fprintf(fp, "B %s\n", incbin.c_str());
+    }
+
+    std::fclose(fp);
+
+    std::remove(m_cachePath.c_str());
+    if (std::rename(tmpPath.c_str(), m_cachePath.c_str()) != 0)
+        FATAL_ERROR("Failed to write \"%s\".\n", m_cachePath.c_str());
+
+    m_dirty = false;
+}
+
+const ScannedFile& DependencyCache::Get(std::string path)
+{
+    long long mtime = -1;
+    long long size = -1;
+    auto it = m_entries.find(path);
+
+    if (it != m_entries.end())
+    {
+        if (it->second.fresh)
+            return it->second.file;
+
+        if (GetFileStamp(path, mtime, size) && mtime == it->second.mtime && size == it->second.size)
+        {
+            it->second.fresh = true;
+            return it->second.file;
+        }
+    }
+    else
+    {
+        GetFileStamp(path, mtime, size);
+    }
+
+    SourceFile source(path);
+    Entry& entry = m_entries[path];
+
+    entry.mtime = mtime;
+    entry.size = size;
+    entry.fresh = true;
+    entry.file.type = source.FileType();
+    entry.file.srcDir = source.GetSrcDir();
+    entry.file.incbins = source.GetIncbins();
+    entry.file.includes = source.GetIncludes();
+    m_canOpen[path] = true;
+    m_dirty = true;
+
+    return entry.file;
+}
+
+bool DependencyCache::CanOpenFile(const std::string& path)
+{
+    auto it = m_canOpen.find(path);
+
+    if (it != m_canOpen.end())
+        return it->second;
+
+    FILE *fp = std::fopen(path.c_str(), "rb");
+    bool canOpen = (fp != NULL);
+
+    if (fp != NULL)
+        std::fclose(fp);
+
+    m_canOpen[path] = canOpen;
+    return canOpen;
+}
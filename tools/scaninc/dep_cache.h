@@ -0,0 +1,46 @@
+#ifndef DEP_CACHE_H
+#define DEP_CACHE_H
+
+#include <map>
+#include <set>
+#include <string>
+#include "source_file.h"
+
+// The parts of a scanned source file that dependency resolution needs.
+struct ScannedFile
+{
+    SourceFileType type;
+    std::string srcDir;
+    std::set<std::string> incbins;
+    std::set<std::string> includes;
+};
+
+// Keeps one ScannedFile per path for the lifetime of the process. If a cache
+// path is given, entries are also persisted between runs and reused as long
+// as the file's mtime and size have not changed.
+class DependencyCache
+{
+public:
+    DependencyCache(std::string cachePath);
+    const ScannedFile& Get(std::string path);
+    bool CanOpenFile(const std::string& path);
+    void Save();
+
+private:
+    struct Entry
+    {
+        long long mtime;
+        long long size;
+        bool fresh;
+        ScannedFile file;
+    };
+
+    std::string m_cachePath;
+    std::map<std::string, Entry> m_entries;
+    std::map<std::string, bool> m_canOpen;
+    bool m_dirty;
+
+    void Load();
+};
+
+#endif // DEP_CACHE_H
@@ -24,33 +24,114 @@
 #include <queue>
 #include <set>
 #include <string>
+#include <vector>
 #include "scaninc.h"
 #include "source_file.h"
+#include "dep_cache.h"
 
-bool CanOpenFile(std::string path)
+const char *const USAGE = "Usage: scaninc [-I INCLUDE_PATH] FILE_PATH\n"
+                          "       scaninc [-I INCLUDE_PATH] [-c CACHE_PATH] -M OBJ_DIR FILE_PATH...\n";
+
+std::set<std::string> ScanDependencies(DependencyCache& cache, std::vector<std::string> includeDirs, std::string initialPath)
 {
-    FILE *fp = std::fopen(path.c_str(), "rb");
+    std::queue<std::string> filesToProcess;
+    std::set<std::string> dependencies;
+
+    filesToProcess.push(initialPath);
+
+    while (!filesToProcess.empty())
+    {
+        std::string filePath = filesToProcess.front();
+        const ScannedFile& file = cache.Get(filePath);
+        filesToProcess.pop();
+
+        includeDirs.push_back(file.srcDir);
+        for (auto incbin : file.incbins)
+        {
+            dependencies.insert(incbin);
+        }
+        for (auto include : file.includes)
+        {
+            bool exists = false;
+            std::string path("");
+            for (auto includeDir : includeDirs)
+            {
+                path = includeDir + include;
+                if (cache.CanOpenFile(path))
+                {
+                    exists = true;
+                    break;
+                }
+            }
+            if (!exists && (file.type == SourceFileType::Asm || file.type == SourceFileType::Inc))
+            {
+                path = include;
+            }
+            bool inserted = dependencies.insert(path).second;
+            if (inserted && exists)
+            {
+                filesToProcess.push(path);
+            }
+        }
+        includeDirs.pop_back();
+    }
+
+    return dependencies;
+}
+
+// Writes OBJ_DIR/<path>.d listing the dependencies of OBJ_DIR/<path>.o.
+// The file is left untouched if its contents would not change.
+void WriteDepFile(std::string objDir, std::string srcPath, const std::set<std::string>& dependencies)
+{
+    std::size_t dot = srcPath.find_last_of('.');
+    std::string basePath = objDir + srcPath.substr(0, dot);
+    std::string depPath = basePath + ".d";
+    std::string contents = basePath + ".o:";
+
+    for (const std::string &path : dependencies)
+    {
+        contents += " \\\n ";
+        contents += path;
+    }
+    contents += "\n";
+
+    FILE *fp = std::fopen(depPath.c_str(), "rb");
+
+    if (fp != NULL)
+    {
+        std::string oldContents;
+        char buffer[4096];
+        std::size_t count;
+
+        while ((count = std::fread(buffer, 1, sizeof(buffer), fp)) > 0)
+            oldContents.append(buffer, count);
+
+        std::fclose(fp);
+
+        if (oldContents == contents)
+            return;
+    }
+
+    fp = std::fopen(depPath.c_str(), "wb");
 
     if (fp == NULL)
-        return false;
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", depPath.c_str());
 
+    std::fwrite(contents.data(), 1, contents.size(), fp);
     std::fclose(fp);
-    return true;
 }
 
-const char *const USAGE = "Usage: scaninc [-I INCLUDE_PATH] FILE_PATH\n";
-
 int main(int argc, char **argv)
 {
-    std::queue<std::string> filesToProcess;
-    std::set<std::string> dependencies;
-
     std::vector<std::string> includeDirs;
+    std::string cachePath;
+    std::string objDir;
+    bool batch = false;
 
     argc--;
     argv++;
 
-    while (argc > 1)
+    while (argc > 1 && argv[0][0] == '-')
     {
         std::string arg(argv[0]);
         if (arg.substr(0, 2) == "-I")
@@ -68,6 +149,23 @@ int main(int argc, char **argv)
             }
             includeDirs.push_back(includeDir);
         }
+        else if (arg == "-c")
+        {
+            argc--;
+            argv++;
+            cachePath = std::string(argv[0]);
+        }
+        else if (arg == "-M")
+        {
+            argc--;
+            argv++;
+            objDir = std::string(argv[0]);
+            if (!objDir.empty() && objDir.back() != '/')
+            {
+                objDir += '/';
+            }
+            batch = true;
+        }
         else
         {
             FATAL_ERROR(USAGE);
@@ -76,53 +174,27 @@ int main(int argc, char **argv)
         argv++;
     }
 
-    if (argc != 1) {
+    if (argc < 1 || (!batch && argc != 1)) {
         FATAL_ERROR(USAGE);
     }
 
-    std::string initialPath(argv[0]);
+    DependencyCache cache(cachePath);
 
-    filesToProcess.push(initialPath);
-
-    while (!filesToProcess.empty())
+    if (!batch)
     {
-        std::string filePath = filesToProcess.front();
-        SourceFile file(filePath);
-        filesToProcess.pop();
-
-        includeDirs.push_back(file.GetSrcDir());
-        for (auto incbin : file.GetIncbins())
+        for (const std::string &path : ScanDependencies(cache, includeDirs, argv[0]))
         {
-            dependencies.insert(incbin);
+            std::printf("%s\n", path.c_str());
         }
-        for (auto include : file.GetIncludes())
+    }
+    else
+    {
+        for (int i = 0; i < argc; i++)
         {
-            bool exists = false;
-            std::string path("");
-            for (auto includeDir : includeDirs)
-            {
-                path = includeDir + include;
-                if (CanOpenFile(path))
-                {
-                    exists = true;
-                    break;
-                }
-            }
-            if (!exists && (file.FileType() == SourceFileType::Asm || file.FileType() == SourceFileType::Inc))
-            {
-                path = include;
-            }
-            bool inserted = dependencies.insert(path).second;
-            if (inserted && exists)
-            {
-                filesToProcess.push(path);
-            }
+            std::string srcPath(argv[i]);
+            WriteDepFile(objDir, srcPath, ScanDependencies(cache, includeDirs, srcPath));
         }
-        includeDirs.pop_back();
     }
 
-    for (const std::string &path : dependencies)
-    {
-        std::printf("%s\n", path.c_str());
-    }
+    cache.Save();
 }